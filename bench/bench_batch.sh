@@ -0,0 +1,37 @@
+#!/bin/sh
+#
+#  bench_batch.sh
+#
+#  Author: Joseph Erlinger
+#      Created on: October 17, 2026
+#
+#  Measures file mode throughput in commands/sec on a generated batch file
+#  of cheap builtins, read both from a regular file (mapped) and from a pipe
+#  (streamed).
+#
+#  Usage: bench/bench_batch.sh [shell] [lines]
+#
+
+SHELL_BIN=$(realpath "${1:-./pseudo-shell}")
+LINES=${2:-1000000}
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+# Three commands per line.
+awk -v n="$LINES" 'BEGIN { for (i = 0; i < n; i++) print "cd .; pwd; cd ." }' \
+    > "$DIR/batch.txt"
+COMMANDS=$((LINES * 3))
+
+now () { date +%s%N; }
+
+run () {
+    start=$(now)
+    (cd "$DIR" && eval "$1") > /dev/null
+    end=$(now)
+    awk -v c="$COMMANDS" -v ns=$((end - start)) -v what="$2" \
+        'BEGIN { printf "%-8s %10d commands %8.3f s %12.0f commands/sec\n",
+                 what, c, ns / 1e9, c / (ns / 1e9) }'
+}
+
+run "\"$SHELL_BIN\" -f batch.txt" "mapped"
+run "cat batch.txt | \"$SHELL_BIN\" -f /dev/stdin" "streamed"
@@ -0,0 +1,168 @@
+/*
+ *  bench_cat.c
+ *
+ *  Author: Joseph Erlinger
+ *      Created on: October 17, 2026
+ *
+ *  Compares the old cat path (BUFSIZ read/write loop) against stream_data()
+ *  from src/copy.c, writing to a regular file (like output.txt in file mode)
+ *  and to a pipe, and names the method stream_data() picked. A file of 8 MiB
+ *  or more written to a file goes through io_uring when it is available.
+ *
+ *  Usage: bench/bench_cat [-d dir] [size ...]    e.g. bench/bench_cat 1M 100M 2G
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "../src/copy.h"
+
+
+#define REPEAT 5
+
+
+static double now (void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}   /* now */
+
+
+static off_t parse_size (const char *arg)
+{
+    char *end;
+    off_t n;
+
+    n = strtoll(arg, &end, 10);
+    switch (*end) {
+        case 'G': n <<= 10;  /* fallthrough */
+        case 'M': n <<= 10;  /* fallthrough */
+        case 'K': n <<= 10;
+    }
+    return n;
+}   /* parse_size */
+
+
+/* The displayFile() loop as it was before stream_data(). */
+static void old_cat (int fd, int out)
+{
+    char *line_buf;
+    ssize_t filepos;
+
+    line_buf = malloc(BUFSIZ);
+    while ((filepos = read(fd, line_buf, BUFSIZ)) > 0)
+        if (write(out, line_buf, filepos) == -1)
+            break;
+    free(line_buf);
+}   /* old_cat */
+
+
+/* Run one cat of path into out, which is a file or the write end of a pipe
+whose reader is drained by a child process. Returns seconds taken, and the
+method stream_data() used in report. */
+static double run (const char *path, const char *out_path, int use_pipe,
+                   int use_new, copy_report *report)
+{
+    int fd, out, pfd[2];
+    pid_t child;
+    double start, elapsed;
+    char buf[1 << 16];
+
+    child = -1;
+    fd = open(path, O_RDONLY);
+    if (use_pipe) {
+        if (pipe(pfd) == -1)
+            exit(EXIT_FAILURE);
+        if ((child = fork()) == 0) {
+            close(pfd[1]);
+            while (read(pfd[0], buf, sizeof(buf)) > 0)
+                ;
+            _exit(0);
+        }
+        close(pfd[0]);
+        out = pfd[1];
+    } else {
+        out = open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+
+    start = now();
+    if (use_new)
+        stream_data(fd, out, report);
+    else
+        old_cat(fd, out);
+    close(out);
+    if (child > 0)
+        waitpid(child, NULL, 0);
+    elapsed = now() - start;
+
+    close(fd);
+    return elapsed;
+}   /* run */
+
+
+int main (int argc, char *argv[])
+{
+    const char *dir = "/tmp";
+    const char *defaults[] = {"1M", "100M"};
+    char in_path[4096], out_path[4096];
+    char block[1 << 16];
+    off_t size, done;
+    int opt, i, fd, use_pipe, nsizes, rep;
+    const char **sizes;
+    double t, t_old, t_new, mb;
+    copy_report report;
+
+    while ((opt = getopt(argc, argv, "d:")) != -1) {
+        if (opt != 'd') {
+            fprintf(stderr, "Usage: %s [-d dir] [size ...]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+        dir = optarg;
+    }
+    sizes = optind < argc ? (const char **) argv + optind : defaults;
+    nsizes = optind < argc ? argc - optind : 2;
+
+    memset(block, 'x', sizeof(block));
+    for (i = 0; i < (int) sizeof(block); i += 80)
+        block[i] = '\n';
+    snprintf(in_path, sizeof(in_path), "%s/bench_cat.in", dir);
+    snprintf(out_path, sizeof(out_path), "%s/bench_cat.out", dir);
+
+    printf("%-8s %-6s %12s %12s %9s  %s\n", "size", "output", "old MB/s",
+           "new MB/s", "speedup", "method");
+    for (i = 0; i < nsizes; i++) {
+        size = parse_size(sizes[i]);
+        fd = open(in_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        for (done = 0; done < size; done += sizeof(block))
+            if (write(fd, block, size - done < (off_t) sizeof(block)
+                      ? size - done : (off_t) sizeof(block)) == -1)
+                return EXIT_FAILURE;
+        close(fd);
+        mb = size / 1048576.0;
+
+        for (use_pipe = 0; use_pipe <= 1; use_pipe++) {
+            run(in_path, out_path, use_pipe, 0, NULL);    // Warm the cache.
+            t_old = t_new = 1e9;
+            for (rep = 0; rep < REPEAT; rep++) {        // Best of REPEAT runs.
+                t = run(in_path, out_path, use_pipe, 0, NULL);
+                t_old = t < t_old ? t : t_old;
+                t = run(in_path, out_path, use_pipe, 1, &report);
+                t_new = t < t_new ? t : t_new;
+            }
+            printf("%-8s %-6s %12.1f %12.1f %8.2fx  %s\n", sizes[i],
+                   use_pipe ? "pipe" : "file", mb / t_old, mb / t_new,
+                   t_old / t_new, copy_method_name(report.method));
+        }
+    }
+    unlink(in_path);
+    unlink(out_path);
+    return EXIT_SUCCESS;
+}   /* main */
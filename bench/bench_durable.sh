@@ -0,0 +1,64 @@
+#!/bin/sh
+#
+#  bench_durable.sh
+#
+#  Author: Joseph Erlinger
+#      Created on: October 17, 2026
+#
+#  Measures the throughput of cp at each durability level (pseudo-shell -d):
+#
+#    small    many small files copied by one cp, so each level's syncs are
+#             one group commit
+#    lines    the same files with one cp per line, so one commit per file
+#    bulk     one large file
+#
+#  The files are written under dir (default: a new directory in the current
+#  one, since /tmp may be a tmpfs where syncs cost nothing).
+#
+#  Usage: bench/bench_durable.sh [shell] [files] [dir]
+#
+
+SHELL_BIN=$(realpath "${1:-./pseudo-shell}")
+FILES=${2:-200}
+DIR=$(mktemp -d "${3:-.}/bench_durable.XXXXXX")
+DIR=$(realpath "$DIR")
+trap 'rm -rf "$DIR"' EXIT
+
+SMALL=16384                     # Bytes per small file.
+BULK_MB=256
+
+mkdir "$DIR/src"
+i=0
+while [ $i -lt "$FILES" ]; do
+    head -c $SMALL /dev/urandom > "$DIR/src/f$i"
+    i=$((i + 1))
+done
+head -c $((BULK_MB << 20)) /dev/urandom > "$DIR/bulk"
+
+# One line copying every file, and one line per file.
+echo "cp $(cd "$DIR/src" && ls | sed 's|^|src/|' | tr '\n' ' ')dst" \
+    > "$DIR/small.txt"
+(cd "$DIR/src" && ls | awk '{ print "cp src/" $0 " dst" }') > "$DIR/lines.txt"
+echo "cp bulk dst/bulk" > "$DIR/bulk.txt"
+
+now () { date +%s%N; }
+
+# run <level> <batch> <files> <bytes>
+run () {
+    rm -rf "$DIR/dst"
+    mkdir "$DIR/dst"
+    sync
+    start=$(now)
+    (cd "$DIR" && "$SHELL_BIN" -d "$1" -f "$2.txt") > /dev/null
+    end=$(now)
+    awk -v f="$3" -v b="$4" -v ns=$((end - start)) -v what="$1 $2" \
+        'BEGIN { s = ns / 1e9;
+                 printf "%-14s %6d files %8.3f s %10.0f files/sec %9.1f MB/s\n",
+                 what, f, s, f / s, b / s / 1e6 }'
+}
+
+for level in none data direct atomic; do
+    run $level small "$FILES" $((FILES * SMALL))
+    run $level lines "$FILES" $((FILES * SMALL))
+    run $level bulk 1 $((BULK_MB << 20))
+done
@@ -0,0 +1,430 @@
+/*
+ *  bench_run.c
+ *
+ *  Author: Joseph Erlinger
+ *      Created on: October 17, 2026
+ *
+ *  Runs pseudo-shell -f on each batch file written by bench/gen_batch.sh and
+ *  reports commands/sec, bytes/sec, peak RSS and the number of read-like and
+ *  write-like calls (syscr + syscw of /proc/<pid>/io, read before the child
+ *  is reaped; other syscalls are not counted), each the median of the
+ *  repeats. Results can be saved as JSON and compared against a baseline
+ *  saved the same way; a workload that got slower, bigger or chattier than
+ *  the tolerance allows is flagged and the exit status is 1.
+ *
+ *  The shell runs in dir through a symbolic link of fixed length under
+ *  /tmp, so the paths pwd prints, and with them the bytes and calls, do not
+ *  depend on where the tree is checked out. The repeats go round the
+ *  workloads in turn, so the samples of each are spread over the whole run
+ *  and its spread shows the machine's slower and faster spells too.
+ *
+ *  Peak RSS and call counts barely move from run to run, so they are held
+ *  to the tight tolerance of -t. Wall time is noisy, so commands/sec and
+ *  bytes/sec are held to the looser -T, widened further to NOISE_FACTOR
+ *  times the spread (median absolute deviation) seen in this run or in the
+ *  baseline, whichever is larger.
+ *
+ *  Usage: bench/bench_run [-s shell] [-d dir] [-r repeat] [-o out.json]
+ *                         [-b baseline.json] [-t tolerance%]
+ *                         [-T time tolerance%]
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+
+static const char *workloads[] = {"tiny", "payload", "deep", "wide"};
+#define NWORKLOADS (int) (sizeof(workloads) / sizeof(workloads[0]))
+
+#define MAX_REPEAT 99
+#define NOISE_FACTOR 3          // Spreads a timing may move by unflagged.
+#define LINK_TEMPLATE "/tmp/bench_run.XXXXXX"   // Holds the link "work".
+
+
+typedef struct result {
+    double seconds;             // Median wall time of the repeats.
+    double spread;              // Median absolute deviation of the wall
+                                //   time, as a fraction of the median.
+    double commands_per_sec;
+    double bytes_per_sec;       // rchar + wchar over seconds.
+    long peak_rss_kb;           // Median of the repeats.
+    long io_calls;              // syscr + syscw, median of the repeats.
+} result;
+
+
+/* The repeats of one workload so far. */
+typedef struct samples {
+    long commands;              // # Commands in its batch file.
+    double seconds[MAX_REPEAT];
+    double rss[MAX_REPEAT];
+    double bytes[MAX_REPEAT];
+    double io_calls[MAX_REPEAT];
+} samples;
+
+
+static double now (void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}   /* now */
+
+
+/* Number of commands in a batch file: non-blank segments between ';' and
+newlines. */
+static long count_commands (const char *path)
+{
+    FILE *f;
+    long count;
+    int c, blank;
+
+    if ((f = fopen(path, "r")) == NULL)
+        return -1;
+    count = 0;
+    blank = 1;
+    while ((c = getc(f)) != EOF) {
+        if (c == ';' || c == '\n') {
+            count += !blank;
+            blank = 1;
+        } else if (c != ' ' && c != '\t' && c != '\r') {
+            blank = 0;
+        }
+    }
+    count += !blank;
+    fclose(f);
+    return count;
+}   /* count_commands */
+
+
+static long io_field (const char *text, const char *key)
+{
+    const char *p;
+
+    p = strstr(text, key);
+    return p == NULL ? 0 : strtol(p + strlen(key), NULL, 10);
+}   /* io_field */
+
+
+/* Run the shell on one batch file inside dir. Fills in the time, peak RSS
+(KiB), bytes and read/write calls of the run. Returns -1 if it did not exit
+0. */
+static int run_once (const char *shell, const char *dir, const char *batch,
+                     double *seconds, long *rss, long *bytes, long *io_calls)
+{
+    char path[64], buf[512];
+    struct rusage ru;
+    siginfo_t info;
+    double start;
+    ssize_t n;
+    pid_t pid;
+    int fd, status;
+
+    start = now();
+    if ((pid = fork()) == 0) {
+        fd = open("/dev/null", O_WRONLY);
+        dup2(fd, 1);
+        dup2(fd, 2);
+        if (chdir(dir) == -1 || setenv("PWD", dir, 1) == -1)
+            _exit(127);                 // PWD keeps the link in pwd's path.
+        execl(shell, shell, "-f", batch, (char *) NULL);
+        _exit(127);
+    }
+    if (pid == -1 || waitid(P_PID, pid, &info, WEXITED | WNOWAIT) == -1)
+        return -1;
+    *seconds = now() - start;
+
+    /* The zombie still has its I/O accounting until it is reaped. */
+    *bytes = *io_calls = 0;
+    snprintf(path, sizeof(path), "/proc/%d/io", (int) pid);
+    if ((fd = open(path, O_RDONLY)) != -1) {
+        if ((n = read(fd, buf, sizeof(buf) - 1)) > 0) {
+            buf[n] = '\0';
+            *bytes = io_field(buf, "rchar: ") + io_field(buf, "wchar: ");
+            *io_calls = io_field(buf, "syscr: ") + io_field(buf, "syscw: ");
+        }
+        close(fd);
+    }
+    if (wait4(pid, &status, 0, &ru) == -1)
+        return -1;
+    *rss = ru.ru_maxrss;
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : -1;
+}   /* run_once */
+
+
+static int compare_doubles (const void *a, const void *b)
+{
+    double x = *(const double *) a, y = *(const double *) b;
+
+    return x < y ? -1 : x > y;
+}   /* compare_doubles */
+
+
+/* Median of the n values of v, which are sorted in place. */
+static double median (double *v, int n)
+{
+    qsort(v, n, sizeof(double), compare_doubles);
+    return n % 2 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+}   /* median */
+
+
+/* Run one workload once more, as repeat number i. */
+static int run_workload (const char *shell, const char *dir, const char *name,
+                         int i, samples *s)
+{
+    char batch[PATH_MAX], path[PATH_MAX];
+    long rss, bytes, io_calls;
+
+    snprintf(batch, sizeof(batch), "%s.txt", name);
+    if (i == 0) {
+        snprintf(path, sizeof(path), "%s/%s", dir, batch);
+        if ((s->commands = count_commands(path)) == -1)
+            return -1;
+    }
+    if (run_once(shell, dir, batch, &s->seconds[i], &rss, &bytes,
+                 &io_calls) == -1)
+        return -1;
+    s->rss[i] = rss;
+    s->bytes[i] = bytes;
+    s->io_calls[i] = io_calls;
+    return 0;
+}   /* run_workload */
+
+
+/* Medians of the repeat samples of a workload. */
+static void summarize (samples *s, int repeat, result *r)
+{
+    int i;
+
+    r->seconds = median(s->seconds, repeat);
+    r->peak_rss_kb = median(s->rss, repeat);
+    r->io_calls = median(s->io_calls, repeat);
+    r->commands_per_sec = s->commands / r->seconds;
+    r->bytes_per_sec = median(s->bytes, repeat) / r->seconds;
+    for (i = 0; i < repeat; i++)
+        s->seconds[i] = s->seconds[i] > r->seconds
+                        ? s->seconds[i] - r->seconds
+                        : r->seconds - s->seconds[i];
+    r->spread = median(s->seconds, repeat) / r->seconds;
+}   /* summarize */
+
+
+/* Make link, a copy of LINK_TEMPLATE with "/work" appended, a symbolic
+link to dir. Returns 0, or -1 with errno set. */
+static int link_dir (const char *dir, char *link)
+{
+    char target[PATH_MAX];
+
+    strcpy(link, LINK_TEMPLATE);
+    if (realpath(dir, target) == NULL || mkdtemp(link) == NULL)
+        return -1;
+    strcat(link, "/work");
+    return symlink(target, link);
+}   /* link_dir */
+
+
+static void unlink_dir (char *link)
+{
+    unlink(link);
+    *strrchr(link, '/') = '\0';
+    rmdir(link);
+}   /* unlink_dir */
+
+
+static void write_json (FILE *f, const result *results)
+{
+    int i;
+
+    fprintf(f, "{\n");
+    for (i = 0; i < NWORKLOADS; i++)
+        fprintf(f, "  \"%s\": {\"seconds\": %.6f, \"spread\": %.4f, "
+                "\"commands_per_sec\": %.0f, \"bytes_per_sec\": %.0f, "
+                "\"peak_rss_kb\": %ld, \"io_calls\": %ld}%s\n", workloads[i],
+                results[i].seconds, results[i].spread,
+                results[i].commands_per_sec, results[i].bytes_per_sec,
+                results[i].peak_rss_kb, results[i].io_calls,
+                i + 1 < NWORKLOADS ? "," : "");
+    fprintf(f, "}\n");
+}   /* write_json */
+
+
+/* Value of key inside the object of workload name in a JSON file written by
+write_json(). Returns -1 if either is missing. */
+static double json_field (const char *json, const char *name, const char *key)
+{
+    char pattern[64];
+    const char *obj, *end, *p;
+
+    snprintf(pattern, sizeof(pattern), "\"%s\": {", name);
+    if ((obj = strstr(json, pattern)) == NULL
+        || (end = strchr(obj, '}')) == NULL)
+        return -1;
+    snprintf(pattern, sizeof(pattern), "\"%s\": ", key);
+    if ((p = strstr(obj, pattern)) == NULL || p > end)
+        return -1;
+    return strtod(p + strlen(pattern), NULL);
+}   /* json_field */
+
+
+/* The m'th metric of compare(), in the order of its table. */
+static double metric (const result *r, int m)
+{
+    switch (m) {
+        case 0: return r->commands_per_sec;
+        case 1: return r->bytes_per_sec;
+        case 2: return r->peak_rss_kb;
+        default: return r->io_calls;
+    }
+}   /* metric */
+
+
+/* Flag every metric that moved the wrong way by more than its tolerance:
+tolerance percent for the counts, and for the timings time_tolerance
+percent or NOISE_FACTOR spreads, whichever is larger. Returns the number of
+regressions. */
+static int compare (const char *baseline_path, const result *results,
+                    double tolerance, double time_tolerance)
+{
+    static const struct {
+        const char *key;
+        int higher_is_better;
+        int timed;              // Derived from the wall time.
+    } metrics[] = {
+        {"commands_per_sec", 1, 1},
+        {"bytes_per_sec", 1, 1},
+        {"peak_rss_kb", 0, 0},
+        {"io_calls", 0, 0},
+    };
+    char json[1 << 16];
+    double base, cur, change, allowed, spread;
+    size_t n;
+    FILE *f;
+    int i, m, regressions;
+
+    if ((f = fopen(baseline_path, "r")) == NULL) {
+        perror(baseline_path);
+        return 1;
+    }
+    n = fread(json, 1, sizeof(json) - 1, f);
+    json[n] = '\0';
+    fclose(f);
+
+    regressions = 0;
+    printf("\nagainst %s (tolerance %.0f%%, timings %.0f%% or %d spreads):\n",
+           baseline_path, tolerance, time_tolerance, NOISE_FACTOR);
+    for (i = 0; i < NWORKLOADS; i++) {
+        spread = json_field(json, workloads[i], "spread");  // -1 if absent.
+        if (results[i].spread > spread)
+            spread = results[i].spread;
+        for (m = 0; m < (int) (sizeof(metrics) / sizeof(metrics[0])); m++) {
+            base = json_field(json, workloads[i], metrics[m].key);
+            if (base <= 0)
+                continue;
+            allowed = tolerance;
+            if (metrics[m].timed) {
+                allowed = NOISE_FACTOR * spread * 100;
+                if (allowed < time_tolerance)
+                    allowed = time_tolerance;
+            }
+            cur = metric(&results[i], m);
+            change = (cur - base) / base * 100;
+            if (!metrics[m].higher_is_better)
+                change = -change;
+            if (change < -allowed) {
+                printf("  REGRESSION %-8s %-17s %14.0f -> %14.0f (%+.1f%%, "
+                       "allowed %.0f%%)\n", workloads[i], metrics[m].key,
+                       base, cur, (cur - base) / base * 100, allowed);
+                regressions++;
+            }
+        }
+    }
+    if (regressions == 0)
+        printf("  no regressions\n");
+    return regressions;
+}   /* compare */
+
+
+int main (int argc, char *argv[])
+{
+    const char *shell_arg = "./pseudo-shell", *dir = "bench/work";
+    const char *out_path = NULL, *baseline_path = NULL;
+    char shell[PATH_MAX];
+    char link[sizeof(LINK_TEMPLATE) + 8];   // dir, seen from a fixed path.
+    static samples runs[NWORKLOADS];
+    result results[NWORKLOADS];
+    double tolerance = 5, time_tolerance = 25;
+    int opt, repeat = 5, i, rep;
+    FILE *out;
+
+    while ((opt = getopt(argc, argv, "s:d:r:o:b:t:T:")) != -1) {
+        switch (opt) {
+            case 's': shell_arg = optarg; break;
+            case 'd': dir = optarg; break;
+            case 'r': repeat = atoi(optarg); break;
+            case 'o': out_path = optarg; break;
+            case 'b': baseline_path = optarg; break;
+            case 't': tolerance = atof(optarg); break;
+            case 'T': time_tolerance = atof(optarg); break;
+            default:
+                fprintf(stderr, "Usage: %s [-s shell] [-d dir] [-r repeat] "
+                        "[-o out.json] [-b baseline.json] [-t tolerance%%] "
+                        "[-T time tolerance%%]\n",
+                        argv[0]);
+                return 2;
+        }
+    }
+    if (repeat < 1 || repeat > MAX_REPEAT) {
+        fprintf(stderr, "%s: repeat must be 1 to %d\n", argv[0], MAX_REPEAT);
+        return 2;
+    }
+    if (realpath(shell_arg, shell) == NULL) {
+        perror(shell_arg);
+        return 2;
+    }
+
+    if (link_dir(dir, link) == -1) {
+        perror(dir);
+        return 2;
+    }
+    for (rep = 0; rep < repeat; rep++)
+        for (i = 0; i < NWORKLOADS; i++)
+            if (run_workload(shell, link, workloads[i], rep, &runs[i]) == -1) {
+                fprintf(stderr, "%s: %s/%s.txt failed\n", argv[0], dir,
+                        workloads[i]);
+                unlink_dir(link);
+                return 2;
+            }
+    unlink_dir(link);
+
+    printf("%-8s %10s %7s %14s %12s %10s %12s\n", "workload", "seconds",
+           "spread", "commands/sec", "MB/sec", "peak RSS", "r/w calls");
+    for (i = 0; i < NWORKLOADS; i++) {
+        summarize(&runs[i], repeat, &results[i]);
+        printf("%-8s %10.3f %6.1f%% %14.0f %12.1f %7ld KiB %12ld\n",
+               workloads[i], results[i].seconds, results[i].spread * 100,
+               results[i].commands_per_sec,
+               results[i].bytes_per_sec / 1048576, results[i].peak_rss_kb,
+               results[i].io_calls);
+    }
+
+    if (out_path != NULL) {
+        if ((out = fopen(out_path, "w")) == NULL) {
+            perror(out_path);
+            return 2;
+        }
+        write_json(out, results);
+        fclose(out);
+    }
+    if (baseline_path != NULL
+        && compare(baseline_path, results, tolerance, time_tolerance))
+        return 1;
+    return 0;
+}   /* main */
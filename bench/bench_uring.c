@@ -0,0 +1,112 @@
+/*
+ *  bench_uring.c
+ *
+ *  Author: Joseph Erlinger
+ *      Created on: October 17, 2026
+ *
+ *  Copies one file with the blocking backend and with io_uring at several
+ *  queue depths, and prints the throughput of each.
+ *
+ *  Usage: bench/bench_uring [-s size] [-i input_dir] [-o output_dir]
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include "../src/iobackend.h"
+#include "../src/uring.h"
+
+
+#define REPEAT 3
+
+
+static double now (void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}   /* now */
+
+
+/* Best time of REPEAT copies; depth 0 means the blocking backend. */
+static double run (const char *in_path, const char *out_path, off_t size,
+                   int depth)
+{
+    double best, start, t;
+    int in, out, rep;
+    off_t n;
+
+    best = 1e9;
+    for (rep = 0; rep < REPEAT; rep++) {
+        in = open(in_path, O_RDONLY);
+        out = open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        start = now();
+        if (depth == 0)
+            n = sync_backend.transfer(in, 0, out, 0, size);
+        else
+            n = uring_transfer(in, 0, out, 0, size, depth);
+        fsync(out);
+        t = now() - start;
+        close(in);
+        close(out);
+        if (n != size) {
+            perror("transfer");
+            exit(EXIT_FAILURE);
+        }
+        best = t < best ? t : best;
+    }
+    return best;
+}   /* run */
+
+
+int main (int argc, char *argv[])
+{
+    const char *in_dir = "/tmp", *out_dir = "/tmp";
+    char in_path[4096], out_path[4096];
+    static char block[1 << 20];
+    int depths[] = {1, 2, 4, 8, 16, 32, 64};
+    off_t size, done;
+    double mb, t;
+    int opt, fd, i;
+
+    size = 512 << 20;
+    while ((opt = getopt(argc, argv, "s:i:o:")) != -1) {
+        switch (opt) {
+            case 's': size = strtoll(optarg, NULL, 10) << 20; break;
+            case 'i': in_dir = optarg; break;
+            case 'o': out_dir = optarg; break;
+            default:
+                fprintf(stderr, "Usage: %s [-s MiB] [-i dir] [-o dir]\n",
+                        argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (!uring_available()) {
+        fprintf(stderr, "io_uring is not available\n");
+        return EXIT_FAILURE;
+    }
+    snprintf(in_path, sizeof(in_path), "%s/bench_uring.in", in_dir);
+    snprintf(out_path, sizeof(out_path), "%s/bench_uring.out", out_dir);
+    memset(block, 'x', sizeof(block));
+    fd = open(in_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    for (done = 0; done < size; done += sizeof(block))
+        if (write(fd, block, sizeof(block)) == -1)
+            return EXIT_FAILURE;
+    close(fd);
+    mb = size / 1048576.0;
+
+    printf("%-10s %10s\n", "backend", "MB/s");
+    t = run(in_path, out_path, size, 0);
+    printf("%-10s %10.1f\n", "sync", mb / t);
+    for (i = 0; i < (int) (sizeof(depths) / sizeof(depths[0])); i++) {
+        t = run(in_path, out_path, size, depths[i]);
+        printf("uring qd%-2d %10.1f\n", depths[i], mb / t);
+    }
+    unlink(in_path);
+    unlink(out_path);
+    return EXIT_SUCCESS;
+}   /* main */
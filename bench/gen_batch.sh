@@ -0,0 +1,51 @@
+#!/bin/sh
+#
+#  gen_batch.sh
+#
+#  Author: Joseph Erlinger
+#      Created on: October 17, 2026
+#
+#  Writes the synthetic batch files run by bench/bench_run into dir, along
+#  with the files and directories they use:
+#
+#    tiny.txt     many cheap builtins, three per line
+#    payload.txt  cat and cp of a large file
+#    deep.txt     a long mkdir/cd chain, walked back up and removed
+#    wide.txt     ls of a directory with many entries
+#
+#  Usage: bench/gen_batch.sh dir [scale]    (scale 1 is the default size)
+#
+
+DIR=${1:?usage: gen_batch.sh dir [scale]}
+SCALE=${2:-1}
+mkdir -p "$DIR"
+cd "$DIR" || exit 1
+
+# 300k commands at scale 1.
+awk -v n=$((100000 * SCALE)) \
+    'BEGIN { for (i = 0; i < n; i++) print "pwd; cd .; pwd" }' > tiny.txt
+
+# A 64 MiB payload, catted and copied 8 times at scale 1.
+head -c $((64 * 1048576)) /dev/urandom > payload.bin
+awk -v n=$((8 * SCALE)) 'BEGIN {
+    for (i = 0; i < n; i++) {
+        print "cat payload.bin"
+        print "cp payload.bin payload.copy; cp payload.copy payload.again"
+        print "rm payload.copy payload.again"
+    }
+}' > payload.txt
+
+# A chain 1000 directories deep, entered, left and removed.
+awk -v n=$((1000 * SCALE)) 'BEGIN {
+    for (i = 0; i < n; i++) print "mkdir d; cd d; pwd"
+    for (i = 0; i < n; i++) print "cd .."
+    print "rm -r d"
+}' > deep.txt
+
+# 20k entries, listed in all three forms 20 times at scale 1.
+rm -rf wide
+mkdir wide
+seq 1 $((20000 * SCALE)) | sed 's/^/entry_/' | (cd wide && xargs touch)
+awk -v n=$((20 * SCALE)) \
+    'BEGIN { for (i = 0; i < n; i++) print "ls -U wide; ls wide; ls -l wide" }' \
+    > wide.txt
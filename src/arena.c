@@ -0,0 +1,181 @@
+/*
+ *  arena.c
+ *
+ *  Author: Joseph Erlinger
+ *      Created on: October 17, 2026
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include "arena.h"
+
+
+#define ALIGNMENT 16
+
+
+__thread arena line_arena;
+alloc_counters alloc_stats;
+
+
+void *counted_malloc (size_t size)
+{
+    __atomic_fetch_add(&alloc_stats.mallocs, 1, __ATOMIC_RELAXED);
+    return malloc(size);
+}   /* counted_malloc */
+
+
+void *counted_calloc (size_t count, size_t size)
+{
+    __atomic_fetch_add(&alloc_stats.mallocs, 1, __ATOMIC_RELAXED);
+    return calloc(count, size);
+}   /* counted_calloc */
+
+
+void *counted_realloc (void *ptr, size_t size)
+{
+    __atomic_fetch_add(&alloc_stats.mallocs, 1, __ATOMIC_RELAXED);
+    return realloc(ptr, size);
+}   /* counted_realloc */
+
+
+void *counted_memalign (size_t alignment, size_t size)
+{
+    void *ptr;
+    int error;
+
+    __atomic_fetch_add(&alloc_stats.mallocs, 1, __ATOMIC_RELAXED);
+    if ((error = posix_memalign(&ptr, alignment, size)) != 0) {
+        errno = error;
+        return NULL;
+    }
+    return ptr;
+}   /* counted_memalign */
+
+
+void counted_free (void *ptr)
+{
+    if (ptr == NULL)
+        return;
+    __atomic_fetch_add(&alloc_stats.frees, 1, __ATOMIC_RELAXED);
+    free(ptr);
+}   /* counted_free */
+
+
+/* Returns size bytes aligned to ALIGNMENT, or NULL if out of memory. A new
+chunk is only added when the current one is full. */
+void *arena_alloc (arena *a, size_t size)
+{
+    arena_chunk *chunk;     // Chunk to allocate from.
+    size_t off;             // Aligned offset of the allocation in the chunk.
+    size_t chunk_size;      // Size of a new chunk.
+
+    chunk = a->head;
+    off = chunk == NULL ? 0
+          : (chunk->used + ALIGNMENT - 1) & ~(size_t) (ALIGNMENT - 1);
+    if (chunk == NULL || off + size > chunk->size) {
+        chunk_size = size > ARENA_CHUNK_SIZE ? size : ARENA_CHUNK_SIZE;
+        chunk = counted_malloc(sizeof(arena_chunk) + chunk_size);
+        if (chunk == NULL)
+            return NULL;
+        chunk->next = a->head;
+        chunk->size = chunk_size;
+        a->head = chunk;
+        off = 0;
+    }
+    chunk->used = off + size;
+    a->total += size;
+    return chunk->data + off;
+}   /* arena_alloc */
+
+
+char *arena_strdup (arena *a, const char *s)
+{
+    size_t len;
+    char *copy;
+
+    len = strlen(s) + 1;
+    if ((copy = arena_alloc(a, len)) != NULL)
+        memcpy(copy, s, len);
+    return copy;
+}   /* arena_strdup */
+
+
+/* Hand back everything allocated from the arena. If the last line needed
+more than one chunk, the chunks are replaced by a single chunk big enough for
+all of them, so a steady workload settles on one chunk and stops calling
+malloc altogether. A line that needed more than ARENA_KEEP_MAX (e.g. a
+sorted listing of a huge directory) does not pin that memory afterwards. */
+void arena_reset (arena *a)
+{
+    arena_chunk *chunk;     // Chunk being inspected.
+    size_t need;            // Total size of all chunks.
+
+    a->total = 0;
+    if (a->head == NULL)
+        return;
+    if (a->head->next != NULL) {
+        for (need = 0, chunk = a->head; chunk != NULL; chunk = chunk->next)
+            need += chunk->size;
+        arena_release(a);
+        if (need > ARENA_KEEP_MAX)
+            return;
+        if ((a->head = counted_malloc(sizeof(arena_chunk) + need)) == NULL)
+            return;
+        a->head->next = NULL;
+        a->head->size = need;
+    }
+    a->head->used = 0;
+}   /* arena_reset */
+
+
+/* Raise the peak to this thread's line arena, if it is bigger. Job and pool
+threads start lines too, so the maximum is taken with compare-and-swap. */
+static void note_peak (void)
+{
+    size_t peak;
+
+    peak = __atomic_load_n(&alloc_stats.peak, __ATOMIC_RELAXED);
+    while (line_arena.total > peak
+           && !__atomic_compare_exchange_n(&alloc_stats.peak, &peak,
+                                           line_arena.total, 1,
+                                           __ATOMIC_RELAXED,
+                                           __ATOMIC_RELAXED))
+        ;                               // peak now holds the latest value.
+}   /* note_peak */
+
+
+/* Called by the shell at the start of each line: counts the line and frees
+the temporaries of the previous one from the calling thread's line arena. */
+void arena_new_line (void)
+{
+    __atomic_fetch_add(&alloc_stats.lines, 1, __ATOMIC_RELAXED);
+    note_peak();
+    arena_reset(&line_arena);
+}   /* arena_new_line */
+
+
+/* Free every chunk of the arena. */
+void arena_release (arena *a)
+{
+    arena_chunk *chunk, *next;
+
+    for (chunk = a->head; chunk != NULL; chunk = next) {
+        next = chunk->next;
+        counted_free(chunk);
+    }
+    a->head = NULL;
+    a->total = 0;
+}   /* arena_release */
+
+
+/* Write the allocation counters to fd. */
+void print_alloc_stats (int fd)
+{
+    note_peak();                                    // Include the last line.
+    dprintf(fd, "lines: %lu, commands: %lu, mallocs: %lu, frees: %lu, "
+            "peak line arena: %zu bytes\n", alloc_stats.lines,
+            alloc_stats.commands, alloc_stats.mallocs, alloc_stats.frees,
+            alloc_stats.peak);
+}   /* print_alloc_stats */
@@ -0,0 +1,88 @@
+/*
+ *  arena.h
+ *
+ *  Author: Joseph Erlinger
+ *      Created on: October 17, 2026
+ */
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+
+typedef struct arena_chunk {
+    struct arena_chunk *next;   // Older (fuller) chunk.
+    size_t size;                // # Bytes in data.
+    size_t used;                // # Bytes handed out from data.
+    char data[];
+} arena_chunk;
+
+
+/* A bump allocator. Memory is handed out from the newest chunk and is only
+given back all at once by arena_reset(). */
+typedef struct arena {
+    arena_chunk *head;          // Chunk currently being allocated from.
+    size_t total;               // # Bytes allocated since the last reset.
+} arena;
+
+
+/* Counts every malloc/free made on behalf of a command, so steady-state
+execution can be checked to allocate nothing. mallocs and frees are updated
+atomically since worker threads allocate too. */
+typedef struct alloc_counters {
+    unsigned long mallocs;      // Calls to malloc/realloc.
+    unsigned long frees;        // Calls to free.
+    unsigned long lines;        // Lines executed.
+    unsigned long commands;     // Commands executed.
+    size_t peak;                // Largest # bytes used by one line.
+} alloc_counters;
+
+
+/* Temporaries that live for one input line. Each thread has its own; the
+pool's workers reset theirs after every task. */
+extern __thread arena line_arena;
+extern alloc_counters alloc_stats;
+
+
+#define ARENA_CHUNK_SIZE (64 << 10)     // Default size of a new chunk.
+#define ARENA_KEEP_MAX (4 << 20)        // Largest chunk kept across resets.
+
+
+void *arena_alloc (arena *a, size_t size);
+
+
+char *arena_strdup (arena *a, const char *s);
+
+
+void arena_reset (arena *a);
+
+
+void arena_new_line (void);
+
+
+void arena_release (arena *a);
+
+
+void *counted_malloc (size_t size);
+
+
+/* Zeroed memory; pages fresh from the kernel are not touched to clear them,
+so a large table costs only the pages that are used. */
+void *counted_calloc (size_t count, size_t size);
+
+
+void *counted_realloc (void *ptr, size_t size);
+
+
+/* size bytes aligned to alignment (a power of two), for O_DIRECT and
+io_uring buffers; freed with counted_free(). Returns NULL with errno set if
+out of memory. */
+void *counted_memalign (size_t alignment, size_t size);
+
+
+void counted_free (void *ptr);
+
+
+void print_alloc_stats (int fd);
+
+#endif  /* ARENA_H */
@@ -0,0 +1,255 @@
+/*
+ *  catcache.c
+ *
+ *  Author: Joseph Erlinger
+ *      Created on: October 17, 2026
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "catcache.h"
+#include "arena.h"
+#include "output.h"
+
+
+typedef struct cat_entry {
+    struct cat_entry *prev, *next;  // In the LRU list, most recent first.
+    struct cat_entry *chain;        // The next entry in its hash bucket.
+    dev_t dev;
+    ino_t ino;
+    off_t size;             // Also the length of the mapping.
+    struct timespec mtime;
+    struct timespec ctime;  // Moves on chmod too, which mtime does not.
+    char *map;
+    int refs;               // Writes using the mapping right now.
+    int cached;             // Still in the list (not evicted).
+} cat_entry;
+
+
+static cat_entry *head, *tail;          // The LRU list.
+static cat_entry *buckets[CATCACHE_BUCKETS];    // The listed entries.
+static size_t mapped;                   // # Bytes mapped by listed entries.
+static size_t budget = CATCACHE_BUDGET;
+static int disabled;
+static unsigned long hits, misses;      // Cacheable cats found / not found.
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;   // Guards it all.
+
+
+/* The hash chain of a file. Called with the lock held. */
+static cat_entry **bucket_of (dev_t dev, ino_t ino)
+{
+    unsigned long h;
+
+    h = (unsigned long) ino * 0x9E3779B97F4A7C15UL ^ (unsigned long) dev;
+    return &buckets[(h ^ (h >> 32)) & (CATCACHE_BUCKETS - 1)];
+}   /* bucket_of */
+
+
+static void unlink_entry (cat_entry *e)
+{
+    if (e->prev != NULL)
+        e->prev->next = e->next;
+    else
+        head = e->next;
+    if (e->next != NULL)
+        e->next->prev = e->prev;
+    else
+        tail = e->prev;
+    e->prev = e->next = NULL;
+}   /* unlink_entry */
+
+
+static void push_front (cat_entry *e)
+{
+    e->prev = NULL;
+    if ((e->next = head) != NULL)
+        head->prev = e;
+    else
+        tail = e;
+    head = e;
+}   /* push_front */
+
+
+static void free_entry (cat_entry *e)
+{
+    munmap(e->map, e->size);
+    counted_free(e);
+}   /* free_entry */
+
+
+/* Take e out of the cache; it is unmapped once no write uses it. Called
+with the lock held. */
+static void evict (cat_entry *e)
+{
+    cat_entry **p;
+
+    for (p = bucket_of(e->dev, e->ino); *p != e; p = &(*p)->chain)
+        ;
+    *p = e->chain;
+    unlink_entry(e);
+    mapped -= e->size;
+    e->cached = 0;
+    if (e->refs == 0)
+        free_entry(e);
+}   /* evict */
+
+
+/* Write e's mapping to the current output, without holding the lock. */
+static void write_entry (cat_entry *e)
+{
+    out_write_direct(e->map, e->size);
+    pthread_mutex_lock(&lock);
+    if (--e->refs == 0 && !e->cached)
+        free_entry(e);
+    pthread_mutex_unlock(&lock);
+}   /* write_entry */
+
+
+int catcache_write (int dirfd, const char *path)
+{
+    struct stat sb;
+    cat_entry *e;
+
+    if (__atomic_load_n(&disabled, __ATOMIC_RELAXED)
+        || fstatat(dirfd, path, &sb, 0) == -1 || !S_ISREG(sb.st_mode))
+        return 0;
+    pthread_mutex_lock(&lock);
+    for (e = *bucket_of(sb.st_dev, sb.st_ino); e != NULL; e = e->chain)
+        if (e->ino == sb.st_ino && e->dev == sb.st_dev)
+            break;
+    if (e != NULL && (e->size != sb.st_size
+                      || e->mtime.tv_sec != sb.st_mtim.tv_sec
+                      || e->mtime.tv_nsec != sb.st_mtim.tv_nsec
+                      || e->ctime.tv_sec != sb.st_ctim.tv_sec
+                      || e->ctime.tv_nsec != sb.st_ctim.tv_nsec)) {
+        evict(e);                               // The file has changed.
+        e = NULL;
+    }
+    if (e == NULL) {
+        pthread_mutex_unlock(&lock);
+        return 0;                       // catcache_fill() counts the miss.
+    }
+    hits++;
+    e->refs++;
+    if (e != head) {
+        unlink_entry(e);
+        push_front(e);
+    }
+    pthread_mutex_unlock(&lock);
+    write_entry(e);
+    return 1;
+}   /* catcache_write */
+
+
+int catcache_fill (int fd, const struct stat *sb)
+{
+    cat_entry *e, **chain;
+    char *map;
+
+    pthread_mutex_lock(&lock);
+    if (__atomic_load_n(&disabled, __ATOMIC_RELAXED)
+        || !S_ISREG(sb->st_mode) || sb->st_size == 0
+        || (size_t) sb->st_size > budget / CATCACHE_FILE_SHARE) {
+        pthread_mutex_unlock(&lock);
+        return 0;               // Streaming it costs no more (see copy.c).
+    }
+    misses++;
+    pthread_mutex_unlock(&lock);
+
+    map = mmap(NULL, sb->st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED)
+        return 0;
+    if ((e = counted_malloc(sizeof(cat_entry))) == NULL) {
+        munmap(map, sb->st_size);
+        return 0;
+    }
+    e->dev = sb->st_dev;
+    e->ino = sb->st_ino;
+    e->size = sb->st_size;
+    e->mtime = sb->st_mtim;
+    e->ctime = sb->st_ctim;
+    e->map = map;
+    e->refs = 1;
+    e->cached = 1;
+
+    pthread_mutex_lock(&lock);
+    while (tail != NULL && mapped + e->size > budget)
+        evict(tail);
+    push_front(e);
+    chain = bucket_of(e->dev, e->ino);
+    e->chain = *chain;
+    *chain = e;
+    mapped += e->size;
+    pthread_mutex_unlock(&lock);
+    write_entry(e);
+    return 1;
+}   /* catcache_fill */
+
+
+void catcache_clear (void)
+{
+    pthread_mutex_lock(&lock);
+    while (head != NULL)
+        evict(head);
+    pthread_mutex_unlock(&lock);
+}   /* catcache_clear */
+
+
+static void print_counters (void)
+{
+    char text[256];
+    unsigned long looked_up;
+    size_t files;
+    cat_entry *e;
+    int len;
+
+    pthread_mutex_lock(&lock);
+    for (files = 0, e = head; e != NULL; e = e->next)
+        files++;
+    looked_up = hits + misses;
+    len = snprintf(text, sizeof(text), "catcache %s: %zu files, %zu/%zu "
+                   "bytes, %lu hits, %lu misses, %.1f%% hit rate\n",
+                   __atomic_load_n(&disabled, __ATOMIC_RELAXED) ? "off" : "on",
+                   files, mapped, budget, hits,
+                   misses, looked_up == 0 ? 0.0 : 100.0 * hits / looked_up);
+    pthread_mutex_unlock(&lock);
+    out_write(text, len);
+}   /* print_counters */
+
+
+cmd_result catCache (char **args, int count)
+{
+    unsigned long n;
+    char *end;
+
+    if (count > 1)
+        return CMD_USAGE;
+    if (count == 0) {
+        print_counters();
+    } else if (strcmp(args[0], "on") == 0 || strcmp(args[0], "off") == 0) {
+        __atomic_store_n(&disabled, args[0][1] == 'f', __ATOMIC_RELAXED);
+        if (args[0][1] == 'f')
+            catcache_clear();
+    } else if (strcmp(args[0], "clear") == 0) {
+        catcache_clear();
+        pthread_mutex_lock(&lock);
+        hits = misses = 0;
+        pthread_mutex_unlock(&lock);
+    } else {
+        n = strtoul(args[0], &end, 10);
+        if (*end != '\0' || end == args[0])
+            return CMD_USAGE;
+        pthread_mutex_lock(&lock);
+        budget = n;
+        while (tail != NULL && mapped > budget)
+            evict(tail);
+        pthread_mutex_unlock(&lock);
+    }
+    return CMD_OK;
+}   /* catCache */
@@ -0,0 +1,49 @@
+/*
+ *  catcache.h
+ *
+ *  Author: Joseph Erlinger
+ *      Created on: October 17, 2026
+ */
+#ifndef CATCACHE_H
+#define CATCACHE_H
+
+#include <stddef.h>
+#include <sys/stat.h>
+#include "command.h"
+
+
+#define CATCACHE_BUDGET (64 << 20)  // Default bytes of files kept mapped.
+#define CATCACHE_FILE_SHARE 4       // A file may use 1/4 of the budget.
+#define CATCACHE_BUCKETS 256        // Hash chains on (dev, ino), a power of 2.
+
+
+/* Keeps the files cat printed mapped (MAP_SHARED, read only), most recently
+used first, up to a budget of mapped bytes. An entry is found by the
+(dev, ino) of the file in a hash table and is used only while its size,
+mtime and ctime still match (ctime moves on a chmod that takes the
+permission to read it away), so a repeat cat costs one fstatat(2) and one
+writev(2) from the mapping. A shared mapping shows writes made in place,
+and a replaced file has a new inode. Safe to call from any thread: an entry being written
+from is not unmapped until the write is done. */
+
+
+/* Write the file at path (relative to dirfd) to the current output if it
+is cached. Returns 1 if it was written, 0 if the caller must read it. */
+int catcache_write (int dirfd, const char *path);
+
+
+/* Map the open file fd (with metadata sb), cache it and write it to the
+current output. Returns 1 if it was written, 0 if it is not worth caching
+or could not be mapped, and the caller must stream it. */
+int catcache_fill (int fd, const struct stat *sb);
+
+
+/* Unmap every file that is not being written from. */
+void catcache_clear (void);
+
+
+/* catcache: print the hit rate. catcache on|off|clear enables, disables or
+empties the cache, and catcache <bytes> sets its budget. */
+cmd_result catCache (char **args, int count);
+
+#endif  /* CATCACHE_H */
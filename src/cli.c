@@ -12,55 +12,179 @@
 #include <limits.h>
 #include <sys/types.h>
 #include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "string_parser.h"
 #include "cli.h"
 #include "command.h"
+#include "arena.h"
+#include "output.h"
+#include "stats.h"
+#include "exec.h"
+#include "jobs.h"
+#include "cpcache.h"
+#include "catcache.h"
+#include "compile.h"
+#include "lineedit.h"
+#include "durable.h"
 #define _GNU_SOURCE
 
 
 #define STDOUT 1
 #define STDERR 2
-const char* OPERATOR_LIST[] = {"ls", "pwd", "mkdir", "cd", "cp", "mv", "rm",
-                               "cat", "exit"};
+#define BATCH_CHUNK (1 << 20)    // Read size for batch files that are streams.
 
 
-/* Note: Only call from main. File mode reads from a batch file, and executes
-each line as a command or sequence of commands. */
-void file_mode (char *filename)
+/* The dispatch table. Each builtin lands in the slot its name hashes to, and
+an override of an already filled slot (a hash collision) fails the build. */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic error "-Woverride-init"
+#define BUILTIN(name, len, first, last, arity, member, handler, flags)  \
+    [BUILTIN_HASH(len, first, last)] =                                 \
+        { #name, len, flags, { arity, { .member = handler } } },
+const builtin BUILTIN_TABLE[BUILTIN_SLOTS] = {
+#include "builtins.def"
+};
+#undef BUILTIN
+#pragma GCC diagnostic pop
+
+
+/* Execute every complete line in buf[0..len). Each newline is replaced by
+a NUL so the line can be tokenized where it lies. Sets *consumed to the
+number of bytes of complete lines that were executed. */
+SHELL_STATUS run_lines (char *buf, size_t len, size_t *consumed)
 {
-    FILE *stream;           // Stream of the input batch file.
-    char *line_buf;         // Line buffer for storing a line from the stream.
-    size_t len;             // Length of the line buffer.
-    ssize_t nread;          // # Bytes read from stdin.
     SHELL_STATUS opcode;    // Status of the shell.
+    char *line, *eol;       // Current line and its newline.
+    char *end;              // End of the buffer.
 
-    line_buf = NULL;
-    len = 0;
     opcode = RUNNING;
+    line = buf;
+    end = buf + len;
+    while (line < end && (eol = memchr(line, '\n', end - line)) != NULL) {
+        *eol = '\0';
+        opcode = command_line_interface(line);
+        line = eol + 1;
+        if (opcode == HALTED)
+            break;                                      // exit was executed.
+    }
+    *consumed = line - buf;
+    return opcode;
+}   /* run_lines */
 
-    /* Open the stream */
-    if ((stream = fopen(filename, "r")) == NULL) {
-        write(STDERR, "Error! File '", 13);
-        write(STDERR, filename, strlen(filename));
-        write(STDERR, "' not found.\n", 13);
-        return;                         // Error! Could not read from filename.
+
+/* Run a batch file by mapping it privately. Tokenizing writes NULs into the
+mapping, so the kernel copies only the pages that are parsed and the file is
+never read through a user buffer. A last line without a newline is copied
+out only when it ends exactly on a page boundary. */
+static void run_mapped_batch (int fd, size_t size)
+{
+    char *map;              // The whole batch file.
+    char *tail;             // Copy of an unterminated last line.
+    size_t done;            // # Bytes of complete lines executed.
+
+    map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        print_syserr(errno, __func__);
+        return;
     }
+    madvise(map, size, MADV_SEQUENTIAL);
 
-    /* Execute each line of commands from the stream. */
-    while (opcode == RUNNING || opcode == ERROR) {
-        if ((nread = getline(&line_buf, &len, stream)) == -1) {                              
-            break;                                              // Reached EOF.
+    if (run_lines(map, size, &done) != HALTED && done < size) {
+        if (size % sysconf(_SC_PAGESIZE) != 0) {
+            map[size] = '\0';         // The page is zero-filled past EOF.
+            command_line_interface(map + done);
+        } else if ((tail = counted_malloc(size - done + 1)) != NULL) {
+            memcpy(tail, map + done, size - done);
+            tail[size - done] = '\0';
+            command_line_interface(tail);
+            counted_free(tail);
         }
-        if (errno != 0) {
-            print_syserr(errno, __func__);                            // DEBUG.             
-            break;                        // Encounted some error in getline().
+    }
+    munmap(map, size);
+}   /* run_mapped_batch */
+
+
+/* Run a batch file that cannot be mapped (a pipe or other stream) by
+reading it in BATCH_CHUNK blocks. An incomplete last line is moved to the
+front of the buffer before the next read; the buffer only grows for lines
+longer than itself. */
+static void run_streamed_batch (int fd)
+{
+    char *buf;              // Read buffer, with room for a final NUL.
+    size_t cap;             // Capacity of buf (excluding the NUL).
+    size_t len;             // # Bytes in buf.
+    size_t done;            // # Bytes of complete lines executed.
+    ssize_t nread;          // # Bytes read from fd.
+    char *grown;
+
+    cap = BATCH_CHUNK;
+    len = 0;
+    if ((buf = counted_malloc(cap + 1)) == NULL) {
+        print_syserr(errno, __func__);
+        return;
+    }
+    for (;;) {
+        if (len == cap) {                   // A single line fills the buffer.
+            if ((grown = counted_realloc(buf, 2 * cap + 1)) == NULL) {
+                print_syserr(errno, __func__);
+                break;
+            }
+            buf = grown;
+            cap *= 2;
         }
-        opcode = command_line_interface(line_buf);
+        nread = read(fd, buf + len, cap - len);
+        if (nread == -1 && errno == EINTR)
+            continue;
+        if (nread == -1) {
+            print_syserr(errno, __func__);
+            break;                             // Encounted some error in read.
+        }
+        if (nread == 0) {                                       // Reached EOF.
+            if (len > 0) {
+                buf[len] = '\0';
+                command_line_interface(buf);
+            }
+            break;
+        }
+        len += nread;
+        if (run_lines(buf, len, &done) == HALTED)
+            break;
+        memmove(buf, buf + done, len - done);
+        len -= done;
     }
+    counted_free(buf);
+}   /* run_streamed_batch */
 
-    /* Free resources and close the input stream. */
-    fclose(stream);
-    free(line_buf);
+
+/* Note: Only call from main. File mode reads from a batch file, and executes
+each line as a command or sequence of commands. */
+void file_mode (char *filename)
+{
+    int fd;                 // File descriptor of the input batch file.
+    struct stat sb;         // Metadata of the batch file.
+
+    /* Open the batch file */
+    if ((fd = open(filename, O_RDONLY | O_CLOEXEC)) == -1) {
+        const char *msg[] = {"Error! File '", filename, "' not found.\n"};
+        err_write(msg, 3);
+        return;                         // Error! Could not read from filename.
+    }
+
+    /* Execute each line of commands from the file, or its compiled form if
+    that is up to date (see compile.h). A file that cannot be stat'ed is
+    just read. */
+    if (fstat(fd, &sb) == -1 || !S_ISREG(sb.st_mode))
+        run_streamed_batch(fd);
+    else if (run_compiled(filename, &sb) == 0)
+        ;
+    else if (sb.st_size > 0)
+        run_mapped_batch(fd, sb.st_size);
+    else
+        run_streamed_batch(fd);
+
+    close(fd);
 }   /* file_mode */
 
 
@@ -77,190 +201,304 @@ void interactive_mode ()
     line_buf = NULL;
     len = 0;
     opcode = RUNNING;
+    lineedit_open();
     
     while (opcode == RUNNING || opcode == ERROR) {
-        write(STDOUT, ">>> ", 4);
-        if ((nread = getline(&line_buf, &len, stdin)) == -1) {  
-            write(STDOUT, "\n", 1);                              
-            break;                                              // Reached EOF.
-        }
-        if (errno != 0) {
-            print_syserr(errno, __func__);                            // DEBUG.             
-            break;                        // Encounted some error in getline().
+        jobs_report(0);
+        if ((nread = lineedit_read(">>> ", &line_buf, &len)) == -1) {  
+            if (errno != 0)               // Encounted some error reading.
+                print_syserr(errno, __func__);
+            else
+                out_write("\n", 1);                            // Reached EOF.
+            break;
         }
         opcode = command_line_interface(line_buf);
     }
+    lineedit_close();
     free(line_buf);
 }   /* interactive_mode */
 
 
 /* The command line interface takes a single line of text and splits it into
-command_line(s). It then gives each command_line to the command interpreter. */
+command_line(s). It then gives each command_line to the command interpreter.
+The line is tokenized in place, so buf is modified. */
 SHELL_STATUS command_line_interface (char *buf)
+{
+    static token_arena tokens;     // Reused for every line the shell reads.
+    static int initialized;
+    int num_segments;
+
+    if (!initialized) {
+        init_token_arena(&tokens, SEGMENT_DELIM, TOKEN_DELIM, OPERATOR_DELIM,
+                         BACKGROUND_DELIM);
+        initialized = 1;
+    }
+    if ((num_segments = tokenize_line(&tokens, buf)) == -1) {
+        print_syserr(errno, __func__);
+        return ERROR;
+    }
+    return run_segments(tokens.segments, num_segments);
+}   /* command_line_interface */
+
+
+SHELL_STATUS run_segments (command_line *segments, int num_segments)
 {
     SHELL_STATUS opcode = RUNNING;
-    command_line large_token_buffer;
-    command_line small_token_buffer;
+    const char *call;       // The sync that failed to commit.
 
-    large_token_buffer = str_filler(buf, ";");
-    
-    /* Iterate through each large token */
-    for (int i = 0; large_token_buffer.command_list[i] != NULL; i++)
+    jobs_report(0);                 // Output of the jobs that are done.
+    arena_new_line();               // Free the temporaries of the last line.
+
+    /* Iterate through each command */
+    for (int i = 0; i < num_segments; i++)
     {
-        char* large_token = large_token_buffer.command_list[i];
-        small_token_buffer = str_filler(large_token, " ");
-        opcode = command_interpreter(small_token_buffer);        
-        
-        /* Free small token buffer and reset variables. */
-        free_command_line(&small_token_buffer);
-        memset(&small_token_buffer, 0, 0);
-        
+        opcode = command_interpreter(segments[i]);
+
         /* stop processing the rest of the line on exit or error. */
         if (opcode == HALTED || opcode == ERROR)
             break;
     }
-    /* Free large token buffer and reset variables. */
-    free_command_line(&large_token_buffer);
-    memset(&large_token_buffer, 0, 0);
+
+    /* One group commit for everything the line wrote (see durable.h) */
+    if ((call = durable_commit()) != NULL)
+        print_syserr(errno, call);
     return opcode;
-}   /* command_line_interface */
+}   /* run_segments */
 
 
-/* The command interpreter uses the tokens from a command_line to execute a
-shell command. The command interpreter uses execute_command() to execute
-the tokenized command line, and to display any errors. */
-SHELL_STATUS command_interpreter (command_line command)
+/* Find the descriptor of a builtin from its name in O(1): hash the length
+and the first and last characters, then confirm with one memcmp. Returns
+NULL if name is not a builtin. */
+const builtin *lookup_builtin (const char *name)
+{
+    const builtin *b;       // The only builtin that can match name.
+    size_t len;
+
+    len = strlen(name);
+    if (len == 0)
+        return NULL;
+    b = &BUILTIN_TABLE[BUILTIN_HASH(len, (unsigned char) name[0],
+                                    (unsigned char) name[len-1])];
+    if (b->name == NULL || (size_t) b->len != len
+        || memcmp(b->name, name, len) != 0)
+        return NULL;
+    return b;
+}   /* lookup_builtin */
+
+
+const char *check_builtins (void)
 {
-    shellCommand cmd;  // Datatype for passing into a try-catch function.
-    char *op;          // The name of the command.
-    OPTYPE op_type;    // The mapping of the command name to a enum.
-    char **args;       // Alias for command.command_list
+    const builtin *b;
+    int slot;
+
+    for (slot = 0; slot < BUILTIN_SLOTS; slot++) {
+        b = &BUILTIN_TABLE[slot];
+        if (b->name != NULL && lookup_builtin(b->name) != b)
+            return b->name;
+    }
+    return NULL;
+}   /* check_builtins */
+
+
+/* Run one command or pipeline of an and-or list; args is NULL terminated.
+Returns HALTED for exit, otherwise RUNNING if it succeeded and ERROR if it
+failed. A program or pipeline fails with a non-zero exit status. */
+static SHELL_STATUS run_command (char **args)
+{
+    const builtin *b;  // Descriptor of the command.
     int num_args;      // The number of operands - aka. # tokens - 1.
-    int i;
+    const char *call;  // The call that failed to put its copies in place.
+    int failed;        // Whether the builtin failed.
 
-    /* Initialize Variables */
-    op = command.command_list[0];
-    args = command.command_list;
-    num_args = command.num_token - 2;
-    op_type = DNE;
+    __atomic_fetch_add(&alloc_stats.commands, 1, __ATOMIC_RELAXED);
 
-    /* Skip the NULL/empty/nothing comamnd */
-    if (op == NULL || strcmp(op, "\n") == 0)
-        return RUNNING;
-   
-    /* Match the operator to an OpType, then set op_type. */
-    for (i = 0; i < OPERATOR_LIST_SIZE; i++) {
-        if (strcmp(op, OPERATOR_LIST[i]) == 0) {
-            op_type = i;
-            break;
+    /* Programs and pipelines are started by run_pipeline() */
+    if ((b = lookup_builtin(args[0])) == NULL || is_pipeline(args))
+        return run_pipeline(args) == 0 ? RUNNING : ERROR;
+
+    /* Run the builtin */
+    if (b->flags & BUILTIN_HALTS)
+        return HALTED;
+    for (num_args = 0; args[num_args + 1] != NULL; num_args++)
+        ;
+    failed = execute_command(b, args, num_args).err != 0;
+
+    /* The copies it made at DURABLE_ATOMIC are in place before the next
+    command runs (see durable.h) */
+    if ((call = durable_publish()) != NULL) {
+        print_syserr(errno, call);
+        failed = 1;
+    }
+    return failed ? ERROR : RUNNING;       // Don't read rest of line if error.
+}   /* run_command */
+
+
+static int is_and_or (const char *token)
+{
+    return (token[0] == '&' || token[0] == '|') && token[1] == token[0]
+           && token[2] == '\0';
+}   /* is_and_or */
+
+
+/* Run the commands of tokens joined by "&&" (run the next one only if this
+one succeeded) and "||" (only if it failed), from left to right. The
+operators are replaced by NULLs. As with `set -e`, only a failure of the
+last command counts: a failure that decided an "&&" or "||" was expected.
+Returns HALTED, ERROR or RUNNING like run_command(). */
+SHELL_STATUS run_list (char **tokens)
+{
+    SHELL_STATUS opcode;    // Status of the last command that ran.
+    char **cmd;             // The current command.
+    char *op, *next_op;     // Operators before and after it.
+    int ran;                // Whether the current command ran.
+    int i;
+
+    /* An operator needs a command on both sides. */
+    for (i = 0, op = NULL; tokens[i] != NULL; i++) {
+        if (is_and_or(tokens[i]) && (i == 0 || op != NULL
+                                     || tokens[i + 1] == NULL)) {
+            print_err(CMD, tokens[i]);
+            return ERROR;
         }
+        op = is_and_or(tokens[i]) ? tokens[i] : NULL;
     }
 
-    /* Handling all the different shell commands */
-    switch (op_type) {
-        case LS:
-            cmd.n = 0;
-            cmd.fun.noInput = listDir;
-            execute_command(cmd, args, num_args, "ls");
-            break;
-        case PWD:
-            cmd.n = 0;
-            cmd.fun.noInput = showCurrentDir;
-            execute_command(cmd, args, num_args, "pwd");
-            break;
-        case MKDIR:
-            cmd.n = 1;
-            cmd.fun.oneInput = makeDir;
-            execute_command(cmd, args, num_args, "mkdir");
-            break;
-        case CD:
-            cmd.n = 1;
-            cmd.fun.oneInput = changeDir;
-            execute_command(cmd, args, num_args, "cd");
-            break;
-        case CP:
-            cmd.n = 2;
-            cmd.fun.twoInput = copyFile;
-            execute_command(cmd, args, num_args, "cp");
-            break;
-        case MV:
-            cmd.n = 2;
-            cmd.fun.twoInput = moveFile;
-            execute_command(cmd, args, num_args, "mv");
-            break;
-        case RM:
-            cmd.n = 1;
-            cmd.fun.oneInput = deleteFile;
-            execute_command(cmd, args, num_args, "rm");
-            break;
-        case CAT:
-            cmd.n = 1;
-            cmd.fun.oneInput = displayFile;
-            execute_command(cmd, args, num_args, "cat");
-            break;
-        case EXIT:
+    opcode = RUNNING;
+    ran = 0;
+    op = NULL;
+    cmd = tokens;
+    for (i = 0; ; i++) {
+        if (tokens[i] != NULL && !is_and_or(tokens[i]))
+            continue;
+        next_op = tokens[i];
+        tokens[i] = NULL;
+        ran = op == NULL || (op[0] == '&') == (opcode == RUNNING);
+        if (ran && (opcode = run_command(cmd)) == HALTED)
             return HALTED;
-        case DNE:
-            print_err(CMD, op);
-            return ERROR;
+        if (next_op == NULL)
+            break;
+        op = next_op;
+        cmd = tokens + i + 1;
     }
-    if (errno != 0) {                      // Don't read rest of line if error.
-        errno = 0;                                              // Reset errno.
-        return ERROR;
-    } else {
+    return ran ? opcode : RUNNING;
+}   /* run_list */
+
+
+/* The command interpreter uses the tokens from a command_line to execute a
+shell command. The command interpreter uses run_list() to execute the
+tokenized command line, and to display any errors. A command line ended by
+"&" is handed to the job scheduler instead, and the shell goes on at once. */
+SHELL_STATUS command_interpreter (command_line command)
+{
+    /* Skip the NULL/empty/nothing comamnd */
+    if (command.command_list[0] == NULL)
+        return RUNNING;
+
+    if (command.background) {
+        if (job_start(command.command_list) == -1) {
+            print_syserr(errno, "&");
+            return ERROR;
+        }
         return RUNNING;
     }
+    return run_list(command.command_list);
 }   /* command_interpreter */
 
 
+/* Run a builtin with its operands args[1..num_args] without reporting a
+failure. errno is left alone: a builtin running on another thread, or on
+behalf of a job, only ever reports through what it returns. */
+cmd_result run_builtin (const builtin *b, char **args, int num_args)
+{
+    const shellCommand *cmd;    // Arity and handler of the builtin.
+    stats_sample sample;        // Clocks and I/O counters at the start.
+    cmd_result result;
+    int timed;                  // Whether this run is being measured.
+
+    cmd = &b->cmd;
+    if (num_args != cmd->n && cmd->n != ANY_ARGS
+        && (cmd->n != VARIADIC || num_args < 1))
+        return CMD_USAGE;              // Error! Incorrect number of arguments.
+    if ((timed = stats_enabled))
+        stats_begin(&sample);
+    if (cmd->n == VARIADIC || cmd->n == ANY_ARGS)
+        result = cmd->fun.manyInput(args + 1, num_args);
+    else if (num_args == 0)
+        result = cmd->fun.noInput();
+    else if (num_args == 1)
+        result = cmd->fun.oneInput(args[1]);
+    else
+        result = cmd->fun.twoInput(args[1], args[2]);
+    if (timed)
+        stats_end(b - BUILTIN_TABLE, &sample, result.err != 0);
+    return result;
+}   /* run_builtin */
+
+
 /* Generalized function for executing shell commands and catching any errors */
-void execute_command (shellCommand cmd, char **args, int num_args, char *name)
+cmd_result execute_command (const builtin *b, char **args, int num_args)
 {
-    if (num_args != cmd.n) {
-        print_err(PARAM, name);
-        errno = EINVAL;        // Indirectly stop reading the rest of the line.
-        return;                        // Error! Incorrect number of arguments.
-    }
-    if (num_args == 0) {
-        cmd.fun.noInput();
-    } else if (num_args == 1) {
-        cmd.fun.oneInput(args[1]);
-    } else if (num_args == 2) {
-        cmd.fun.twoInput(args[1], args[2]);
-    }
-    if (errno != 0) {          // Check if something went wrong in the syscall.
-        print_err(PARAM, name);
-    }
+    cmd_result result;
+
+    result = run_builtin(b, args, num_args);
+    print_result(b->name, &result);
+    return result;
 }   /* execute_command */
 
 
 /* FOR DEBUGGING: for problems outside of the command_interpreter. */
 void print_syserr (int error_number, const char *error_msg)
 {
-    const char* error_str;    // The text description of an errno.
-    
-    error_str = strerror(error_number);
-    write(STDERR, "Error! ", 7);
-    write(STDERR, error_str, strlen(error_str));
-    write(STDERR, ": ", 2);
-    write(STDERR, error_msg, strlen(error_msg));
-    write(STDERR, "\n", 1);
+    const char *msg[5];       // Pieces of the message, written at once.
+
+    msg[0] = "Error! ";
+    msg[1] = strerror(error_number);  // The text description of an errno.
+    msg[2] = ": ";
+    msg[3] = error_msg;
+    msg[4] = "\n";
+    err_write(msg, 5);
 }   /* print_syserr */
 
 
 /* Print a (rather unhelpful) error message if anything goes wrong. */
 void print_err (ERR_TYPE err_type, const char *error_msg)
 {
-    write(STDOUT, "Error! ", 7);
+    out_write("Error! ", 7);
     switch (err_type) {
         case CMD:
-            write(1, "Unrecognized command: ", 22);
+            out_write("Unrecognized command: ", 22);
             break;
         case PARAM:
-            write(1, "Unsupported parameters for command: ", 36);
+            out_write("Unsupported parameters for command: ", 36);
             break;
     }
-    write(STDOUT, error_msg, strlen(error_msg));
-    write(STDOUT, "\n", 1);
+    out_puts(error_msg);
+    out_write("\n", 1);
 }   /* print_err */
- 
\ No newline at end of file
+ 
+
+/* Report a failed command as "Error! cmd: path: reason (syscall)", leaving
+out the parts r does not have. Bad operands keep the usage message. */
+void print_result (const char *cmd, const cmd_result *r)
+{
+    if (r->err == 0 || r->reported)
+        return;
+    if (CMD_IS_USAGE(*r)) {
+        print_err(PARAM, cmd);
+        return;
+    }
+    out_write("Error! ", 7);
+    out_puts(cmd);
+    out_write(": ", 2);
+    if (r->path != NULL) {
+        out_puts(r->path);
+        out_write(": ", 2);
+    }
+    out_puts(strerror(r->err));
+    if (r->syscall != NULL) {
+        out_write(" (", 2);
+        out_puts(r->syscall);
+        out_write(")", 1);
+    }
+    out_write("\n", 1);
+}   /* print_result */
@@ -7,22 +7,9 @@
 #ifndef CLI_H
 #define CLI_H
 
-typedef enum OPTYPE {
-    LS,
-    PWD,
-    MKDIR,
-    CD,
-    CP,
-    MV,
-    RM,
-    CAT,
-    EXIT,
-    DNE
-} OPTYPE;
-
-extern const char* OPERATOR_LIST[];
-
-#define OPERATOR_LIST_SIZE 9
+#include <stddef.h>
+#include "string_parser.h"
+#include "command.h"
 
 
 typedef enum SHELL_STATUS {
@@ -47,23 +34,75 @@ void file_mode ();
 SHELL_STATUS command_line_interface (char *buf);
 
 
+/* Run the command_lines of one line, tokenized already, in order; an exit
+or a failure stops the rest of the line. */
+SHELL_STATUS run_segments (command_line *segments, int num_segments);
+
+
+/* Execute every complete line in buf[0..len), stopping after an exit.
+Sets *consumed to the number of bytes of complete lines that were run. */
+SHELL_STATUS run_lines (char *buf, size_t len, size_t *consumed);
+
+
 SHELL_STATUS command_interpreter (command_line command);
 
 
+SHELL_STATUS run_list (char **tokens);
+
+
 void print_syserr (int error_number, const char *error_msg);
 
 
 void print_err (ERR_TYPE err_type, const char *error_msg);
 
+
+/* Report the failure r of cmd, unless it was already reported. */
+void print_result (const char *cmd, const cmd_result *r);
+
+#define VARIADIC -1    // shellCommand.n for commands taking 1 or more args.
+#define ANY_ARGS -2    // shellCommand.n for commands taking 0 or more args.
+
 typedef struct shellCommand {
     int n;
     union {
-        void (*noInput)();
-        void (*oneInput)(char*);
-        void (*twoInput)(char*, char*);
+        cmd_result (*noInput)();
+        cmd_result (*oneInput)(char*);
+        cmd_result (*twoInput)(char*, char*);
+        cmd_result (*manyInput)(char**, int);
     } fun;
 } shellCommand;
 
-void execute_command (shellCommand cmd, char **args, int num_args, char *name);
+
+#define BUILTIN_HALTS 1         // builtin.flags: the command stops the shell.
+
+/* A const descriptor for each builtin, generated from builtins.def. */
+typedef struct builtin {
+    const char *name;
+    int len;                    // strlen(name).
+    int flags;
+    shellCommand cmd;           // Arity and handler.
+} builtin;
+
+
+/* Perfect hash over the builtin names; builtins.def lists the inputs. */
+#define BUILTIN_HASH(len, first, last) \
+    (((len) + (first) * 3 + (last)) & (BUILTIN_SLOTS - 1))
+#define BUILTIN_SLOTS 64
+
+
+extern const builtin BUILTIN_TABLE[BUILTIN_SLOTS];
+
+
+const builtin *lookup_builtin (const char *name);
+
+
+/* Returns the name of a builtin whose len, first or last in builtins.def
+does not match its name (lookup_builtin() would never find it), or NULL if
+the table is sound. */
+const char *check_builtins (void);
+
+cmd_result run_builtin (const builtin *b, char **args, int num_args);
+
+cmd_result execute_command (const builtin *b, char **args, int num_args);
 
 #endif  /* CLI_H */
\ No newline at end of file
@@ -4,6 +4,7 @@
  *  Author: Joseph Erlinger
  * 		Date: April 17, 2024
  */
+#define _GNU_SOURCE
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -16,158 +17,350 @@
 #include <libgen.h>
 #include <limits.h>
 #include "command.h"
+#include "copy.h"
+#include "arena.h"
+#include "output.h"
+#include "dirlist.h"
+#include "pool.h"
+#include "treewalk.h"
+#include "session.h"
+#include "cpcache.h"
+#include "catcache.h"
+#include "durable.h"
+#include "cli.h"
 #include "string_parser.h"
 
 
 #define STDOUT 1
 
 
+#define LS_LONG 1        // ls -l: one entry per line with its metadata.
+#define LS_UNSORTED 2    // ls -U: entries in directory order, not sorted.
+
+
+#define CP_RECURSIVE 1   // cp -r: copy directories and what they contain.
+#define CP_FOLLOW 2      // cp -L: copy what symbolic links point to.
+
+
+#define RM_RECURSIVE 1   // rm -r: remove directories and what they contain.
+
+
 /* listdir() lists all files and directories on a single line
 and not in any order. */
-void listDir() 
+cmd_result listDir() 
 {
-    char *cwd;    // The absolute path that represents the current directory.
-    DIR *dirp;    // A directory pointer that points to the current directory.
-    struct dirent *next_dir; // Data structure of a file or directory.
-    char *name;   // The name of a file or directory.
-
-    /* Allocate memory for the current directory buffer */
-    cwd = (char *) malloc(PATH_MAX*sizeof(char));
-    
-    /* Get the current directory */
-    if (getcwd(cwd, PATH_MAX) == NULL) // Fill the cwd buffer with the absPath.
-        goto cleanup;                                         // Exit on error.
-    
-    /* Open the current directory */
-    dirp = opendir(cwd);
-    if (dirp == NULL)
-        goto cleanup;                                         // Exit on error.
-    
-    /* Write each file/directory name in the current directory to stdout. */
-	for (struct dirent* next_dir; next_dir = readdir(dirp); next_dir != NULL)
-    {
-        char* name = next_dir->d_name;
-		write(STDOUT, name, strlen(name));
-		write(STDOUT, " ", 1);
-    }
-    write(STDOUT, "\n", 1);
-    closedir(dirp);
-
-    /* Free allocated memory before exiting */
-    cleanup:
-    free(cwd);
+    return listDirectory(NULL, 0);
 }   /* listDir */
 
 
-void showCurrentDir() 
+/* The name of the copy engine's method that failed, for an error message. */
+static const char *engine_call(const copy_report *report)
 {
-    char *cwd;    // The absolute path that represents the current directory.
+    return report->method == COPY_NONE ? "fstat"
+                                       : copy_method_name(report->method);
+}   /* engine_call */
 
-    /* Allocate memory for the current directory buffer */
-    cwd = (char *) malloc(PATH_MAX*sizeof(char));
-    
-    /* Get the current directory */
-    if (getcwd(cwd, PATH_MAX) == NULL) // Fill the cwd buffer with the absPath.
-        goto cleanup;                                         // Exit on error.
-    
-    /* Display the current directory to stdout */
-    write(STDOUT, cwd, strlen(cwd));
-    write(STDOUT, "\n", 1);
-    
-    /* Free allocated memory before exiting */
-    cleanup:
-    free(cwd);
+
+/* Fill buf with the ls -l permission string of mode, e.g. "drwxr-xr-x". */
+static void mode_string(mode_t mode, char *buf)
+{
+    const char *rwx = "rwxrwxrwx";
+    int i;
+
+    buf[0] = S_ISDIR(mode) ? 'd' : S_ISLNK(mode) ? 'l' : S_ISCHR(mode) ? 'c'
+           : S_ISBLK(mode) ? 'b' : S_ISFIFO(mode) ? 'p' : S_ISSOCK(mode) ? 's'
+           : '-';
+    for (i = 0; i < 9; i++)
+        buf[i+1] = mode & (0400 >> i) ? rwx[i] : '-';
+    buf[10] = '\0';
+}   /* mode_string */
+
+
+/* Write one entry of the directory dirfd. Short entries are separated by
+spaces; long entries get a line each with the metadata read by fstatat(2)
+relative to the directory, so no path is ever built or walked. */
+static void list_entry(int dirfd, const char *name, int opts)
+{
+    struct stat sb;         // Metadata of the entry.
+    char line[64];          // The metadata columns.
+    char mode[11];          // Permission string.
+    char target[PATH_MAX];  // Target of a symbolic link.
+    ssize_t n;
+
+    if (!(opts & LS_LONG)) {
+        out_puts(name);
+        out_write(" ", 1);
+        return;
+    }
+    if (fstatat(dirfd, name, &sb, AT_SYMLINK_NOFOLLOW) == -1)
+        return;                      // The entry was removed while listing.
+    mode_string(sb.st_mode, mode);
+    n = snprintf(line, sizeof(line), "%s %3lu %10lld ", mode,
+                 (unsigned long) sb.st_nlink, (long long) sb.st_size);
+    out_write(line, n);
+    out_puts(name);
+    if (S_ISLNK(sb.st_mode)
+        && (n = readlinkat(dirfd, name, target, sizeof(target) - 1)) > 0) {
+        out_write(" -> ", 4);
+        out_write(target, n);
+    }
+    out_write("\n", 1);
+}   /* list_entry */
+
+
+/* ls [-l] [-U] [directory]. Entries are read with getdents64(2) straight
+from the directory fd (the current directory by default). Listings are
+sorted in byte order of the names, as POSIX has it: the names are copied
+into the line arena and radix sorted. -U lists them in directory order
+instead, streamed as they are read, so memory use does not depend on the
+size of the directory. */
+cmd_result listDirectory(char **args, int count)
+{
+    const char *dir;        // Directory to list.
+    int opts;               // LS_LONG | LS_UNSORTED.
+    int dirfd;              // The directory being listed.
+    dirlist d;              // Reader over dirfd.
+    const char *name;       // The name of a file or directory.
+    unsigned char type;     // DT_* type of the entry (unused).
+    char **names, **grown;  // Copied names, when sorting.
+    size_t n, cap;          // # Names and capacity of names.
+    char *buf;              // getdents64 buffer.
+    cmd_result result;      // A failure while listing.
+    int i;
+
+    /* Parse the options and the directory operand. */
+    dir = NULL;
+    opts = 0;
+    for (i = 0; i < count; i++) {
+        if (args[i][0] == '-' && args[i][1] != '\0') {
+            for (name = args[i] + 1; *name != '\0'; name++) {
+                if (*name == 'l')
+                    opts |= LS_LONG;
+                else if (*name == 'U')
+                    opts |= LS_UNSORTED;
+                else
+                    return CMD_USAGE;                   // Unknown option.
+            }
+        } else if (dir == NULL) {
+            dir = args[i];
+        } else {
+            return CMD_USAGE;                        // Only one directory.
+        }
+    }
+
+    if (dir == NULL)
+        dir = ".";
+
+    buf = arena_alloc(&line_arena, DIRLIST_BUFSIZ);
+    if (buf == NULL)
+        return CMD_ERROR(ENOMEM, "malloc", NULL);             // Exit on error.
+    dirfd = openat(session_fd(), dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirfd == -1)
+        return CMD_FAIL("openat", dir);                       // Exit on error.
+    dirlist_init(&d, dirfd, buf, DIRLIST_BUFSIZ);
+    result = CMD_OK;
+
+    /* Unsorted: write each file/directory name as it is read. */
+    if (opts & LS_UNSORTED) {
+        while ((name = dirlist_next(&d, &type)) != NULL)
+            list_entry(dirfd, name, opts);
+        goto done;
+    }
+
+    /* Sorted: collect the names, then sort and write them. */
+    names = NULL;
+    n = cap = 0;
+    while ((name = dirlist_next(&d, &type)) != NULL) {
+        if (n == cap) {
+            cap = cap == 0 ? 1024 : 2 * cap;
+            grown = arena_alloc(&line_arena, cap * sizeof(char *));
+            if (grown == NULL) {
+                result = CMD_ERROR(ENOMEM, "malloc", NULL);
+                goto done;                                    // Exit on error.
+            }
+            if (n > 0)
+                memcpy(grown, names, n * sizeof(char *));
+            names = grown;
+        }
+        if ((names[n++] = arena_strdup(&line_arena, name)) == NULL) {
+            result = CMD_ERROR(ENOMEM, "malloc", NULL);
+            goto done;                                        // Exit on error.
+        }
+    }
+    if (n > 0 && (grown = arena_alloc(&line_arena, n * sizeof(char *))) != NULL)
+        sort_names(names, grown, n);
+    for (i = 0; (size_t) i < n; i++)
+        list_entry(dirfd, names[i], opts);
+
+    done:
+    if (!(opts & LS_LONG))
+        out_write("\n", 1);
+    if (d.error != 0 && result.err == 0)
+        result = CMD_ERROR(d.error, "getdents64", dir);
+    close(dirfd);
+    return result;
+}   /* listDirectory */
+
+
+/* pwd prints the logical path of the working directory, which the session
+keeps up to date on every cd, so no syscall is made. */
+cmd_result showCurrentDir() 
+{
+    out_write(current_session->cwd, current_session->len);
+    out_write("\n", 1);
+    return CMD_OK;
 }   /* showCurrentDir */
 
 
+/* pwd [-L] [-P]: -P prints the physical path, with symbolic links
+resolved. */
+cmd_result showWorkingDir(char **args, int count)
+{
+    char *cwd;              // The physical path.
+    int physical;           // Whether -P was given last.
+    int i;
+
+    physical = 0;
+    for (i = 0; i < count; i++) {
+        if (strcmp(args[i], "-P") == 0)
+            physical = 1;
+        else if (strcmp(args[i], "-L") == 0)
+            physical = 0;
+        else
+            return CMD_USAGE;
+    }
+    if (!physical)
+        return showCurrentDir();
+    cwd = (char *) arena_alloc(&line_arena, PATH_MAX*sizeof(char));
+    if (cwd == NULL)
+        return CMD_ERROR(ENOMEM, "malloc", NULL);             // Exit on error.
+    if (session_physical(current_session, cwd, PATH_MAX) == NULL)
+        return CMD_FAIL("readlink", NULL);                    // Exit on error.
+    out_puts(cwd);
+    out_write("\n", 1);
+    return CMD_OK;
+}   /* showWorkingDir */
+
+
 /* Files are created with the default mode (755) which grants the user read,
 write, and execute privileges, and the group and others read and execute
 privileges. */
-void makeDir(char *dirName)
+cmd_result makeDir(char *dirName)
 {
     mode_t mode;    // mode sets the privileges of the new directory.
 
     mode = S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH;    // Default mode.
-    mkdir(dirName, mode);                     // Try to create a new directory.
+    if (mkdirat(session_fd(), dirName, mode) == -1)   // Try to create it.
+        return CMD_FAIL("mkdirat", dirName);
+    return CMD_OK;
 }  
 
 
-void changeDir(char *dirName)
+cmd_result changeDir(char *dirName)
 {
-    chdir(dirName);                               // Try to change directories.
+    if (session_chdir(current_session, dirName) == -1)    // Try to change.
+        return CMD_FAIL("openat", dirName);
+    return CMD_OK;
 }  
 
 
-void deleteFile(char *filename)
+cmd_result deleteFile(char *filename)
 {
-    unlink(filename);                                // Try to remove the file.
+    if (unlinkat(session_fd(), filename, 0) == -1)   // Try to remove the file.
+        return CMD_FAIL("unlinkat", filename);
+    return CMD_OK;
 } 
 
 
-void displayFile(char *filename)
+cmd_result displayFile(char *filename)
 {
     int fd;                 // File descriptors for source file.
-    ssize_t filepos;        // Variable to keep track of a file's position.
-    ssize_t nwrite;         // Variable to keep track of # bytes written.
-    char *line_buf;         // Buffer for transfering data from src to dst.
+    struct stat sb;         // Metadata of the source file.
+    copy_report report;     // Which method streamed the file.
+    cmd_result result;
 
-    /* Initialize file descriptor */
-    fd = -1;
-    
-    /* Allocate memory for the line buffer. */
-    line_buf = (char *) malloc(BUFSIZ*sizeof(char));
+    /* A file printed before is written from its mapping (see catcache.h) */
+    if (catcache_write(session_fd(), filename))
+        return CMD_OK;
 
     /* Open the source file */
-    fd = open(filename, O_RDONLY);      // Get file desciptor from source file.
+    fd = openat(session_fd(), filename, O_RDONLY);  // Get source descriptor.
     if (fd == -1)
-        goto cleanup;                                         // Exit on error.
+        return CMD_FAIL("openat", filename);                  // Exit on error.
+    result = CMD_OK;
+    if (fstat(fd, &sb) == 0 && catcache_fill(fd, &sb))
+        goto done;
+
+    /* Stream the file to stdout without copying it through user space */
+    out_flush();                         // Keep earlier output ahead of it.
+    if (stream_data(fd, out_fileno(), &report) == -1)
+        result = CMD_FAIL(engine_call(&report), filename);
+    done:
+    close(fd);
+    return result;
+}   /* displayFile */
+
 
-    /* Read each line from src file, and write the line to stdout */
-    for(filepos=0; filepos=read(fd, line_buf, BUFSIZ); filepos!=0) {
-        if (filepos == -1)
-            goto cleanup;                                     // Exit on error.
-        nwrite = write(STDOUT, line_buf, filepos);
-        if (nwrite == -1)
-            goto cleanup;                                     // Exit on error.
+/* cat with several operands streams each file to stdout in turn. A file that
+cannot be read is reported where its contents would have been and does not
+stop the others; the command fails with the first such error. */
+cmd_result displayFiles(char **filenames, int count)
+{
+    cmd_result first;       // The first file that failed.
+    cmd_result result;
+    int i;
+
+    if (count == 1)
+        return displayFile(filenames[0]);
+    first = CMD_OK;
+    for (i = 0; i < count; i++) {
+        result = displayFile(filenames[i]);
+        if (result.err == 0)
+            continue;
+        print_result("cat", &result);
+        if (first.err == 0) {
+            first = result;
+            first.reported = 1;
+        }
     }
-    
-    /* Close open files and free allocated memory before exiting. */
-    cleanup:
-    if (fd != -1)
-        close(fd);
-    free(line_buf);
-    return;
-}   /* displayFile */
+    return first;
+}   /* displayFiles */
 
 
-void copyFile(char *sourcePath, char *destinationPath)
+cmd_result copyFile(char *sourcePath, char *destinationPath)
 {
     int fd1, fd2;           // File descriptors for src file and dst file.
-    ssize_t filepos;        // Variable to keep track of a file's position.
-    ssize_t nwrite;         // Variable to keep track of # bytes written.
-    int flags = O_WRONLY|O_CREAT|O_TRUNC;  // For opening the destination file.
     mode_t m1;              // Mode of source file.
     struct stat sb1, sb2;   // Stat buffers for source and destination.
     struct stat tb;         // Temp stat buffer.
     char *sp, *dp;          // Temp copies of sourcePath and destinationPath.
     char *bs, *dd;          // Basename of src file and dirname of dst file.
     int pathsize;           // Number of bytes in path string.
+    int dirfd;              // Directory the paths are relative to.
     char *path;             // path = "dirname_of_dstPath/basename_of_srcPath".
-    char *line_buf;         // Buffer for transfering data from src to dst.
+    char *target;           // The file that is written: destinationPath or path.
+    char *temp;             // What target is written as (see durable.h).
+    const char *call;       // The call that failed to make the copy durable.
+    int exists;             // Whether target exists.
+    copy_report report;     // Which copy method the engine ended up using.
+    cmd_result result;      // The first call that failed.
 
     /* Initialize file descriptors */
-    fd1, fd2 = -1;
-
-    /* Allocate memory for the line buffer. */
-    line_buf = (char *) malloc(BUFSIZ*sizeof(char));
+    fd1 = fd2 = -1;
+    dirfd = session_fd();
+    result = CMD_OK;
 
     /* Get basename of srcFile and directory path of dstFile */
-    sp = strdup(sourcePath);
+    sp = arena_strdup(&line_arena, sourcePath);
+    dp = arena_strdup(&line_arena, destinationPath);
+    if (sp == NULL || dp == NULL)
+        return CMD_ERROR(ENOMEM, "malloc", NULL);             // Exit on error.
     bs = basename(sp);  //< Note: might modify sp.
-    dp = strdup(destinationPath);
 
     pathsize = strlen(destinationPath) + strlen(bs) + 2;    // +2 for / and \0.
-    path = (char *) malloc(pathsize*sizeof(char));
+    path = (char *) arena_alloc(&line_arena, pathsize*sizeof(char));
+    if (path == NULL)
+        return CMD_ERROR(ENOMEM, "malloc", NULL);             // Exit on error.
 
     /* If destinationPath ends with a backslash, then it explicitiy declares 
     itself as a directory. Otherwise, whether destinationPath is a directory
@@ -181,91 +374,438 @@ void copyFile(char *sourcePath, char *destinationPath)
     }
 
     /* Open the source file */
-    fd1 = open(sourcePath, O_RDONLY);   // Get file desciptor from source file.
-    if (fd1 == -1)
-        goto cleanup;                                         // Exit on error.    
-    if (stat(sourcePath, &sb1) == -1)         // Get metadata from source file.
+    fd1 = openat(dirfd, sourcePath, O_RDONLY);   // Get source descriptor.
+    if (fd1 == -1) {
+        result = CMD_FAIL("openat", sourcePath);
+        goto cleanup;                                         // Exit on error.
+    }
+    if (fstat(fd1, &sb1) == -1) {             // Get metadata from source file.
+        result = CMD_FAIL("fstat", sourcePath);
         goto cleanup;                                         // Exit on error.
+    }
     m1 = sb1.st_mode;                           // Get mode of the source file.
 
     /* Open the destination file */
-    if (stat(dd, &tb) != 0)                // Check if parent directory exists.
+    if (fstatat(dirfd, dd, &tb, 0) != 0) { // Check if parent directory exists.
+        result = CMD_FAIL("fstatat", dd);
         goto cleanup;                                         // Exit on error.
-    if (stat(destinationPath, &sb2) == -1) {   // Check if file at dstPath DNE.
-        fd2 = open(destinationPath, flags, m1);                 // Create file.
-        if (fd2 == -1)        // Common error when writing to a restricted dir.
-            goto cleanup;                                     // Exit on error.
     }
-    else if ((sb2.st_mode & S_IFMT) == S_IFREG) {      // Check if dst is file.
-        if (unlink(destinationPath) == -1)             // Remove existing file.
-            goto cleanup;                                     // Exit on error.
-        fd2 = open(destinationPath, flags, m1);                 // Create file.
-        if (fd2 == -1)
-            goto cleanup;                                     // Exit on error.
-    } else if (stat(path, &sb2) == 0) {    // Check if filename exists at path.
-        if (unlink(path) == -1)                        // Remove existing file.
-            goto cleanup;                                     // Exit on error.
-        fd2 = open(path, flags, m1);                            // Create file.
-        if (fd2 == -1) 
-            goto cleanup;                                     // Exit on error.
-    } else {                                     // Else, filename at path DNE.
-        fd2 = open(path, flags, m1);                            // Create file.
-        if (fd2 == -1)
-            goto cleanup;                                     // Exit on error.
+    target = destinationPath;
+    if (fstatat(dirfd, destinationPath, &sb2, 0) == -1)     // dstPath DNE.
+        exists = 0;
+    else if ((sb2.st_mode & S_IFMT) == S_IFREG)        // Check if dst is file.
+        exists = 1;
+    else {
+        target = path;
+        exists = fstatat(dirfd, path, &sb2, 0) == 0;  // Filename exists at path.
     }
-    
-    /* Supress the "File not found error" that occurs when creating a file. */
-    if (errno == 2)
-        errno = 0;                                // Set errno to "Successful".
-
-    /* Copy data from source file to destination file */
-    for(filepos=0; filepos=read(fd1, line_buf, BUFSIZ); filepos!=0) {
-        if (filepos == -1)
-            goto cleanup;                                     // Exit on error.
-        nwrite = write(fd2, line_buf, filepos);
-        if (nwrite == -1)
-            goto cleanup;                                     // Exit on error.
+
+    /* An earlier cp left an unchanged copy there (see cpcache.h). */
+    if (exists && cpcache_lookup(fd1, &sb1, dirfd, target, &sb2))
+        goto cleanup;
+    if (exists && durable_level() != DURABLE_ATOMIC
+        && unlinkat(dirfd, target, 0) == -1) {          // Remove old file.
+        result = CMD_FAIL("unlinkat", target);
+        goto cleanup;                                         // Exit on error.
+    }
+    fd2 = durable_create(dirfd, target, m1, &temp);             // Create file.
+    if (fd2 == -1) {      // Common error when writing to a restricted dir.
+        result = CMD_FAIL("openat", target);
+        goto cleanup;                                         // Exit on error.
     }
 
-    /* Close any open files and free allocated memory before exiting. */
+    /* Copy data from source file to destination file (see copy.c), and
+    make it as durable as asked (see durable.h) */
+    if (durable_copy(fd1, fd2, &sb1, &report) == -1) {
+        result = CMD_FAIL(engine_call(&report), target);
+        durable_abort(dirfd, temp);
+    } else if ((call = durable_finish(fd2, dirfd, target, temp)) != NULL)
+        result = CMD_FAIL(call, target);
+    else
+        cpcache_record(&sb1, fd2);
+
+    /* Close any open files before exiting. */
     cleanup:
     if (fd1 != -1)
         close(fd1); 
     if (fd2 != -1)
         close(fd2);
-    free(sp); free(dp); free(path); free(line_buf);
-    return;
+    return result;
 }   /* copyFile */
 
 
-void moveFile(char *sourcePath, char *destinationPath)
+/* Rename sourcePath to target, falling back to renameat(2) if renameat2(2)
+is not available. flags may only be 0 or RENAME_NOREPLACE. */
+static int rename_path(const char *sourcePath, const char *target,
+                       unsigned int flags)
 {
-    char *sp1, *sp2;                              // Temp copies of sourcePath.
-    char *dp1, *dp2;                         // Temp copies of destinationPath.
-    char *bs, *ds;                       // basename and dirname of sourcePath.
-    char *bd, *dd;                  // basename and dirname of destinationPath.
-
-    sp1 = strdup(sourcePath);
-    sp2 = strdup(sourcePath);
-    dp1 = strdup(destinationPath);
-    dp2 = strdup(destinationPath);
-    bs = basename(sp1);
-    bd = basename(dp1);
-    ds = dirname(sp2);
-    dd = dirname(dp2);
-
-    if (strcmp(ds, dd) == 0 && strcmp(bd, ".") == 0)
-        goto cleanup;       // Exit early if the new file replaced the old one.
-
-    copyFile(sourcePath, destinationPath);
-    if (errno != 0)
+    int dirfd = session_fd();
+
+    if (renameat2(dirfd, sourcePath, dirfd, target, flags) == 0)
+        return 0;
+    if (flags != 0 || (errno != ENOSYS && errno != EINVAL))
+        return -1;
+    return renameat(dirfd, sourcePath, dirfd, target);
+}   /* rename_path */
+
+
+/* Move a directory across filesystems. The tree is copied into the temporary
+directory tmp next to target (see treewalk.c), which is renamed into place
+once the copy is complete. The source tree is removed only after that. */
+static cmd_result move_tree_across_devices(const char *sourcePath, char *tmp,
+                                           const char *target,
+                                           unsigned int flags)
+{
+    cmd_result result;      // The failed copy or rename.
+
+    if (make_temp(session_fd(), tmp, 1, S_IRWXU) == -1)
+        return CMD_FAIL("mkdirat", target);                   // Exit on error.
+    if (tree_copy(session_fd(), sourcePath, session_fd(), tmp, 0) == -1)
+        result = CMD_FAIL(NULL, sourcePath);
+    else if (rename_path(tmp, target, flags) == -1)
+        result = CMD_FAIL("renameat2", target);
+    else if (tree_remove(session_fd(), sourcePath) == -1)
+        return CMD_FAIL(NULL, sourcePath);
+    else
+        return CMD_OK;
+    tree_remove(session_fd(), tmp);                // Discard the partial copy.
+    return result;
+}   /* move_tree_across_devices */
+
+
+/* Move a regular file or a directory across filesystems. The data is
+streamed into a temporary file next to target, which is then renamed into
+place, so target is either the old file or the complete new one and never a
+partial copy. The source is unlinked only after the rename succeeded. */
+static cmd_result move_across_devices(const char *sourcePath,
+                                      const char *target, unsigned int flags)
+{
+    int fd1, fd2;           // File descriptors for src file and temp file.
+    struct stat sb;         // Metadata of the source file.
+    char *tp, *dd, *bs;     // Temp copy of target, its dirname and basename.
+    char *tmp;              // tmp = "dirname_of_target/.basename.XXXXXX".
+    copy_report report;     // Which copy method failed.
+    cmd_result result;      // Return value.
+
+    fd1 = fd2 = -1;
+    result = CMD_OK;
+    tp = arena_strdup(&line_arena, target);
+    if (tp == NULL)
+        return CMD_ERROR(ENOMEM, "malloc", NULL);             // Exit on error.
+    bs = basename(tp);
+    tmp = (char *) arena_alloc(&line_arena, strlen(target) + strlen(bs) + 10);
+    if (tmp == NULL)
+        return CMD_ERROR(ENOMEM, "malloc", NULL);             // Exit on error.
+    strcpy(tmp, target);
+    dd = dirname(tmp);                             // Note: truncates tmp.
+    sprintf(tmp + strlen(dd), "/.%s.XXXXXX", bs);
+
+    if (fstatat(session_fd(), sourcePath, &sb, AT_SYMLINK_NOFOLLOW) == -1) {
+        result = CMD_FAIL("fstatat", sourcePath);
+        goto cleanup;                                         // Exit on error.
+    }
+    if (S_ISDIR(sb.st_mode)) {
+        result = move_tree_across_devices(sourcePath, tmp, target, flags);
+        goto cleanup;
+    }
+    if (!S_ISREG(sb.st_mode)) {  // Only regular files can be streamed across.
+        result = CMD_ERROR(EXDEV, "renameat2", sourcePath);
+        goto cleanup;
+    }
+    fd1 = openat(session_fd(), sourcePath, O_RDONLY | O_NOFOLLOW);
+    if (fd1 == -1 || fstat(fd1, &sb) == -1) {
+        result = CMD_FAIL(fd1 == -1 ? "openat" : "fstat", sourcePath);
         goto cleanup;                                         // Exit on error.
+    }
+
+    fd2 = make_temp(session_fd(), tmp, 0,  // Temp file in the target's dir.
+                    S_IRUSR | S_IWUSR);
+    if (fd2 == -1) {
+        result = CMD_FAIL("openat", target);
+        goto cleanup;                                         // Exit on error.
+    }
+    if (fchmod(fd2, sb.st_mode & 07777) == -1)
+        result = CMD_FAIL("fchmod", target);
+    else if (copy_data(fd1, fd2, &sb, &report) == -1)
+        result = CMD_FAIL(engine_call(&report), target);
+    else if (close(fd2) == -1)
+        result = CMD_FAIL("close", target);
+    else
+        fd2 = -1;
+    if (result.err != 0) {
+        if (fd2 != -1)
+            close(fd2);
+        fd2 = -1;
+        unlinkat(session_fd(), tmp, 0);            // Discard the partial copy.
+        goto cleanup;
+    }
 
-    deleteFile(sourcePath);
-    if (errno != 0)
+    if (rename_path(tmp, target, flags) == -1) {
+        result = CMD_FAIL("renameat2", target);
+        unlinkat(session_fd(), tmp, 0);
         goto cleanup;                                         // Exit on error.
-    
+    }
+    if (unlinkat(session_fd(), sourcePath, 0) == -1)
+        result = CMD_FAIL("unlinkat", sourcePath);
+
     cleanup:
-    free(sp1); free(sp2); free(dp1); free(dp2);
-    return;
-}
\ No newline at end of file
+    if (fd1 != -1)
+        close(fd1);
+    if (fd2 != -1)
+        close(fd2);
+    return result;
+}   /* move_across_devices */
+
+
+/* Returns the path that sourcePath gets when it is copied or moved to
+destinationPath: onto a directory means into that directory. The result is
+taken from the line arena; NULL on error. */
+static char *target_path(const char *sourcePath, const char *destinationPath)
+{
+    char *sp;                                      // Temp copy of sourcePath.
+    char *bs;                                        // basename of sourcePath.
+    char *target;           // Final path of the file after it has been moved.
+    struct stat sb;         // Stat buffer for destinationPath.
+
+    sp = arena_strdup(&line_arena, sourcePath);
+    if (sp == NULL)
+        return NULL;                                          // Exit on error.
+    bs = basename(sp);
+    target = (char *) arena_alloc(&line_arena,
+                                  strlen(destinationPath) + strlen(bs) + 2);
+    if (target == NULL)
+        return NULL;                                          // Exit on error.
+
+    if (destinationPath[strlen(destinationPath)-1] == '/')
+        sprintf(target, "%s%s", destinationPath, bs);
+    else if (fstatat(session_fd(), destinationPath, &sb, 0) == 0
+             && S_ISDIR(sb.st_mode))
+        sprintf(target, "%s/%s", destinationPath, bs);
+    else
+        strcpy(target, destinationPath);
+    return target;
+}   /* target_path */
+
+
+/* Moving within a filesystem is a single rename(2), for directories too.
+Only when the kernel reports EXDEV is the file or tree copied into the
+destination filesystem. flags is passed on to renameat2(2)
+(RENAME_NOREPLACE for mv -n). */
+static cmd_result move_file(char *sourcePath, char *destinationPath,
+                            unsigned int flags)
+{
+    char *target;           // Final path of the file after it has been moved.
+
+    if ((target = target_path(sourcePath, destinationPath)) == NULL)
+        return CMD_ERROR(ENOMEM, "malloc", NULL);             // Exit on error.
+    if (rename_path(sourcePath, target, flags) == 0)
+        return CMD_OK;
+    if (errno == EXDEV)
+        return move_across_devices(sourcePath, target, flags);
+    return CMD_FAIL("renameat2", sourcePath);
+}   /* move_file */
+
+
+cmd_result moveFile(char *sourcePath, char *destinationPath)
+{
+    return move_file(sourcePath, destinationPath, 0);
+}   /* moveFile */
+
+
+/* cp of one operand. With -r the source may be a directory, which is copied
+with everything below it; without it this is copyFile(). */
+static cmd_result copy_path(char *sourcePath, char *destinationPath,
+                            unsigned int flags)
+{
+    char *target;           // Final path of the copy.
+
+    if (!(flags & CP_RECURSIVE))
+        return copyFile(sourcePath, destinationPath);
+    if ((target = target_path(sourcePath, destinationPath)) == NULL)
+        return CMD_ERROR(ENOMEM, "malloc", NULL);             // Exit on error.
+    if (tree_copy(session_fd(), sourcePath, session_fd(), target,
+                  flags & CP_FOLLOW ? TREE_FOLLOW : 0) == -1)
+        return CMD_FAIL(NULL, sourcePath);
+    return CMD_OK;
+}   /* copy_path */
+
+
+/* rm of one operand. With -r a directory is removed with everything below
+it; without it only files are removed. */
+static cmd_result delete_path(char *path, unsigned int flags)
+{
+    if (!(flags & RM_RECURSIVE))
+        return deleteFile(path);
+    if (tree_remove(session_fd(), path) == -1)
+        return CMD_FAIL(NULL, path);
+    return CMD_OK;
+}   /* delete_path */
+
+
+/* One operand of a cp, mv or rm with several operands. */
+typedef struct file_task {
+    enum { FILE_COPY, FILE_MOVE, FILE_DELETE } op;
+    unsigned int flags;     // CP_*, renameat2(2) or RM_* flags of the op.
+    char *path;             // The operand.
+    char *dir;              // Destination directory (FILE_COPY/FILE_MOVE).
+    cmd_result result;      // What the operation returned.
+} file_task;
+
+
+/* Runs on a pool worker, which writes only the result of its own task. */
+static void run_file_task(void *arg)
+{
+    file_task *task = arg;
+
+    switch (task->op) {
+        case FILE_COPY:
+            task->result = copy_path(task->path, task->dir, task->flags);
+            break;
+        case FILE_MOVE:
+            task->result = move_file(task->path, task->dir, task->flags);
+            break;
+        case FILE_DELETE:
+            task->result = delete_path(task->path, task->flags);
+            break;
+    }
+}   /* run_file_task */
+
+
+/* Run one task per operand on the worker pool so the I/O of different files
+overlaps. Once all have finished, the failures are reported in operand
+order and the first of them is returned. A worker may reset its arena as
+soon as the task is done, so each failure is reported against its operand,
+never a path the worker built. */
+static cmd_result run_file_tasks(const char *name, int op, unsigned int flags,
+                                 char **paths, int count, char *dir)
+{
+    file_task *tasks;       // One per operand, in operand order.
+    pool_group group;       // Everything submitted for this command.
+    cmd_result first;       // First failure, in operand order.
+    int i;
+
+    tasks = arena_alloc(&line_arena, count * sizeof(file_task));
+    if (tasks == NULL)
+        return CMD_ERROR(ENOMEM, "malloc", NULL);             // Exit on error.
+    group.pending = 0;
+    for (i = 0; i < count; i++) {
+        tasks[i].op = op;
+        tasks[i].flags = flags;
+        tasks[i].path = paths[i];
+        tasks[i].dir = dir;
+        pool_submit(&group, run_file_task, &tasks[i]);
+    }
+    pool_wait(&group);
+
+    first = CMD_OK;
+    for (i = 0; i < count; i++) {
+        if (tasks[i].result.err == 0)
+            continue;
+        tasks[i].result.path = tasks[i].path;
+        print_result(name, &tasks[i].result);
+        if (first.err == 0) {
+            first = tasks[i].result;
+            first.reported = 1;
+        }
+    }
+    return first;
+}   /* run_file_tasks */
+
+
+/* Returns true if path names an existing directory. */
+static int is_directory(const char *path)
+{
+    struct stat sb;
+
+    return fstatat(session_fd(), path, &sb, 0) == 0 && S_ISDIR(sb.st_mode);
+}   /* is_directory */
+
+
+/* Consume the leading options of args (e.g. "-r" or "-rL"). Each letter of
+an option must appear in letters, and sets the flag at the same index in
+values. Returns the number of arguments consumed, or -1 if an option is not
+known. */
+static int parse_flags(char **args, int count, const char *letters,
+                       const unsigned int *values, unsigned int *flags)
+{
+    const char *c;          // The current option letter.
+    const char *found;      // Its place in letters.
+    int i;
+
+    *flags = 0;
+    for (i = 0; i < count && args[i][0] == '-' && args[i][1] != '\0'; i++)
+        for (c = args[i] + 1; *c != '\0'; c++) {
+            if ((found = strchr(letters, *c)) == NULL)
+                return -1;
+            *flags |= values[found - letters];
+        }
+    return i;
+}   /* parse_flags */
+
+
+/* cp [-r] [-L] <src> <dst>, or cp [-r] [-L] <src>... <directory> with the
+files copied in parallel. -r copies directories (see treewalk.c), and -L
+copies what symbolic links point to instead of the links. */
+cmd_result copyFiles(char **args, int count)
+{
+    static const unsigned int values[] = {CP_RECURSIVE, CP_RECURSIVE,
+                                          CP_FOLLOW};
+    unsigned int flags;
+    int n;
+
+    if ((n = parse_flags(args, count, "rRL", values, &flags)) == -1)
+        return CMD_USAGE;                                     // Exit on error.
+    args += n;
+    count -= n;
+    if (count < 2)
+        return CMD_USAGE;
+    if (count == 2)
+        return copy_path(args[0], args[1], flags);
+    if (!is_directory(args[count-1]))
+        return CMD_ERROR(ENOTDIR, NULL, args[count-1]);
+    return run_file_tasks("cp", FILE_COPY, flags, args, count - 1,
+                          args[count-1]);
+}   /* copyFiles */
+
+
+/* mv [-n] <src> <dst>, or mv [-n] <src>... <directory> with the files moved
+in parallel. -n never replaces an existing file (RENAME_NOREPLACE). */
+cmd_result moveFiles(char **args, int count)
+{
+    static const unsigned int values[] = {RENAME_NOREPLACE};
+    unsigned int flags;
+    int n;
+
+    if ((n = parse_flags(args, count, "n", values, &flags)) == -1)
+        return CMD_USAGE;                                     // Exit on error.
+    args += n;
+    count -= n;
+    if (count < 2)
+        return CMD_USAGE;
+    if (count == 2)
+        return move_file(args[0], args[1], flags);
+    if (!is_directory(args[count-1]))
+        return CMD_ERROR(ENOTDIR, NULL, args[count-1]);
+    return run_file_tasks("mv", FILE_MOVE, flags, args, count - 1,
+                          args[count-1]);
+}   /* moveFiles */
+
+
+/* rm [-r] <file>..., with several files removed in parallel. -r removes
+directories and everything below them. */
+cmd_result deleteFiles(char **args, int count)
+{
+    static const unsigned int values[] = {RM_RECURSIVE, RM_RECURSIVE};
+    unsigned int flags;
+    int n;
+
+    if ((n = parse_flags(args, count, "rR", values, &flags)) == -1)
+        return CMD_USAGE;                                     // Exit on error.
+    args += n;
+    count -= n;
+    if (count < 1)
+        return CMD_USAGE;
+    if (count == 1)
+        return delete_path(args[0], flags);
+    return run_file_tasks("rm", FILE_DELETE, flags, args, count, NULL);
+}   /* deleteFiles */
@@ -9,19 +9,57 @@
 * Notes:
 * 1. Do not edit this file.
 */
+#ifndef COMMAND_H
+#define COMMAND_H
 
-void listDir(); /*for the ls command*/
+#include <errno.h>
 
-void showCurrentDir(); /*for the pwd command*/
 
-void makeDir(char *dirName); /*for the mkdir command*/
+/* What every builtin returns instead of leaving errno set: err is 0 on
+success, otherwise the errno value of the failure, with the call that
+failed and the path it failed on (either may be NULL). The strings must
+outlive the command: string literals, operands, or the line arena. */
+typedef struct cmd_result {
+    int err;
+    const char *syscall;
+    const char *path;
+    int reported;           // The failure was already printed, per operand.
+} cmd_result;
 
-void changeDir(char *dirName); /*for the cd command*/
+#define CMD_OK ((cmd_result) {0, NULL, NULL, 0})
+#define CMD_USAGE ((cmd_result) {EINVAL, NULL, NULL, 0})      // Bad operands.
+#define CMD_ERROR(err, syscall, path) ((cmd_result) {(err), (syscall), (path), 0})
+#define CMD_FAIL(syscall, path) CMD_ERROR(errno, (syscall), (path))
 
-void copyFile(char *sourcePath, char *destinationPath); /*for the cp command*/
+#define CMD_IS_USAGE(r) ((r).err == EINVAL && (r).syscall == NULL && (r).path == NULL)
 
-void moveFile(char *sourcePath, char *destinationPath); /*for the mv command*/
 
-void deleteFile(char *filename); /*for the rm command*/
+cmd_result listDir(); /*for the ls command*/
 
-void displayFile(char *filename); /*for the cat command*/
+cmd_result listDirectory(char **args, int count); /*for ls with options*/
+
+cmd_result showCurrentDir(); /*for the pwd command*/
+
+cmd_result showWorkingDir(char **args, int count); /*for pwd -P*/
+
+cmd_result makeDir(char *dirName); /*for the mkdir command*/
+
+cmd_result changeDir(char *dirName); /*for the cd command*/
+
+cmd_result copyFile(char *sourcePath, char *destinationPath); /*for the cp command*/
+
+cmd_result moveFile(char *sourcePath, char *destinationPath); /*for the mv command*/
+
+cmd_result deleteFile(char *filename); /*for the rm command*/
+
+cmd_result displayFile(char *filename); /*for the cat command*/
+
+cmd_result displayFiles(char **filenames, int count); /*for cat with several files*/
+
+cmd_result copyFiles(char **args, int count); /*for cp with several files*/
+
+cmd_result moveFiles(char **args, int count); /*for mv with several files or -n*/
+
+cmd_result deleteFiles(char **args, int count); /*for rm with several files*/
+
+#endif  /* COMMAND_H */
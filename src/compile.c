@@ -0,0 +1,507 @@
+/*
+ *  compile.c
+ *
+ *  Author: Joseph Erlinger
+ *      Created on: October 17, 2026
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <time.h>
+#include "compile.h"
+#include "string_parser.h"
+#include "cli.h"
+#include "arena.h"
+
+
+#define INTERN_MIN_SLOTS 256    // Initial size of the string hash table.
+
+
+/* A growing array of bytes. */
+typedef struct buffer {
+    char *data;
+    size_t len;
+    size_t cap;
+} buffer;
+
+
+/* What compile_batch() builds. */
+typedef struct program {
+    buffer offsets;         // uint32_t per string: where it starts in text.
+    buffer code;            // uint32_t words.
+    buffer text;            // The strings.
+    uint32_t *slots;        // Hash table of string id + 1, 0 if empty.
+    size_t nslots;          // A power of two.
+    uint32_t num_strings, num_lines, num_segments, num_tokens;
+} program;
+
+
+static unsigned long fnv1a (unsigned long h, const void *data, size_t len)
+{
+    const unsigned char *p = data;
+
+    for (; len > 0; len--, p++) {
+        h ^= *p;
+        h *= 1099511628211UL;
+    }
+    return h;
+}   /* fnv1a */
+
+
+#define FNV_BASIS 14695981039346656037UL
+
+
+static int append (buffer *b, const void *data, size_t len)
+{
+    size_t cap;
+    char *grown;
+
+    if (b->len + len > b->cap) {
+        for (cap = b->cap == 0 ? 4096 : b->cap; cap < b->len + len; cap *= 2)
+            ;
+        if ((grown = counted_realloc(b->data, cap)) == NULL)
+            return -1;
+        b->data = grown;
+        b->cap = cap;
+    }
+    memcpy(b->data + b->len, data, len);
+    b->len += len;
+    return 0;
+}   /* append */
+
+
+static int emit (program *p, uint32_t word)
+{
+    if (p->code.len / sizeof(uint32_t) >= UINT32_MAX) {
+        errno = EFBIG;
+        return -1;
+    }
+    return append(&p->code, &word, sizeof(word));
+}   /* emit */
+
+
+static const char *string_of (const program *p, uint32_t id)
+{
+    return p->text.data + ((const uint32_t *) p->offsets.data)[id];
+}   /* string_of */
+
+
+/* Double the hash table (or create it) and reinsert every string. */
+static int grow_slots (program *p)
+{
+    uint32_t *old;
+    size_t old_slots, i, j;
+    const char *s;
+
+    old = p->slots;
+    old_slots = p->nslots;
+    p->nslots = old_slots == 0 ? INTERN_MIN_SLOTS : 2 * old_slots;
+    if ((p->slots = counted_malloc(p->nslots * sizeof(uint32_t))) == NULL) {
+        p->slots = old;
+        p->nslots = old_slots;
+        return -1;
+    }
+    memset(p->slots, 0, p->nslots * sizeof(uint32_t));
+    for (i = 0; i < old_slots; i++) {
+        if (old[i] == 0)
+            continue;
+        s = string_of(p, old[i] - 1);
+        for (j = fnv1a(FNV_BASIS, s, strlen(s)) & (p->nslots - 1);
+             p->slots[j] != 0; j = (j + 1) & (p->nslots - 1))
+            ;
+        p->slots[j] = old[i];
+    }
+    counted_free(old);
+    return 0;
+}   /* grow_slots */
+
+
+/* The id of s in the string table, adding it if it is new. Returns -1 if
+out of memory. */
+static long intern (program *p, const char *s)
+{
+    size_t len, i;
+    uint32_t offset;
+
+    if ((p->num_strings + 1) * 2 > p->nslots && grow_slots(p) == -1)
+        return -1;
+    len = strlen(s);
+    for (i = fnv1a(FNV_BASIS, s, len) & (p->nslots - 1); p->slots[i] != 0;
+         i = (i + 1) & (p->nslots - 1))
+        if (strcmp(string_of(p, p->slots[i] - 1), s) == 0)
+            return p->slots[i] - 1;
+    if (p->text.len + len + 1 > UINT32_MAX) {
+        errno = EFBIG;
+        return -1;
+    }
+    offset = p->text.len;
+    if (append(&p->offsets, &offset, sizeof(offset)) == -1
+        || append(&p->text, s, len + 1) == -1)
+        return -1;
+    p->slots[i] = ++p->num_strings;
+    return p->num_strings - 1;
+}   /* intern */
+
+
+/* Compile one line, which is tokenized in place. */
+static int compile_line (program *p, token_arena *tokens, char *line)
+{
+    command_line *seg;
+    int num_segments, i, n;
+    long id;
+
+    if ((num_segments = tokenize_line(tokens, line)) == -1
+        || emit(p, COMPILED_LINE) == -1)
+        return -1;
+    p->num_lines++;
+    for (i = 0; i < num_segments; i++) {
+        seg = &tokens->segments[i];
+        for (n = 0; seg->command_list[n] != NULL; n++)
+            ;
+        if (emit(p, seg->background ? COMPILED_JOB : COMPILED_COMMAND) == -1
+            || emit(p, n) == -1)
+            return -1;
+        for (n = 0; seg->command_list[n] != NULL; n++)
+            if ((id = intern(p, seg->command_list[n])) == -1
+                || emit(p, id) == -1)
+                return -1;
+        p->num_segments++;
+        p->num_tokens += n;
+    }
+    return 0;
+}   /* compile_line */
+
+
+/* Read all of fd into a new buffer with a NUL after the data. */
+static char *read_all (int fd, size_t *size)
+{
+    buffer b = {NULL, 0, 0};
+    char chunk[65536];
+    ssize_t n;
+
+    for (;;) {
+        n = read(fd, chunk, sizeof(chunk));
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n == -1 || append(&b, chunk, n) == -1) {
+            counted_free(b.data);
+            return NULL;
+        }
+        if (n == 0)
+            break;
+    }
+    if (append(&b, "", 1) == -1) {
+        counted_free(b.data);
+        return NULL;
+    }
+    *size = b.len - 1;
+    return b.data;
+}   /* read_all */
+
+
+/* Returns <0, 0 or >0 as a is before, at or after b. */
+static int compare_time (const struct timespec *a, const struct timespec *b)
+{
+    if (a->tv_sec != b->tv_sec)
+        return a->tv_sec < b->tv_sec ? -1 : 1;
+    return (a->tv_nsec > b->tv_nsec) - (a->tv_nsec < b->tv_nsec);
+}   /* compare_time */
+
+
+/* Take the time of the compile of fd into *now, and its metadata into sb.
+Timestamps come from the kernel's coarse clock, so a write in the tick of
+the source's ctime can leave it unchanged: first wait for that tick to
+pass (for up to 100 ms, in case the ctime is ahead of this clock), so a
+fresh source is not compiled as stale. */
+static int stat_source (int fd, struct stat *sb, struct timespec *now)
+{
+    const struct timespec tick = { 0, 1000000 };
+    int waited;             // # Ticks waited.
+
+    if (fstat(fd, sb) == -1)
+        return -1;
+    clock_gettime(CLOCK_REALTIME_COARSE, now);
+    for (waited = 0; waited < 100 && compare_time(&sb->st_ctim, now) >= 0;
+         waited++) {
+        nanosleep(&tick, NULL);
+        clock_gettime(CLOCK_REALTIME_COARSE, now);
+    }
+    return fstat(fd, sb);
+}   /* stat_source */
+
+
+/* Write the header and the three parts of p to fd. */
+static int write_program (int fd, program *p, const struct stat *source,
+                          const struct timespec *compiled)
+{
+    compiled_header h;
+    struct iovec iov[4];
+    ssize_t n;
+    int i;
+
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, COMPILED_MAGIC, sizeof(h.magic));
+    h.version = COMPILED_VERSION;
+    h.source_size = source->st_size;
+    h.source_mtime_sec = source->st_mtim.tv_sec;
+    h.source_mtime_nsec = source->st_mtim.tv_nsec;
+    h.source_ino = source->st_ino;
+    h.source_dev = source->st_dev;
+    h.source_ctime_sec = source->st_ctim.tv_sec;
+    h.source_ctime_nsec = source->st_ctim.tv_nsec;
+    h.compile_sec = compiled->tv_sec;
+    h.compile_nsec = compiled->tv_nsec;
+    h.num_strings = p->num_strings;
+    h.num_words = p->code.len / sizeof(uint32_t);
+    h.num_lines = p->num_lines;
+    h.num_segments = p->num_segments;
+    h.num_tokens = p->num_tokens;
+    h.strings_size = p->text.len;
+    h.checksum = FNV_BASIS;
+    h.checksum = fnv1a(h.checksum, p->offsets.data, p->offsets.len);
+    h.checksum = fnv1a(h.checksum, p->code.data, p->code.len);
+    h.checksum = fnv1a(h.checksum, p->text.data, p->text.len);
+
+    iov[0].iov_base = &h;
+    iov[0].iov_len = sizeof(h);
+    iov[1].iov_base = p->offsets.data;
+    iov[1].iov_len = p->offsets.len;
+    iov[2].iov_base = p->code.data;
+    iov[2].iov_len = p->code.len;
+    iov[3].iov_base = p->text.data;
+    iov[3].iov_len = p->text.len;
+    for (i = 0; i < 4; ) {
+        if ((n = writev(fd, iov + i, 4 - i)) == -1) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        for (; i < 4 && (size_t) n >= iov[i].iov_len; i++)
+            n -= iov[i].iov_len;
+        if (i < 4) {
+            iov[i].iov_base = (char *) iov[i].iov_base + n;
+            iov[i].iov_len -= n;
+        }
+    }
+    return 0;
+}   /* write_program */
+
+
+int compile_batch (const char *filename)
+{
+    token_arena tokens;
+    program p;
+    struct stat sb;
+    struct timespec now;    // When the source is read.
+    char *source;           // The batch file, NUL terminated.
+    char *line, *eol, *end;
+    char tmp[PATH_MAX];     // Written here, then renamed into place.
+    char target[PATH_MAX];
+    size_t size;
+    int fd, status, saved_errno;
+
+    if ((fd = open(filename, O_RDONLY | O_CLOEXEC)) == -1)
+        return -1;
+    source = NULL;
+    if (stat_source(fd, &sb, &now) == 0) {
+        if (S_ISREG(sb.st_mode))
+            source = read_all(fd, &size);
+        else
+            errno = EINVAL;     // No metadata to tell a stale compile apart.
+    }
+    saved_errno = errno;
+    close(fd);
+    errno = saved_errno;
+    if (source == NULL)
+        return -1;
+
+    memset(&p, 0, sizeof(p));
+    init_token_arena(&tokens, SEGMENT_DELIM, TOKEN_DELIM, OPERATOR_DELIM,
+                     BACKGROUND_DELIM);
+    status = 0;
+    end = source + size;
+    for (line = source; status == 0 && line < end; line = eol + 1) {
+        if ((eol = memchr(line, '\n', end - line)) == NULL)
+            eol = end;                      // An unterminated last line.
+        *eol = '\0';
+        status = compile_line(&p, &tokens, line);
+    }
+
+    /* Write a temporary file next to the target and rename it over it. */
+    fd = -1;
+    if (status == 0
+        && (snprintf(target, sizeof(target), "%s%s", filename,
+                     COMPILED_SUFFIX) >= (int) sizeof(target)
+            || snprintf(tmp, sizeof(tmp), "%s.XXXXXX", target)
+               >= (int) sizeof(tmp))) {
+        errno = ENAMETOOLONG;
+        status = -1;
+    }
+    if (status == 0 && ((fd = mkostemp(tmp, O_CLOEXEC)) == -1
+                        || write_program(fd, &p, &sb, &now) == -1
+                        || fchmod(fd, sb.st_mode & 0666) == -1
+                        || close(fd) == -1
+                        || rename(tmp, target) == -1)) {
+        saved_errno = errno;
+        unlink(tmp);
+        errno = saved_errno;
+        status = -1;
+    }
+
+    saved_errno = errno;
+    free_token_arena(&tokens);
+    counted_free(p.offsets.data);
+    counted_free(p.code.data);
+    counted_free(p.text.data);
+    counted_free(p.slots);
+    counted_free(source);
+    errno = saved_errno;
+    return status;
+}   /* compile_batch */
+
+
+/* A program ready to run: the segments of every line, with their tokens
+pointing into the mapped string table. */
+typedef struct loaded {
+    command_line *segments;
+    uint32_t *line_segments;    // # Segments of each line.
+    char **argv;                // Every segment's tokens, NULL terminated.
+} loaded;
+
+
+/* Check the header and the checksum of the mapping of size bytes, and
+resolve its code into l. Returns -1 if it is not a compiled form of the
+file with metadata source, or if anything in it is out of bounds. */
+static int load (char *map, size_t size, const struct stat *source,
+                 loaded *l)
+{
+    const compiled_header *h = (const compiled_header *) map;
+    const uint32_t *offsets, *code;
+    char *text;
+    uint64_t body;          // Expected bytes after the header.
+    unsigned long sum;
+    uint32_t w, n, i, id, line, seg, tok;
+
+    if (size < sizeof(*h) || memcmp(h->magic, COMPILED_MAGIC, 4) != 0
+        || h->version != COMPILED_VERSION
+        || h->source_size != (uint64_t) source->st_size
+        || h->source_mtime_sec != source->st_mtim.tv_sec
+        || h->source_mtime_nsec != source->st_mtim.tv_nsec
+        || h->source_ino != (uint64_t) source->st_ino
+        || h->source_dev != (uint64_t) source->st_dev
+        || h->source_ctime_sec != source->st_ctim.tv_sec
+        || h->source_ctime_nsec != source->st_ctim.tv_nsec
+        || h->source_ctime_sec > h->compile_sec
+        || (h->source_ctime_sec == h->compile_sec
+            && h->source_ctime_nsec >= h->compile_nsec))
+        return -1;                                      // Stale or foreign.
+    body = ((uint64_t) h->num_strings + h->num_words) * sizeof(uint32_t)
+           + h->strings_size;
+    if (size - sizeof(*h) != body
+        || (h->strings_size > 0 && map[size - 1] != '\0'))
+        return -1;
+    sum = fnv1a(FNV_BASIS, map + sizeof(*h), body);
+    if (sum != h->checksum)
+        return -1;                                      // Damaged.
+
+    offsets = (const uint32_t *) (map + sizeof(*h));
+    code = offsets + h->num_strings;
+    text = (char *) (code + h->num_words);
+    for (i = 0; i < h->num_strings; i++)
+        if (offsets[i] >= h->strings_size)
+            return -1;
+
+    l->segments = counted_malloc((h->num_segments + 1) * sizeof(command_line));
+    l->line_segments = counted_malloc((h->num_lines + 1) * sizeof(uint32_t));
+    l->argv = counted_malloc(((uint64_t) h->num_tokens + h->num_segments + 1)
+                             * sizeof(char *));
+    if (l->segments == NULL || l->line_segments == NULL || l->argv == NULL)
+        return -1;
+
+    /* Resolve the code, checking every count and index against the
+    header before anything is written. */
+    line = seg = tok = 0;
+    for (w = 0; w < h->num_words; ) {
+        if (code[w] == COMPILED_LINE) {
+            if (line == h->num_lines)
+                return -1;
+            l->line_segments[line++] = 0;
+            w++;
+            continue;
+        }
+        if ((code[w] != COMPILED_COMMAND && code[w] != COMPILED_JOB)
+            || line == 0 || seg == h->num_segments || w + 1 >= h->num_words)
+            return -1;
+        n = code[w + 1];
+        if (n > h->num_words - w - 2 || n > h->num_tokens - tok)
+            return -1;
+        l->segments[seg].command_list = l->argv + tok + seg;
+        l->segments[seg].num_token = n + 1;     // Counts the NULL.
+        l->segments[seg].background = code[w] == COMPILED_JOB;
+        for (i = 0; i < n; i++) {
+            if ((id = code[w + 2 + i]) >= h->num_strings)
+                return -1;
+            l->argv[tok + seg + i] = text + offsets[id];
+        }
+        l->argv[tok + seg + n] = NULL;
+        tok += n;
+        seg++;
+        l->line_segments[line - 1]++;
+        w += 2 + n;
+    }
+    if (line != h->num_lines || seg != h->num_segments
+        || tok != h->num_tokens)
+        return -1;
+    return 0;
+}   /* load */
+
+
+int run_compiled (const char *filename, const struct stat *source)
+{
+    const compiled_header *h;
+    char path[PATH_MAX];
+    struct stat sb;
+    loaded l = {NULL, NULL, NULL};
+    char *map;
+    uint32_t line, seg;
+    int fd, status;
+
+    if (snprintf(path, sizeof(path), "%s%s", filename, COMPILED_SUFFIX)
+        >= (int) sizeof(path))
+        return -1;
+    if ((fd = open(path, O_RDONLY | O_CLOEXEC)) == -1)
+        return -1;
+    if (fstat(fd, &sb) == -1 || !S_ISREG(sb.st_mode)
+        || (size_t) sb.st_size < sizeof(compiled_header)) {
+        close(fd);
+        return -1;
+    }
+
+    /* Private and writable: tokens are char *, as if they were parsed. */
+    map = mmap(NULL, sb.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return -1;
+    status = load(map, sb.st_size, source, &l);
+    if (status == 0) {
+        h = (const compiled_header *) map;
+        for (line = seg = 0; line < h->num_lines; line++) {
+            if (run_segments(l.segments + seg, l.line_segments[line])
+                == HALTED)
+                break;                                  // exit was executed.
+            seg += l.line_segments[line];
+        }
+    }
+    counted_free(l.segments);
+    counted_free(l.line_segments);
+    counted_free(l.argv);
+    munmap(map, sb.st_size);
+    return status;
+}   /* run_compiled */
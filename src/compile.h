@@ -0,0 +1,69 @@
+/*
+ *  compile.h
+ *
+ *  Author: Joseph Erlinger
+ *      Created on: October 17, 2026
+ */
+#ifndef COMPILE_H
+#define COMPILE_H
+
+#include <stdint.h>
+#include <sys/stat.h>
+
+
+#define COMPILED_SUFFIX ".psc"      // batch.txt compiles to batch.txt.psc.
+#define COMPILED_MAGIC "PSC\n"
+#define COMPILED_VERSION 2          // Bump on any change to the format.
+
+
+/* A compiled batch file is the header, then the string table offsets
+(uint32_t[num_strings]), then the code (uint32_t[num_words]), then the
+strings, each NUL terminated. The code is a sequence of
+
+    COMPILED_LINE                               start of a line
+    COMPILED_COMMAND|COMPILED_JOB n id[n]       a segment of n tokens
+
+where a segment is what the tokenizer made of a ';' or '&' separated
+command (see string_parser.h), and COMPILED_JOB marks the '&' ones. Every
+token is an index into the string table, and equal tokens share one
+string. The file is in the byte order of the machine that wrote it. */
+typedef struct compiled_header {
+    char magic[4];              // COMPILED_MAGIC.
+    uint32_t version;           // COMPILED_VERSION.
+    uint64_t source_size;       // The batch file it was compiled from.
+    int64_t source_mtime_sec;
+    int64_t source_mtime_nsec;
+    uint64_t source_ino;
+    uint64_t source_dev;
+    int64_t source_ctime_sec;   // Changes with any write, even one that
+    int64_t source_ctime_nsec;  //   puts the size and mtime back.
+    int64_t compile_sec;        // When the source was read: a change in the
+    int64_t compile_nsec;       //   tick of its ctime may not show in it.
+    uint64_t checksum;          // FNV-1a of everything after the header.
+    uint32_t num_strings;
+    uint32_t num_words;         // Code length.
+    uint32_t num_lines;
+    uint32_t num_segments;
+    uint32_t num_tokens;        // In all segments.
+    uint32_t strings_size;      // Bytes of string text.
+} compiled_header;
+
+
+enum { COMPILED_LINE, COMPILED_COMMAND, COMPILED_JOB };
+
+
+/* -c: tokenize every line of the batch file filename once and write the
+result to filename COMPILED_SUFFIX, replacing it atomically. Returns 0, or
+-1 with errno set. */
+int compile_batch (const char *filename);
+
+
+/* Run the compiled form of the batch file filename (whose metadata is
+source), mapping it and executing its code without any parsing. Returns 0
+if it was run, or -1 if there is no compiled form, or it was compiled from
+another version of the file or is damaged; the caller then parses the text
+instead. A compiled form counts as current only if the source's ctime is
+what was compiled and is older than the compile. */
+int run_compiled (const char *filename, const struct stat *source);
+
+#endif  /* COMPILE_H */
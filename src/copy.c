@@ -0,0 +1,502 @@
+/*
+ *  copy.c
+ *
+ *  Author: Joseph Erlinger
+ *      Created on: October 17, 2026
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <limits.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <linux/fs.h>
+#include "copy.h"
+#include "arena.h"
+#include "iobackend.h"
+
+
+static __thread char *copy_buf;  // Lazily allocated for COPY_READWRITE.
+static __thread char *direct_buf;   // Lazily allocated for COPY_DIRECT,
+                                    //   COPY_DIRECT_ALIGN aligned.
+
+
+/* Returns true if the kernel refused a copy method outright (as opposed to
+a real I/O error), meaning the next method down should be tried. */
+static int method_unsupported (int error_number)
+{
+    switch (error_number) {
+        case EXDEV:
+        case ENOSYS:
+        case EINVAL:
+        case EOPNOTSUPP:
+        case ENOTTY:
+        case EBADF:
+        case ETXTBSY:
+            return 1;
+        default:
+            return 0;
+    }
+}   /* method_unsupported */
+
+
+/* Copy len bytes at offset off from src to the same offset in dst. The
+method is sticky: once a method is refused it is not retried for the rest of
+the file. When copy_file_range is refused, large extents go to io_uring
+(several blocks in flight) before the one-request-at-a-time sendfile.
+Returns 0 on success and -1 (with errno set) on error. */
+static int copy_extent (int src, int dst, off_t off, off_t len,
+                        COPY_METHOD *method)
+{
+    off_t in_off, out_off;  // Offsets for the kernel copy methods.
+    off_t n;                // # Bytes moved by the last call.
+    size_t chunk;           // # Bytes requested in the next call.
+
+    in_off = out_off = off;
+    while (len > 0) {
+        chunk = len > SSIZE_MAX ? SSIZE_MAX : (size_t) len;
+        switch (*method) {
+            case COPY_NONE:
+            case COPY_REFLINK:
+                *method = COPY_RANGE;
+                /* fallthrough */
+            case COPY_RANGE:
+                n = copy_file_range(src, &in_off, dst, &out_off, chunk, 0);
+                if (n == -1 && method_unsupported(errno)) {
+                    *method = io_backend_for(len) == &uring_backend
+                              ? COPY_URING : COPY_SENDFILE;
+                    continue;
+                }
+                break;
+            case COPY_URING:
+                n = uring_backend.transfer(src, in_off, dst, out_off, len);
+                if (n == -1 && errno == ENOSYS) {
+                    *method = COPY_SENDFILE;
+                    continue;
+                }
+                if (n >= 0 && n < len)
+                    len = n;                 // Source shrank while copying.
+                if (n > 0) {
+                    in_off += n;
+                    out_off += n;
+                }
+                break;
+            case COPY_SENDFILE:
+                if (lseek(dst, out_off, SEEK_SET) == -1)
+                    return -1;
+                n = sendfile(dst, src, &in_off, chunk);
+                if (n == -1 && method_unsupported(errno)) {
+                    *method = COPY_READWRITE;
+                    continue;
+                }
+                if (n > 0)
+                    out_off += n;
+                break;
+            default:
+                *method = COPY_READWRITE;
+                n = sync_backend.transfer(src, in_off, dst, out_off, len);
+                if (n >= 0 && n < len)
+                    len = n;                 // Source shrank while copying.
+                if (n > 0) {
+                    in_off += n;
+                    out_off += n;
+                }
+                break;
+        }
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            return -1;                                        // Exit on error.
+        }
+        if (n == 0)
+            break;                      // Source shrank while being copied.
+        len -= n;
+    }
+    return 0;
+}   /* copy_extent */
+
+
+/* Write all of buf to fd at off, retrying short writes. */
+static int pwrite_all (int fd, const char *buf, size_t len, off_t off)
+{
+    ssize_t n;              // # Bytes written by the last call.
+
+    while (len > 0) {
+        n = pwrite(fd, buf, len, off);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n == -1)
+            return -1;
+        buf += n;
+        len -= n;
+        off += n;
+    }
+    return 0;
+}   /* pwrite_all */
+
+
+/* Turn O_DIRECT on or off for fd. */
+static int set_direct (int fd, int on)
+{
+    int flags;
+
+    if ((flags = fcntl(fd, F_GETFL)) == -1)
+        return -1;
+    if (!(flags & O_DIRECT) == !on)
+        return 0;
+    return fcntl(fd, F_SETFL, on ? flags | O_DIRECT : flags & ~O_DIRECT);
+}   /* set_direct */
+
+
+/* copy_extent() for copy_data_direct(): read len bytes at off from src
+into the aligned buffer and write the aligned blocks of them with O_DIRECT,
+the rest through the page cache. The method drops to COPY_READWRITE for
+good once O_DIRECT is refused. */
+static int direct_extent (int src, int dst, off_t off, off_t len,
+                          COPY_METHOD *method)
+{
+    size_t want;            // # Bytes to read next.
+    size_t aligned;         // # Bytes of them to write with O_DIRECT.
+    ssize_t n;              // # Bytes read.
+
+    if (direct_buf == NULL
+        && (direct_buf = counted_memalign(COPY_DIRECT_ALIGN,
+                                          COPY_BUFSIZ)) == NULL)
+        return -1;
+    if (*method == COPY_NONE)
+        *method = COPY_DIRECT;
+    while (len > 0) {
+        want = off % COPY_DIRECT_ALIGN != 0      // Get back onto a boundary.
+               ? COPY_DIRECT_ALIGN - off % COPY_DIRECT_ALIGN : COPY_BUFSIZ;
+        if ((off_t) want > len)
+            want = len;
+        n = pread(src, direct_buf, want, off);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n == -1)
+            return -1;
+        if (n == 0)
+            break;                      // Source shrank while being copied.
+        aligned = 0;
+        if (*method == COPY_DIRECT && off % COPY_DIRECT_ALIGN == 0)
+            aligned = n & ~(size_t) (COPY_DIRECT_ALIGN - 1);
+        if (aligned > 0 && (set_direct(dst, 1) == -1
+                            || pwrite_all(dst, direct_buf, aligned, off) == -1)) {
+            if (errno != EINVAL)
+                return -1;
+            *method = COPY_READWRITE;   // The filesystem refuses O_DIRECT.
+            aligned = 0;
+        }
+        if ((size_t) n > aligned && (set_direct(dst, 0) == -1
+                                     || pwrite_all(dst, direct_buf + aligned,
+                                                   n - aligned,
+                                                   off + aligned) == -1))
+            return -1;
+        off += n;
+        len -= n;
+    }
+    return 0;
+}   /* direct_extent */
+
+
+/* Copy src_fd into the empty dst_fd, reflinking it if possible and
+otherwise copying each data extent with copy. */
+static int copy_file (int src_fd, int dst_fd, const struct stat *src_sb,
+                      copy_report *report,
+                      int (*copy) (int, int, off_t, off_t, COPY_METHOD *))
+{
+    copy_report r;          // Report being filled in.
+    off_t size;             // Size of the source file.
+    off_t off;              // Start of the next region to scan.
+    off_t data, hole;       // Bounds of the next data extent.
+    int saved_errno;        // Refused methods must not leak into errno.
+
+    saved_errno = errno;
+    r.method = COPY_NONE;
+    r.bytes = r.holes = 0;
+    size = src_sb->st_size;
+
+    /* Fastest path: let the filesystem share the extents. */
+    if (size > 0 && ioctl(dst_fd, FICLONE, src_fd) == 0) {
+        r.method = COPY_REFLINK;
+        r.bytes = size;
+        goto done;
+    }
+
+    /* Walk the data extents of the source, skipping over holes. */
+    for (off = 0; off < size; off = hole) {
+        data = lseek(src_fd, off, SEEK_DATA);
+        if (data == -1 && errno == ENXIO)
+            break;                          // The rest of the file is a hole.
+        if (data == -1) {
+            data = off;                   // SEEK_DATA unsupported: no holes.
+            hole = size;
+        } else if ((hole = lseek(src_fd, data, SEEK_HOLE)) == -1) {
+            hole = size;
+        }
+        if (hole > size)
+            hole = size;
+        if (copy(src_fd, dst_fd, data, hole - data, &r.method) == -1)
+            goto fail;                                        // Exit on error.
+        r.bytes += hole - data;
+    }
+    r.holes = size - r.bytes;
+
+    /* Trailing holes are not written, so extend the file to its full size. */
+    if (r.holes > 0 && ftruncate(dst_fd, size) == -1)
+        goto fail;                                            // Exit on error.
+
+    done:
+    if (report != NULL)
+        *report = r;
+    errno = saved_errno;
+    return 0;
+
+    fail:
+    if (report != NULL)
+        *report = r;
+    return -1;
+}   /* copy_file */
+
+
+/* copy_data() copies the contents of src_fd into dst_fd, which must be an
+empty file open for writing. Reflinking is tried first. Otherwise only the
+data extents of the source are copied (found with SEEK_DATA/SEEK_HOLE), so
+holes in a sparse source stay holes in the destination. Fills in report (if
+not NULL) and returns 0 on success, or -1 with errno set on error; the
+report then names the method that failed. */
+int copy_data (int src_fd, int dst_fd, const struct stat *src_sb,
+               copy_report *report)
+{
+    return copy_file(src_fd, dst_fd, src_sb, report, copy_extent);
+}   /* copy_data */
+
+
+int copy_data_direct (int src_fd, int dst_fd, const struct stat *src_sb,
+                      copy_report *report)
+{
+    return copy_file(src_fd, dst_fd, src_sb, report, direct_extent);
+}   /* copy_data_direct */
+
+
+/* Write all of buf to fd, retrying short writes. */
+static int write_all (int fd, const char *buf, size_t len)
+{
+    ssize_t n;              // # Bytes written by the last call.
+
+    while (len > 0) {
+        n = write(fd, buf, len);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n == -1)
+            return -1;
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}   /* write_all */
+
+
+/* Write the source to out_fd by mapping it in windows of COPY_MMAP_WINDOW
+bytes, so a terminal receives few large writes and no copy is made into a
+user buffer. */
+static int stream_mmap (int src, int out, off_t size)
+{
+    off_t off;              // Offset of the current window.
+    size_t len;             // Length of the current window.
+    char *map;              // The current window.
+    int status;             // Result of writing the window.
+
+    for (off = 0; off < size; off += len) {
+        len = size - off > COPY_MMAP_WINDOW ? COPY_MMAP_WINDOW : size - off;
+        map = mmap(NULL, len, PROT_READ, MAP_SHARED, src, off);
+        if (map == MAP_FAILED)
+            return -1;
+        madvise(map, len, MADV_SEQUENTIAL);
+        status = write_all(out, map, len);
+        munmap(map, len);
+        if (status == -1)
+            return -1;
+    }
+    return 0;
+}   /* stream_mmap */
+
+
+/* Copy the rest of the regular file src_fd, which is size bytes long, to
+the regular file out_fd with backend, from and to their file offsets, and
+move both offsets past it. Returns the # bytes copied, or -1 with errno set
+(ENOSYS if the backend is unavailable and nothing was done). */
+static off_t stream_backend (int src_fd, int out_fd, off_t size,
+                             const io_backend *backend)
+{
+    off_t in_off, out_off;  // Where the copy starts in each file.
+    off_t n;                // # Bytes copied.
+
+    if ((in_off = lseek(src_fd, 0, SEEK_CUR)) == -1
+        || (out_off = lseek(out_fd, 0, SEEK_CUR)) == -1)
+        return -1;
+    n = backend->transfer(src_fd, in_off, out_fd, out_off,
+                          size > in_off ? size - in_off : 0);
+    if (n == -1 || lseek(src_fd, in_off + n, SEEK_SET) == -1
+        || lseek(out_fd, out_off + n, SEEK_SET) == -1)
+        return -1;
+    return n;
+}   /* stream_backend */
+
+
+/* stream_data() writes everything readable from src_fd to out_fd, which is
+usually stdout. The method is picked from the type of out_fd: io_uring
+between regular files large enough for io_backend_for() to pick it (several
+blocks in flight), sendfile(2) for other regular files and sockets,
+splice(2) for pipes, and mmap(2) for anything else (e.g. terminals) if the
+source is a regular file of known size; files that report no size (those
+of /proc) are read until EOF. When io_uring cannot be set up, sendfile is
+used instead; a sendfile between regular files that the kernel refuses
+falls back to the blocking I/O backend, and every other method to a
+read/write loop. Returns 0 on success, or -1 with errno set on error (and
+the report naming the method that failed). */
+int stream_data (int src_fd, int out_fd, copy_report *report)
+{
+    copy_report r;          // Report being filled in.
+    struct stat in_sb;      // Metadata of the source.
+    struct stat out_sb;     // Metadata of the destination.
+    size_t chunk;           // # Bytes requested in the next call.
+    ssize_t n;              // # Bytes moved by the last call.
+    off_t moved;            // # Bytes moved by an I/O backend.
+    int files;              // Both ends are regular files, at offsets.
+    int saved_errno;        // Refused methods must not leak into errno.
+
+    saved_errno = errno;
+    r.method = COPY_NONE;
+    r.bytes = r.holes = 0;
+    if (fstat(src_fd, &in_sb) == -1 || fstat(out_fd, &out_sb) == -1)
+        goto fail;                                            // Exit on error.
+
+    files = S_ISREG(in_sb.st_mode) && S_ISREG(out_sb.st_mode)
+            && !(fcntl(out_fd, F_GETFL) & O_APPEND);    // pwrite(2) appends.
+    if (S_ISFIFO(out_sb.st_mode))
+        r.method = COPY_SPLICE;
+    else if (files && io_backend_for(in_sb.st_size) == &uring_backend)
+        r.method = COPY_URING;
+    else if (S_ISREG(out_sb.st_mode) || S_ISSOCK(out_sb.st_mode))
+        r.method = COPY_SENDFILE;
+    else if (S_ISREG(in_sb.st_mode) && in_sb.st_size > 0)
+        r.method = COPY_MMAP;    // Not for files of no size, such as /proc's.
+    else
+        r.method = COPY_READWRITE;
+
+    /* Sources of unknown size (pipes, devices) are read until EOF. */
+    chunk = S_ISREG(in_sb.st_mode) ? COPY_MMAP_WINDOW : COPY_BUFSIZ;
+
+    if (r.method == COPY_MMAP) {
+        if (stream_mmap(src_fd, out_fd, in_sb.st_size) == 0) {
+            r.bytes = in_sb.st_size;
+            goto done;
+        }
+        if (errno != ENODEV && errno != EINVAL && errno != EACCES)
+            goto fail;                                        // Exit on error.
+        r.method = COPY_READWRITE;       // The file cannot be memory mapped.
+    }
+
+    if (r.method == COPY_URING) {
+        if ((moved = stream_backend(src_fd, out_fd, in_sb.st_size,
+                                    &uring_backend)) != -1) {
+            r.bytes = moved;
+            goto done;
+        }
+        if (errno != ENOSYS)
+            goto fail;                                        // Exit on error.
+        r.method = COPY_SENDFILE;           // io_uring could not be set up.
+    }
+
+    for (;;) {
+        switch (r.method) {
+            case COPY_SPLICE:
+                n = splice(src_fd, NULL, out_fd, NULL, chunk,
+                           SPLICE_F_MOVE | SPLICE_F_MORE);
+                break;
+            case COPY_SENDFILE:
+                n = sendfile(out_fd, src_fd, NULL, chunk);
+                break;
+            default:
+                if (copy_buf == NULL
+                    && (copy_buf = counted_malloc(COPY_BUFSIZ)) == NULL)
+                    goto fail;
+                n = read(src_fd, copy_buf, COPY_BUFSIZ);
+                if (n > 0 && write_all(out_fd, copy_buf, n) == -1)
+                    goto fail;
+                break;
+        }
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n == -1 && r.method == COPY_SENDFILE && files
+            && method_unsupported(errno)) {
+            /* Between regular files the copy can use explicit offsets. */
+            r.method = COPY_READWRITE;
+            if ((moved = stream_backend(src_fd, out_fd, in_sb.st_size,
+                                        &sync_backend)) == -1)
+                goto fail;                                    // Exit on error.
+            r.bytes += moved;
+            break;
+        }
+        if (n == -1 && r.method != COPY_READWRITE
+            && method_unsupported(errno)) {
+            r.method = COPY_READWRITE;
+            continue;
+        }
+        if (n == -1)
+            goto fail;                                        // Exit on error.
+        if (n == 0)
+            break;                                            // Reached EOF.
+        r.bytes += n;
+    }
+
+    done:
+    if (report != NULL)
+        *report = r;
+    errno = saved_errno;
+    return 0;
+
+    fail:
+    if (report != NULL)
+        *report = r;
+    return -1;
+}   /* stream_data */
+
+
+const char *copy_method_name (COPY_METHOD method)
+{
+    switch (method) {
+        case COPY_NONE:
+            return "none";
+        case COPY_REFLINK:
+            return "reflink";
+        case COPY_RANGE:
+            return "copy_file_range";
+        case COPY_SENDFILE:
+            return "sendfile";
+        case COPY_SPLICE:
+            return "splice";
+        case COPY_MMAP:
+            return "mmap";
+        case COPY_URING:
+            return "io_uring";
+        case COPY_READWRITE:
+            return "read/write";
+        case COPY_DIRECT:
+            return "pwrite";
+    }
+    return "unknown";
+}   /* copy_method_name */
+
+
+void copy_release (void)
+{
+    counted_free(copy_buf);
+    counted_free(direct_buf);
+    copy_buf = direct_buf = NULL;
+}   /* copy_release */
@@ -0,0 +1,63 @@
+/*
+ *  copy.h
+ *
+ *  Author: Joseph Erlinger
+ *      Created on: October 17, 2026
+ */
+#ifndef COPY_H
+#define COPY_H
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+
+/* The copy engine tries each method in order and falls through to the next
+one only when the kernel refuses the faster one. */
+typedef enum COPY_METHOD {
+    COPY_NONE,          // Nothing to copy (empty or all-hole source).
+    COPY_REFLINK,       // FICLONE: share extents, no data is moved.
+    COPY_RANGE,         // copy_file_range(2): in-kernel copy.
+    COPY_URING,         // io_uring: several reads and writes in flight.
+    COPY_SENDFILE,      // sendfile(2): in-kernel copy through the page cache.
+    COPY_SPLICE,        // splice(2): move page references into a pipe.
+    COPY_MMAP,          // mmap(2) the source and write(2) the mapping.
+    COPY_READWRITE,     // pread(2)/pwrite(2) through a large user buffer.
+    COPY_DIRECT         // pwrite(2) with O_DIRECT from an aligned buffer.
+} COPY_METHOD;
+
+
+typedef struct copy_report {
+    COPY_METHOD method;     // The slowest method that had to be used.
+    off_t bytes;            // # Bytes of data copied (holes excluded).
+    off_t holes;            // # Bytes skipped because they were holes.
+} copy_report;
+
+
+#define COPY_BUFSIZ (1 << 20)    // User-space buffer for the last fallback.
+#define COPY_MMAP_WINDOW (64 << 20)         // Largest mapping made at a time.
+#define COPY_DIRECT_ALIGN 4096  // O_DIRECT offset, length and buffer alignment.
+
+
+int copy_data (int src_fd, int dst_fd, const struct stat *src_sb,
+               copy_report *report);
+
+
+/* Like copy_data(), but the data is written to dst_fd with O_DIRECT from
+an aligned buffer, so a bulk copy neither fills the page cache nor leaves
+dirty pages for a later sync to write. The parts of an extent that are not
+COPY_DIRECT_ALIGN aligned go through the page cache, as does everything on a
+filesystem that refuses O_DIRECT. */
+int copy_data_direct (int src_fd, int dst_fd, const struct stat *src_sb,
+                      copy_report *report);
+
+
+int stream_data (int src_fd, int out_fd, copy_report *report);
+
+
+const char *copy_method_name (COPY_METHOD method);
+
+
+/* Free the calling thread's copy buffers, before the thread exits. */
+void copy_release (void);
+
+#endif  /* COPY_H */
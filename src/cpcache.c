@@ -0,0 +1,262 @@
+/*
+ *  cpcache.c
+ *
+ *  Author: Joseph Erlinger
+ *      Created on: October 17, 2026
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include "cpcache.h"
+#include "arena.h"
+#include "output.h"
+
+
+/* What a file looked like when it was written or last compared. */
+typedef struct file_id {
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+    struct timespec ctime;
+} file_id;
+
+
+typedef struct cpcache_entry {
+    file_id src, dst;
+    struct timespec verified;   // When a compare of the two started, or 0.
+    int used;
+} cpcache_entry;
+
+
+static cpcache_entry *table;
+static size_t nslots = CPCACHE_SLOTS;   // A power of two.
+static int disabled;
+static struct {
+    unsigned long hits;         // Copies skipped on the identities alone.
+    unsigned long compared;     // Copies skipped after comparing contents.
+    unsigned long misses;       // Copies made over an earlier copy's target.
+    unsigned long saved_bytes;  // Bytes not written by skipped copies.
+} counters;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;   // Guards it all.
+
+
+static void get_id (const struct stat *sb, file_id *id)
+{
+    memset(id, 0, sizeof(*id));             // The keys are compared whole.
+    id->dev = sb->st_dev;
+    id->ino = sb->st_ino;
+    id->size = sb->st_size;
+    id->mtime = sb->st_mtim;
+    id->ctime = sb->st_ctim;
+}   /* get_id */
+
+
+static int before (const struct timespec *a, const struct timespec *b)
+{
+    return a->tv_sec < b->tv_sec
+           || (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}   /* before */
+
+
+/* The slot of a pair of files. Called with the lock held. */
+static cpcache_entry *slot_of (const file_id *src, const file_id *dst)
+{
+    unsigned long h;
+
+    h = (unsigned long) src->ino * 0x9E3779B97F4A7C15UL;
+    h ^= (unsigned long) src->dev + ((unsigned long) dst->ino << 7);
+    h ^= (unsigned long) dst->dev * 0xC2B2AE3D27D4EB4FUL;
+    return &table[(h ^ (h >> 29)) & (nslots - 1)];
+}   /* slot_of */
+
+
+/* pread(2) len bytes at off into buf. Returns 0, or -1 on an error or if
+the file ends first. */
+static int read_at (int fd, char *buf, size_t len, off_t off)
+{
+    ssize_t n;
+
+    while (len > 0) {
+        n = pread(fd, buf, len, off);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        buf += n;
+        len -= n;
+        off += n;
+    }
+    return 0;
+}   /* read_at */
+
+
+/* Returns true if a and b hold the same size bytes. They are read into two
+buffers a window at a time, not mapped: a file truncated during the compare
+just ends early, where a mapping would raise SIGBUS. */
+static int same_contents (int a, int b, off_t size)
+{
+    char *buf;              // A window of a followed by one of b.
+    off_t off;
+    size_t len;
+    int same;
+
+    if ((buf = counted_malloc(2 * CPCACHE_WINDOW)) == NULL)
+        return 0;
+    for (same = 1, off = 0; same && off < size; off += len) {
+        len = size - off < CPCACHE_WINDOW ? size - off : CPCACHE_WINDOW;
+        same = read_at(a, buf, len, off) == 0
+               && read_at(b, buf + CPCACHE_WINDOW, len, off) == 0
+               && memcmp(buf, buf + CPCACHE_WINDOW, len) == 0;
+    }
+    counted_free(buf);
+    return same;
+}   /* same_contents */
+
+
+int cpcache_lookup (int src_fd, const struct stat *src_sb, int dirfd,
+                    const char *path, const struct stat *dst_sb)
+{
+    file_id src, dst;
+    cpcache_entry *e;
+    struct timespec now;    // Changes from here on get a ctime >= now.
+    int found, trusted;
+    int fd;
+
+    if (!S_ISREG(dst_sb->st_mode))
+        return 0;
+    get_id(src_sb, &src);
+    get_id(dst_sb, &dst);
+    pthread_mutex_lock(&lock);
+    found = trusted = 0;
+    if (table != NULL && !disabled) {
+        e = slot_of(&src, &dst);
+        found = e->used && memcmp(&e->src, &src, sizeof(src)) == 0
+                && memcmp(&e->dst, &dst, sizeof(dst)) == 0;
+        trusted = found && before(&src.ctime, &e->verified)
+                  && before(&dst.ctime, &e->verified);
+    }
+    if (trusted) {
+        counters.hits++;
+        counters.saved_bytes += src.size;
+    } else if (!found && !disabled) {
+        counters.misses++;
+    }
+    pthread_mutex_unlock(&lock);
+    if (trusted || !found)
+        return trusted;
+
+    /* Copied too recently to tell a later change apart by its ctime. */
+    clock_gettime(CLOCK_REALTIME_COARSE, &now);
+    if ((fd = openat(dirfd, path, O_RDONLY | O_CLOEXEC)) == -1)
+        found = 0;
+    else {
+        found = same_contents(src_fd, fd, src.size);
+        close(fd);
+    }
+    pthread_mutex_lock(&lock);
+    if (found) {
+        counters.compared++;
+        counters.saved_bytes += src.size;
+        if (table != NULL && (e = slot_of(&src, &dst))->used
+            && memcmp(&e->src, &src, sizeof(src)) == 0
+            && memcmp(&e->dst, &dst, sizeof(dst)) == 0)
+            e->verified = now;
+    } else {
+        counters.misses++;
+    }
+    pthread_mutex_unlock(&lock);
+    return found;
+}   /* cpcache_lookup */
+
+
+void cpcache_record (const struct stat *src_sb, int dst_fd)
+{
+    struct stat sb;
+    file_id src, dst;
+    cpcache_entry *e;
+
+    if (fstat(dst_fd, &sb) == -1)
+        return;
+    get_id(src_sb, &src);
+    get_id(&sb, &dst);
+    pthread_mutex_lock(&lock);
+    if (table == NULL && !disabled)
+        table = counted_calloc(nslots, sizeof(*table));  // Resident as used.
+    if (table != NULL) {
+        e = slot_of(&src, &dst);
+        e->src = src;
+        e->dst = dst;
+        e->verified.tv_sec = e->verified.tv_nsec = 0;     // Not compared yet.
+        e->used = 1;
+    }
+    pthread_mutex_unlock(&lock);
+}   /* cpcache_record */
+
+
+void cpcache_clear (void)
+{
+    pthread_mutex_lock(&lock);
+    counted_free(table);
+    table = NULL;
+    pthread_mutex_unlock(&lock);
+}   /* cpcache_clear */
+
+
+static void print_counters (void)
+{
+    char text[256];
+    size_t used;
+    size_t i;
+    int len;
+
+    pthread_mutex_lock(&lock);
+    for (used = i = 0; table != NULL && i < nslots; i++)
+        used += table[i].used;
+    len = snprintf(text, sizeof(text), "cpcache %s: %zu/%zu slots, "
+                   "%lu hits, %lu compared, %lu misses, %lu bytes saved\n",
+                   disabled ? "off" : "on", used, nslots, counters.hits,
+                   counters.compared, counters.misses, counters.saved_bytes);
+    pthread_mutex_unlock(&lock);
+    out_write(text, len);
+}   /* print_counters */
+
+
+cmd_result copyCache (char **args, int count)
+{
+    unsigned long n;
+    char *end;
+
+    if (count > 1)
+        return CMD_USAGE;
+    if (count == 0) {
+        print_counters();
+    } else if (strcmp(args[0], "on") == 0 || strcmp(args[0], "off") == 0) {
+        pthread_mutex_lock(&lock);
+        disabled = args[0][1] == 'f';
+        pthread_mutex_unlock(&lock);
+        if (args[0][1] == 'f')
+            cpcache_clear();
+    } else if (strcmp(args[0], "clear") == 0) {
+        cpcache_clear();
+        pthread_mutex_lock(&lock);
+        memset(&counters, 0, sizeof(counters));
+        pthread_mutex_unlock(&lock);
+    } else {
+        n = strtoul(args[0], &end, 10);
+        if (*end != '\0' || n == 0 || n > (1UL << 24))
+            return CMD_USAGE;
+        cpcache_clear();
+        pthread_mutex_lock(&lock);
+        for (nslots = 1; nslots < n; nslots *= 2)
+            ;
+        pthread_mutex_unlock(&lock);
+    }
+    return CMD_OK;
+}   /* copyCache */
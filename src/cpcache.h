@@ -0,0 +1,56 @@
+/*
+ *  cpcache.h
+ *
+ *  Author: Joseph Erlinger
+ *      Created on: October 17, 2026
+ */
+#ifndef CPCACHE_H
+#define CPCACHE_H
+
+#include <sys/stat.h>
+#include "command.h"
+
+
+#define CPCACHE_SLOTS 1024      // Default size of the cache (a power of two).
+#define CPCACHE_WINDOW (64 << 10)   // Bytes compared per pread(2).
+
+
+/* Remembers which files cp wrote and from what, so that copying a source
+onto a destination that still holds an earlier copy of it skips the copy.
+Both files are identified by (dev, ino, size, mtime, ctime). ctime cannot
+be set by hand and moves on every write, chmod, or replacement of the file,
+so an identity that still matches means an unchanged file.
+
+The kernel stamps ctime with a clock tick of a few milliseconds, though, so
+a change made in the same tick as the copy keeps its old ctime. An entry is
+therefore trusted on its identity alone only once both ctimes are older
+than a moment at which the two files were seen to be equal. The first
+repeat after a copy compares the contents (reading both files, writing
+nothing), and marks the entry with the time it started comparing. Later
+repeats cost two stat(2)s.
+
+The cache is direct mapped: a pair of files has one slot, and a new copy
+replaces whatever was in it, so its size is fixed. Safe to call from any
+thread. */
+
+
+/* Returns 1 if dst (path, relative to dirfd, with metadata dst_sb) already
+holds a copy of the source src_fd made by an earlier cp, so nothing needs
+to be copied; 0 if it must be copied. */
+int cpcache_lookup (int src_fd, const struct stat *src_sb, int dirfd,
+                    const char *path, const struct stat *dst_sb);
+
+
+/* Remember that dst_fd now holds a complete copy of the source. */
+void cpcache_record (const struct stat *src_sb, int dst_fd);
+
+
+/* Free the cache. */
+void cpcache_clear (void);
+
+
+/* cpcache: print the hit and miss counters. cpcache on|off|clear enables,
+disables or empties the cache, and cpcache <slots> resizes it. */
+cmd_result copyCache (char **args, int count);
+
+#endif  /* CPCACHE_H */
@@ -0,0 +1,110 @@
+/*
+ *  dirlist.c
+ *
+ *  Author: Joseph Erlinger
+ *      Created on: October 17, 2026
+ */
+#define _GNU_SOURCE
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+#include <sys/syscall.h>
+#include "dirlist.h"
+
+
+#define INSERTION_SORT_MAX 32   // Buckets this small are insertion sorted.
+
+
+/* The record format returned by getdents64(2). */
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+
+void dirlist_init (dirlist *d, int fd, char *buf, size_t size)
+{
+    d->fd = fd;
+    d->buf = buf;
+    d->size = size;
+    d->len = d->pos = 0;
+    d->error = 0;
+}   /* dirlist_init */
+
+
+const char *dirlist_next (dirlist *d, unsigned char *type)
+{
+    struct linux_dirent64 *ent;     // The next record.
+    long n;                         // # Bytes returned by getdents64.
+
+    if (d->pos >= d->len) {
+        do {
+            n = syscall(SYS_getdents64, d->fd, d->buf, d->size);
+        } while (n == -1 && errno == EINTR);
+        if (n == -1)
+            d->error = errno;
+        if (n <= 0)
+            return NULL;                         // End of directory or error.
+        d->len = n;
+        d->pos = 0;
+    }
+    ent = (struct linux_dirent64 *) (d->buf + d->pos);
+    d->pos += ent->d_reclen;
+    *type = ent->d_type;
+    return ent->d_name;
+}   /* dirlist_next */
+
+
+static void insertion_sort (char **a, size_t n, size_t depth)
+{
+    size_t i, j;
+    char *key;
+
+    for (i = 1; i < n; i++) {
+        key = a[i];
+        for (j = i; j > 0 && strcmp(a[j-1] + depth, key + depth) > 0; j--)
+            a[j] = a[j-1];
+        a[j] = key;
+    }
+}   /* insertion_sort */
+
+
+/* Distribute a[0..n) into 256 buckets by the byte at depth (strings that
+end there come first and are done), then sort each bucket on the next
+byte. Every name is looked at once per level rather than once per
+comparison. */
+static void radix_sort (char **a, char **aux, size_t n, size_t depth)
+{
+    size_t count[257];      // Start of each bucket; bucket 0 = end of string.
+    size_t i;
+    unsigned char c;
+
+    if (n <= INSERTION_SORT_MAX) {
+        insertion_sort(a, n, depth);
+        return;
+    }
+    memset(count, 0, sizeof(count));
+    for (i = 0; i < n; i++)
+        count[(unsigned char) a[i][depth]]++;
+    for (i = 1; i < 257; i++)                       // Counts to end offsets.
+        count[i] += count[i-1];
+    for (i = n; i-- > 0;) {
+        c = a[i][depth];
+        aux[--count[c]] = a[i];
+    }
+    memcpy(a, aux, n * sizeof(char *));
+    count[256] = n;
+    for (i = 1; i < 256; i++)            // Bucket 0 is already fully sorted.
+        if (count[i+1] - count[i] > 1)
+            radix_sort(a + count[i], aux, count[i+1] - count[i], depth + 1);
+}   /* radix_sort */
+
+
+void sort_names (char **names, char **aux, size_t n)
+{
+    radix_sort(names, aux, n, 0);
+}   /* sort_names */
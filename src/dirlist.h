@@ -0,0 +1,43 @@
+/*
+ *  dirlist.h
+ *
+ *  Author: Joseph Erlinger
+ *      Created on: October 17, 2026
+ */
+#ifndef DIRLIST_H
+#define DIRLIST_H
+
+#include <stddef.h>
+
+
+#define DIRLIST_BUFSIZ (256 << 10)  // Bytes of entries fetched per syscall.
+
+
+/* Reads a directory with getdents64(2), many entries per call, without the
+per-entry bookkeeping of readdir(3). */
+typedef struct dirlist {
+    int fd;                 // The open directory.
+    char *buf;              // Raw linux_dirent64 records.
+    size_t size;            // Capacity of buf.
+    size_t len;             // # Bytes of records in buf.
+    size_t pos;             // Offset of the next record in buf.
+    int error;              // errno of a failed getdents64(2), or 0.
+} dirlist;
+
+
+/* Start reading the open directory fd using buf, which holds size bytes
+(DIRLIST_BUFSIZ unless many directories are read at once). */
+void dirlist_init (dirlist *d, int fd, char *buf, size_t size);
+
+
+/* Returns the name of the next entry, NULL at the end of the directory,
+or NULL with errno and d->error set on error. *type receives the DT_* type
+(DT_UNKNOWN if the filesystem does not report it). */
+const char *dirlist_next (dirlist *d, unsigned char *type);
+
+
+/* Sort n strings in byte order with an MSD radix sort. aux must have room
+for n pointers. */
+void sort_names (char **names, char **aux, size_t n);
+
+#endif  /* DIRLIST_H */
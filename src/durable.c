@@ -0,0 +1,529 @@
+/*
+ *  durable.c
+ *
+ *  Author: Joseph Erlinger
+ *      Created on: October 17, 2026
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include "durable.h"
+#include "arena.h"
+#include "output.h"
+#include "uring.h"
+
+
+/* A sync waiting for the next commit. */
+typedef struct deferred {
+    int fd;                 // Our own descriptor, closed by the commit.
+    int is_dir;             // fsync(2) it rather than fdatasync(2).
+    dev_t dev;              // Identity of a directory, which is synced
+    ino_t ino;              //   once per group.
+    char *temp;             // A temporary file to rename over target once
+    char *target;           //   it is synced (one allocation), or NULL.
+    int dirfd;              // Our own descriptor temp and target are
+                            //   relative to, or AT_FDCWD.
+} deferred;
+
+
+static const char *const level_names[] = { "none", "data", "direct",
+                                           "atomic" };
+
+static int level;                   // A DURABILITY.
+static deferred group[DURABLE_GROUP_MAX];
+static int group_size;
+static int group_renames;           // # Entries of the group with a temp.
+static int forced_error;            // errno of the first failed commit that
+static const char *forced_call;     //   a full group forced and its call,
+                                    //   or 0 and NULL.
+static struct {
+    unsigned long commits;  // Groups synced.
+    unsigned long files;    // Files synced in them.
+    unsigned long dirs;     // Directories synced in them.
+    unsigned long temps;    // Temporary files renamed over their target.
+} counters;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;   // Guards it all.
+static pthread_mutex_t commit_lock = PTHREAD_MUTEX_INITIALIZER;   // A commit
+                            //   returns only once earlier ones are done.
+
+static char *output_temp;           // Temporary name of OUTPUT_FILE, or NULL.
+
+
+DURABILITY durable_level (void)
+{
+    return __atomic_load_n(&level, __ATOMIC_RELAXED);
+}   /* durable_level */
+
+
+int durable_set_level (const char *name)
+{
+    int i;
+
+    for (i = 0; i <= DURABLE_ATOMIC; i++)
+        if (strcmp(name, level_names[i]) == 0) {
+            __atomic_store_n(&level, i, __ATOMIC_RELAXED);
+            return 0;
+        }
+    return -1;
+}   /* durable_set_level */
+
+
+int make_temp (int dirfd, char *tmpl, int directory, mode_t mode)
+{
+    static const char letters[] =
+        "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+    static unsigned long counter;       // Shared by all threads; any value
+                                        //   works, so races are harmless.
+    unsigned long r;                    // Source of the next name.
+    char *x;                            // The XXXXXX of tmpl.
+    int attempt, i, fd;
+
+    x = tmpl + strlen(tmpl) - 6;
+    for (attempt = 0; attempt < 100; attempt++) {
+        r = __atomic_add_fetch(&counter, 7919, __ATOMIC_RELAXED)
+            ^ ((unsigned long) getpid() << 20) ^ (unsigned long) &r;
+        for (i = 0; i < 6; i++, r /= sizeof(letters) - 1)
+            x[i] = letters[r % (sizeof(letters) - 1)];
+        if (directory)
+            fd = mkdirat(dirfd, tmpl, mode);
+        else
+            fd = openat(dirfd, tmpl, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC,
+                        mode);
+        if (fd != -1 || errno != EEXIST)
+            return fd;
+    }
+    return -1;                                      // errno is still EEXIST.
+}   /* make_temp */
+
+
+/* "dir/.name.XXXXXX" for the target "dir/name", from the line arena. */
+static char *temp_path (const char *target)
+{
+    const char *base;
+    char *tmpl;
+
+    base = strrchr(target, '/');
+    base = base != NULL ? base + 1 : target;
+    tmpl = arena_alloc(&line_arena, strlen(target) + 10);
+    if (tmpl != NULL)
+        sprintf(tmpl, "%.*s.%s.XXXXXX", (int) (base - target), target, base);
+    return tmpl;
+}   /* temp_path */
+
+
+static const char *commit_group (void);
+
+
+/* Take e (whose descriptors are owned by the group from now on) into the
+group. A directory is only added once. */
+static void defer_entry (const deferred *e)
+{
+    const char *call;
+    int i;
+
+    pthread_mutex_lock(&lock);
+    while (group_size == DURABLE_GROUP_MAX) {
+        pthread_mutex_unlock(&lock);
+        call = commit_group();      // Reported by the next durable_commit().
+        pthread_mutex_lock(&lock);
+        if (call != NULL && forced_call == NULL) {
+            forced_error = errno;
+            forced_call = call;
+        }
+    }
+    for (i = 0; e->is_dir && i < group_size; i++)
+        if (group[i].is_dir && group[i].dev == e->dev
+            && group[i].ino == e->ino)
+            break;
+    if (e->is_dir && i < group_size) {
+        pthread_mutex_unlock(&lock);
+        close(e->fd);               // The directory is in the group already.
+        return;
+    }
+    group[group_size++] = *e;
+    group_renames += e->temp != NULL;
+    pthread_mutex_unlock(&lock);
+}   /* defer_entry */
+
+
+/* Take fd (owned by the group from now on) into the group. */
+static int defer_fd (int fd, int is_dir)
+{
+    struct stat sb;
+    deferred e;
+
+    if (is_dir && fstat(fd, &sb) == -1) {
+        close(fd);
+        return -1;
+    }
+    e.fd = fd;
+    e.is_dir = is_dir;
+    e.dev = is_dir ? sb.st_dev : 0;
+    e.ino = is_dir ? sb.st_ino : 0;
+    e.temp = e.target = NULL;
+    e.dirfd = AT_FDCWD;
+    defer_entry(&e);
+    return 0;
+}   /* defer_fd */
+
+
+/* Queue the rename of temp over target (relative to dirfd) behind the sync
+of fd, the temporary file. The group gets copies of all three. Returns
+NULL, or the name of the call that failed with errno set. */
+static const char *defer_rename (int fd, int dirfd, const char *temp,
+                                 const char *target)
+{
+    size_t temp_len;
+    deferred e;
+    int saved_errno;
+
+    temp_len = strlen(temp) + 1;
+    if ((e.temp = counted_malloc(temp_len + strlen(target) + 1)) == NULL)
+        return "malloc";
+    e.target = strcpy(e.temp + temp_len, target);
+    memcpy(e.temp, temp, temp_len);
+    if ((e.fd = fcntl(fd, F_DUPFD_CLOEXEC, 0)) == -1) {
+        counted_free(e.temp);
+        return "fcntl";
+    }
+    e.dirfd = dirfd;
+    if (dirfd != AT_FDCWD
+        && (e.dirfd = fcntl(dirfd, F_DUPFD_CLOEXEC, 0)) == -1) {
+        saved_errno = errno;
+        close(e.fd);
+        counted_free(e.temp);
+        errno = saved_errno;
+        return "fcntl";
+    }
+    e.is_dir = 0;
+    e.dev = 0;
+    e.ino = 0;
+    defer_entry(&e);
+    return NULL;
+}   /* defer_rename */
+
+
+int durable_defer (int fd, int is_dir)
+{
+    int copy;
+
+    if ((copy = fcntl(fd, F_DUPFD_CLOEXEC, 0)) == -1)
+        return -1;
+    return defer_fd(copy, is_dir);
+}   /* durable_defer */
+
+
+/* Sync the directories of g (if dirs is set) or its files as one batch,
+and set errors[i] to the errno of the sync of g[i], or 0. */
+static int sync_group (const deferred *g, int n, int dirs, int *errors)
+{
+    int fds[DURABLE_GROUP_MAX];
+    int datasync[DURABLE_GROUP_MAX];
+    int results[DURABLE_GROUP_MAX];
+    int index[DURABLE_GROUP_MAX];   // Which entry of g fds[i] is.
+    int m, i;
+    int error;
+
+    for (m = i = 0; i < n; i++) {
+        errors[i] = 0;
+        if (g[i].is_dir == dirs) {
+            index[m] = i;
+            fds[m] = g[i].fd;
+            datasync[m++] = !dirs;
+        }
+    }
+    if (m == 0)
+        return 0;
+    if (uring_sync(fds, datasync, results, m) == -1
+        && (errno == ENOSYS || errno == EINVAL)) {
+        /* Start writing every file back before waiting for any of them. */
+        for (i = 0; !dirs && i < m; i++)
+            sync_file_range(fds[i], 0, 0, SYNC_FILE_RANGE_WRITE);
+        for (i = 0; i < m; i++)
+            results[i] = (dirs ? fsync(fds[i]) : fdatasync(fds[i])) == -1
+                         ? errno : 0;
+    }
+    for (error = 0, i = 0; i < m; i++) {
+        errors[index[i]] = results[i];
+        if (error == 0)
+            error = results[i];
+    }
+    errno = error;
+    return error == 0 ? 0 : -1;
+}   /* sync_group */
+
+
+/* Put the temporary file of e in place unless its sync failed with error,
+in which case (or if the rename fails) it is removed. Either way the group
+is done with it. Returns 0 if it was renamed, or -1 with errno set. */
+static int rename_entry (const deferred *e, int error)
+{
+    int status;
+
+    status = 0;
+    if (error != 0
+        || renameat(e->dirfd, e->temp, e->dirfd, e->target) == -1) {
+        if (error == 0)
+            error = errno;
+        unlinkat(e->dirfd, e->temp, 0);
+        errno = error;
+        status = -1;
+    }
+    if (e->dirfd != AT_FDCWD)
+        close(e->dirfd);
+    counted_free(e->temp);
+    return status;
+}   /* rename_entry */
+
+
+/* Commit the group as it is now: sync every file in one batch, rename the
+temporary files that synced over their targets, then sync the directories
+in a second batch, so the renames into them are durable too. Returns NULL,
+or the name of the first call that failed with errno set. */
+static const char *commit_group (void)
+{
+    deferred batch[DURABLE_GROUP_MAX];
+    int errors[DURABLE_GROUP_MAX];
+    const char *call;       // The first call that failed, or NULL.
+    int error;              // Its errno.
+    int n, i, dirs, renamed;
+
+    pthread_mutex_lock(&commit_lock);
+    pthread_mutex_lock(&lock);
+    n = group_size;
+    memcpy(batch, group, n * sizeof(deferred));
+    group_size = 0;
+    group_renames = 0;
+    pthread_mutex_unlock(&lock);
+    if (n == 0) {
+        pthread_mutex_unlock(&commit_lock);
+        return NULL;
+    }
+
+    call = NULL;
+    error = 0;
+    if (sync_group(batch, n, 0, errors) == -1) {
+        call = "fdatasync";
+        error = errno;
+    }
+    for (renamed = 0, i = 0; i < n; i++) {
+        if (batch[i].temp == NULL)
+            continue;
+        if (rename_entry(&batch[i], errors[i]) == 0)
+            renamed++;
+        else if (call == NULL) {
+            call = "renameat";
+            error = errno;
+        }
+    }
+    if (sync_group(batch, n, 1, errors) == -1 && call == NULL) {
+        call = "fsync";
+        error = errno;
+    }
+    for (dirs = 0, i = 0; i < n; i++) {
+        dirs += batch[i].is_dir;
+        close(batch[i].fd);
+    }
+    pthread_mutex_lock(&lock);
+    counters.commits++;
+    counters.files += n - dirs;
+    counters.dirs += dirs;
+    counters.temps += renamed;
+    pthread_mutex_unlock(&lock);
+    pthread_mutex_unlock(&commit_lock);
+    errno = error;
+    return call;
+}   /* commit_group */
+
+
+const char *durable_commit (void)
+{
+    const char *call;
+
+    call = commit_group();
+    pthread_mutex_lock(&lock);
+    if (forced_call != NULL) {
+        call = forced_call;
+        errno = forced_error;
+        forced_call = NULL;
+        forced_error = 0;
+    }
+    pthread_mutex_unlock(&lock);
+    return call;
+}   /* durable_commit */
+
+
+const char *durable_publish (void)
+{
+    int pending;
+
+    pthread_mutex_lock(&lock);
+    pending = group_renames;
+    pthread_mutex_unlock(&lock);
+    return pending > 0 ? durable_commit() : NULL;
+}   /* durable_publish */
+
+
+int durable_create (int dirfd, const char *target, mode_t mode, char **temp)
+{
+    *temp = NULL;
+    if (durable_level() == DURABLE_ATOMIC) {
+        if ((*temp = temp_path(target)) == NULL) {
+            errno = ENOMEM;
+            return -1;
+        }
+        return make_temp(dirfd, *temp, 0, mode);
+    }
+    return openat(dirfd, target, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC
+                  | O_NOFOLLOW, mode);
+}   /* durable_create */
+
+
+int durable_copy (int src_fd, int dst_fd, const struct stat *src_sb,
+                  copy_report *report)
+{
+    if (durable_level() == DURABLE_DIRECT)
+        return copy_data_direct(src_fd, dst_fd, src_sb, report);
+    return copy_data(src_fd, dst_fd, src_sb, report);
+}   /* durable_copy */
+
+
+/* Defer the sync of the directory path is in, relative to dirfd. */
+static int defer_parent (int dirfd, const char *path)
+{
+    const char *slash;
+    char *dir;
+    int fd;
+
+    if ((slash = strrchr(path, '/')) == NULL)
+        dir = ".";
+    else if (slash == path)
+        dir = "/";
+    else if ((dir = arena_alloc(&line_arena, slash - path + 1)) == NULL) {
+        errno = ENOMEM;
+        return -1;
+    } else {
+        memcpy(dir, path, slash - path);
+        dir[slash - path] = '\0';
+    }
+    if ((fd = openat(dirfd, dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1)
+        return -1;
+    return defer_fd(fd, 1);
+}   /* defer_parent */
+
+
+const char *durable_finish (int fd, int dirfd, const char *target,
+                            const char *temp)
+{
+    const char *call;
+
+    if (temp == NULL) {
+        if (durable_level() != DURABLE_NONE && durable_defer(fd, 0) == -1)
+            return "fcntl";
+        return NULL;
+    }
+    if ((call = defer_rename(fd, dirfd, temp, target)) != NULL) {
+        durable_abort(dirfd, temp);
+        return call;
+    }
+    return defer_parent(dirfd, target) == -1 ? "openat" : NULL;
+}   /* durable_finish */
+
+
+void durable_abort (int dirfd, const char *temp)
+{
+    int saved_errno;
+
+    if (temp == NULL)
+        return;
+    saved_errno = errno;
+    unlinkat(dirfd, temp, 0);
+    errno = saved_errno;
+}   /* durable_abort */
+
+
+int durable_output_open (void)
+{
+    char tmpl[] = "." OUTPUT_FILE ".XXXXXX";
+    int fd;
+
+    if (durable_level() == DURABLE_ATOMIC) {
+        fd = make_temp(AT_FDCWD, tmpl, 0, 0666);
+        if (fd != -1 && (output_temp = strdup(tmpl)) == NULL) {
+            close(fd);
+            unlink(tmpl);
+            errno = ENOMEM;
+            return -1;
+        }
+    } else {
+        fd = open(OUTPUT_FILE, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                  0666);
+    }
+    if (fd == -1)
+        return -1;
+    if (dup2(fd, STDOUT_FILENO) == -1) {
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    return 0;
+}   /* durable_output_open */
+
+
+int durable_output_close (void)
+{
+    int status;
+    int fd;
+
+    status = 0;
+    if (durable_level() != DURABLE_NONE || output_temp != NULL)
+        status = fdatasync(STDOUT_FILENO);
+    if (output_temp != NULL) {
+        if (status == 0 && rename(output_temp, OUTPUT_FILE) == -1)
+            status = -1;
+        if (status == 0 && (fd = open(".", O_RDONLY | O_DIRECTORY
+                                      | O_CLOEXEC)) != -1) {
+            status = fsync(fd);
+            close(fd);
+        }
+        if (status == -1)
+            unlink(output_temp);
+        free(output_temp);
+        output_temp = NULL;
+    }
+    return status;
+}   /* durable_output_close */
+
+
+static void print_counters (void)
+{
+    char text[256];
+    int len;
+
+    pthread_mutex_lock(&lock);
+    len = snprintf(text, sizeof(text), "durability %s: %lu commits, "
+                   "%lu files, %lu directories, %lu pending, "
+                   "%lu atomic replacements\n",
+                   level_names[durable_level()], counters.commits,
+                   counters.files, counters.dirs,
+                   (unsigned long) group_size, counters.temps);
+    pthread_mutex_unlock(&lock);
+    out_write(text, len);
+}   /* print_counters */
+
+
+cmd_result durability (char **args, int count)
+{
+    if (count > 1)
+        return CMD_USAGE;
+    if (count == 0)
+        print_counters();
+    else if (durable_set_level(args[0]) == -1)
+        return CMD_USAGE;
+    return CMD_OK;
+}   /* durability */
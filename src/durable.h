@@ -0,0 +1,120 @@
+/*
+ *  durable.h
+ *
+ *  Author: Joseph Erlinger
+ *      Created on: October 17, 2026
+ */
+#ifndef DURABLE_H
+#define DURABLE_H
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "command.h"
+#include "copy.h"
+
+
+/* How hard cp (and output.txt in file mode) works to get what it wrote
+onto stable storage. */
+typedef enum DURABILITY {
+    DURABLE_NONE,       // Leave it to the kernel's writeback (the default).
+    DURABLE_DATA,       // fdatasync(2) each file by the end of the line.
+    DURABLE_DIRECT,     // DURABLE_DATA, writing the data with O_DIRECT.
+    DURABLE_ATOMIC      // Write a temporary file, sync it, rename(2) it over
+                        //   the target, and sync the directory by the end
+                        //   of the command: a crash leaves the old file or
+                        //   the new one, never neither.
+} DURABILITY;
+
+
+#define DURABLE_GROUP_MAX 256       // Deferred syncs that force a commit.
+#define OUTPUT_FILE "output.txt"    // Where file mode writes its output.
+
+
+/* The syncs a level asks for are not made file by file. They are deferred
+to a group that is committed at the end of each line (and when it fills
+up), with every sync of the group in one io_uring submission, so the
+filesystem can fold them into one journal commit and the line waits for
+the device once. Without io_uring, writeback of every file is started
+before any of them is waited for. DURABLE_ATOMIC's temporary files are
+synced in the same submission, and only then renamed over their targets;
+the directories go in a second submission after the renames, each once per
+group however many files were renamed into it. So that a copy is in place
+before the next command looks for it, a group holding renames is committed
+at the end of the command rather than of the line. */
+
+
+DURABILITY durable_level (void);
+
+
+/* Set the level from its name ("none", "data", "direct" or "atomic").
+Returns 0, or -1 if there is no such level. */
+int durable_set_level (const char *name);
+
+
+/* Create the file cp writes target (relative to dirfd) as, with mode. At
+DURABLE_ATOMIC this is a new temporary file next to target, whose name is
+put in *temp; otherwise it is target itself, truncated (a symbolic link
+there is not followed), and *temp is NULL. Returns the descriptor, or -1
+with errno set. */
+int durable_create (int dirfd, const char *target, mode_t mode,
+                    char **temp);
+
+
+/* mkstemp(3) and mkdtemp(3) relative to dirfd: replace the trailing XXXXXX
+of tmpl and create a file (returning its descriptor) or a directory
+(returning 0) of that name with mode. Returns -1 with errno set on
+error. */
+int make_temp (int dirfd, char *tmpl, int directory, mode_t mode);
+
+
+/* Copy src_fd into dst_fd with the method of the current level. */
+int durable_copy (int src_fd, int dst_fd, const struct stat *src_sb,
+                  copy_report *report);
+
+
+/* Make the file fd, written as durable_create() asked, durable as the
+level asks: defer its sync, or at DURABLE_ATOMIC queue its sync and the
+rename of temp over target, and defer the sync of the directory. Returns
+NULL, or the name of the call that failed with errno set (the temporary
+file is then removed). A sync or rename that fails in the commit is
+reported by it, and the temporary file is removed there. */
+const char *durable_finish (int fd, int dirfd, const char *target,
+                            const char *temp);
+
+
+/* Remove the temporary file of a copy that failed, if there is one. */
+void durable_abort (int dirfd, const char *temp);
+
+
+/* Sync fd (a directory if is_dir) with the next commit. fd is duplicated,
+so the caller still closes its own. Returns 0, or -1 with errno set. */
+int durable_defer (int fd, int is_dir);
+
+
+/* Sync everything deferred, as one group. Returns NULL, or the name of the
+first call that failed with errno set, here or in a commit forced since
+the last one by a full group. */
+const char *durable_commit (void);
+
+
+/* Commit the group if it holds a rename queued by durable_finish(), so
+every copy made so far is in place. Called after each command. Returns
+like durable_commit(). */
+const char *durable_publish (void);
+
+
+/* Point stdout at OUTPUT_FILE, through a temporary file at DURABLE_ATOMIC.
+Returns 0, or -1 with errno set. */
+int durable_output_open (void);
+
+
+/* Sync the file stdout was pointed at (unless the level is DURABLE_NONE)
+and put it in place. Returns 0, or -1 with errno set. */
+int durable_output_close (void);
+
+
+/* durability: print the level and the commit counters. durability <level>
+sets the level. */
+cmd_result durability (char **args, int count);
+
+#endif  /* DURABLE_H */
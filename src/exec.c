@@ -0,0 +1,246 @@
+/*
+ *  exec.c
+ *
+ *  Author: Joseph Erlinger
+ *      Created on: October 17, 2026
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <pthread.h>
+#include <sys/wait.h>
+#include "exec.h"
+#include "cli.h"
+#include "arena.h"
+#include "output.h"
+#include "session.h"
+#include "pathcache.h"
+
+
+/* One command of a pipeline. */
+typedef struct stage {
+    char **argv;            // NULL terminated, inside the line's tokens.
+    int argc;
+    const builtin *b;       // NULL for a program.
+    pid_t pid;              // The program's process, or -1.
+    int in, out;            // Its ends of the pipes, or -1 for the shell's.
+    int status;             // Exit status, once known.
+} stage;
+
+
+static int is_pipe (const char *token)
+{
+    return token[0] == '|' && token[1] == '\0';
+}   /* is_pipe */
+
+
+int is_pipeline (char **tokens)
+{
+    for (; *tokens != NULL; tokens++)
+        if (is_pipe(*tokens))
+            return 1;
+    return 0;
+}   /* is_pipeline */
+
+
+static posix_spawnattr_t attr;          // The same for every child.
+static pthread_once_t attr_once = PTHREAD_ONCE_INIT;
+
+
+/* The shell ignores SIGPIPE; children get the default back. */
+static void init_attr (void)
+{
+    sigset_t defaults;      // Signals reset to SIG_DFL in the child.
+
+    posix_spawnattr_init(&attr);
+    sigemptyset(&defaults);
+    sigaddset(&defaults, SIGPIPE);
+    posix_spawnattr_setsigdefault(&attr, &defaults);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGDEF);
+}   /* init_attr */
+
+
+/* Start the program of s. posix_spawn(3) creates the child with
+CLONE_VM | CLONE_VFORK, so the shell's page tables are never copied, and the
+file actions give the child its pipe ends and the session's directory. The
+last command writes to the descriptor of the thread's output, which is a
+job's buffer file inside a background job. Returns 0, or an errno value. */
+static int spawn_stage (stage *s)
+{
+    posix_spawn_file_actions_t actions;
+    const char *path;       // The file to execute.
+    int out;                // Descriptor for the child's stdout.
+    int err, retried;
+
+    pthread_once(&attr_once, init_attr);
+    if ((path = pathcache_lookup(s->argv[0])) == NULL)
+        return errno;
+    if ((err = posix_spawn_file_actions_init(&actions)) != 0)
+        return err;
+    out = s->out != -1 ? s->out : out_fileno();
+    if (s->in != -1)
+        err = posix_spawn_file_actions_adddup2(&actions, s->in, STDIN_FILENO);
+    if (err == 0 && out != STDOUT_FILENO)
+        err = posix_spawn_file_actions_adddup2(&actions, out, STDOUT_FILENO);
+    if (err == 0)
+        err = posix_spawn_file_actions_addfchdir_np(&actions, session_fd());
+
+    /* A cached path that has gone away is looked up once more. */
+    for (retried = 0; err == 0; retried = 1) {
+        err = posix_spawn(&s->pid, path, &actions, &attr, s->argv, environ);
+        if (err != ENOENT || retried || path == s->argv[0])
+            break;
+        pathcache_forget(s->argv[0]);
+        if ((path = pathcache_lookup(s->argv[0])) == NULL)
+            break;                                      // err is ENOENT.
+    }
+    posix_spawn_file_actions_destroy(&actions);
+    return err;
+}   /* spawn_stage */
+
+
+/* Run the builtin of s with its output going to its pipe. A reader that
+exits early (`cat big | head`) is not an error of the builtin. The error
+message goes to the shell's output, not down the pipe. */
+static void run_builtin_stage (stage *s, int last)
+{
+    int previous;           // Output descriptor to restore.
+    cmd_result result;
+
+    if (s->b->flags & BUILTIN_HALTS) {          // exit only ends the shell
+        s->status = 0;                          //   when it runs by itself.
+        return;
+    }
+    previous = s->out != -1 ? out_redirect(s->out) : -1;
+    result = run_builtin(s->b, s->argv, s->argc - 1);
+    if (previous != -1)
+        out_redirect(previous);
+    if (result.err == EPIPE && !last)
+        result = CMD_OK;
+    print_result(s->b->name, &result);
+    s->status = result.err != 0;
+}   /* run_builtin_stage */
+
+
+static int wait_status (pid_t pid)
+{
+    int status;
+
+    while (waitpid(pid, &status, 0) == -1)
+        if (errno != EINTR)
+            return EXEC_NOT_FOUND;
+    if (WIFSIGNALED(status))
+        return 128 + WTERMSIG(status);
+    return WEXITSTATUS(status);
+}   /* wait_status */
+
+
+/* Returns true if the builtin b cannot run with no operands. Builtins do not
+read their input, so in a pipeline such a command (`echo hi | cat`) is
+meant for the program of the same name, which reads the pipe. */
+static int needs_operands (const builtin *b)
+{
+    return b->cmd.n == VARIADIC || b->cmd.n > 0;
+}   /* needs_operands */
+
+
+/* Split tokens at the "|" tokens, which are replaced by NULLs so that every
+command's argv is terminated. Returns the number of stages, or -1 if a
+command is missing on either side of a "|". */
+static int split_stages (char **tokens, stage **stages)
+{
+    stage *s;
+    int n, i, start;
+
+    for (n = 1, i = 0; tokens[i] != NULL; i++)
+        n += is_pipe(tokens[i]);
+    if ((s = arena_alloc(&line_arena, n * sizeof(stage))) == NULL)
+        return -1;
+    for (n = 0, i = start = 0; ; i++) {
+        if (tokens[i] != NULL && !is_pipe(tokens[i]))
+            continue;
+        if (i == start)
+            return -1;                      // Nothing before or after a "|".
+        s[n].argv = tokens + start;
+        s[n].argc = i - start;
+        s[n].b = lookup_builtin(tokens[start]);
+        if (s[n].b != NULL && s[n].argc == 1 && needs_operands(s[n].b))
+            s[n].b = NULL;                      // Run the program instead.
+        s[n].pid = -1;
+        s[n].in = s[n].out = -1;
+        s[n].status = 0;
+        n++;
+        if (tokens[i] == NULL)
+            break;
+        tokens[i] = NULL;
+        start = i + 1;
+    }
+    *stages = s;
+    return n;
+}   /* split_stages */
+
+
+int run_pipeline (char **tokens)
+{
+    stage *stages;          // The commands, in order.
+    int fds[2];             // A pipe between two neighbours.
+    int n, i, err;
+
+    if ((n = split_stages(tokens, &stages)) == -1) {
+        print_err(CMD, "|");
+        return EXEC_NOT_FOUND;
+    }
+
+    /* Create every pipe first: a builtin writes into its pipe after the
+    programs on both sides have been started. */
+    for (i = 0; i + 1 < n; i++) {
+        if (pipe2(fds, O_CLOEXEC) == -1) {
+            print_syserr(errno, __func__);
+            n = i + 1;                         // Run what can be connected.
+            break;
+        }
+        stages[i].out = fds[1];
+        stages[i + 1].in = fds[0];
+    }
+
+    /* Start the programs, then hand the shell's copies of their pipe ends
+    back. Builtins do not read their input, so a builtin's read end is
+    closed too: a program writing to it gets EPIPE. */
+    out_flush();                    // Earlier output goes first.
+    for (i = 0; i < n; i++) {
+        if (stages[i].b == NULL
+            && (err = spawn_stage(&stages[i])) != 0) {
+            if (err == ENOENT)
+                print_err(CMD, stages[i].argv[0]);
+            else
+                print_result(stages[i].argv[0],
+                             &CMD_ERROR(err, "posix_spawn", NULL));
+            stages[i].status = EXEC_NOT_FOUND;
+        }
+        if (stages[i].in != -1)
+            close(stages[i].in);
+        if (stages[i].b == NULL && stages[i].out != -1)
+            close(stages[i].out);
+    }
+
+    /* Run the builtins in order, closing each pipe as its writer ends. */
+    for (i = 0; i < n; i++) {
+        if (stages[i].b == NULL)
+            continue;
+        run_builtin_stage(&stages[i], i == n - 1);
+        if (stages[i].out != -1)
+            close(stages[i].out);
+    }
+    out_flush();
+
+    for (i = 0; i < n; i++)
+        if (stages[i].pid != -1)
+            stages[i].status = wait_status(stages[i].pid);
+    return stages[n - 1].status;
+}   /* run_pipeline */
@@ -0,0 +1,26 @@
+/*
+ *  exec.h
+ *
+ *  Author: Joseph Erlinger
+ *      Created on: October 17, 2026
+ */
+#ifndef EXEC_H
+#define EXEC_H
+
+
+#define EXEC_NOT_FOUND 127      // Status of a command that could not run.
+
+
+/* Returns true if the NULL terminated tokens contain a "|". */
+int is_pipeline (char **tokens);
+
+
+/* Run the NULL terminated tokens as a pipeline: commands separated by "|",
+each one a builtin or a program found through $PATH. Programs are started
+with posix_spawn(3) in the session's working directory, and a builtin's
+output is written into the pipe to the next command (cat splices the file
+into it). Reports the commands that failed to start or failed, and
+returns the status of the last command: 0 on success. */
+int run_pipeline (char **tokens);
+
+#endif  /* EXEC_H */
@@ -0,0 +1,60 @@
+/*
+ *  iobackend.c
+ *
+ *  Author: Joseph Erlinger
+ *      Created on: October 17, 2026
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include "iobackend.h"
+#include "uring.h"
+#include "copy.h"
+#include "arena.h"
+
+
+static __thread char *sync_buf;     // Lazily allocated, COPY_BUFSIZ bytes.
+
+
+/* The original read -> write loop, one request at a time. */
+static off_t sync_transfer (int in_fd, off_t in_off, int out_fd,
+                            off_t out_off, off_t len)
+{
+    off_t copied;           // # Bytes written so far.
+    size_t chunk;           // # Bytes requested in the next read.
+    ssize_t n, w;           // # Bytes read, written by the last call.
+
+    if (sync_buf == NULL && (sync_buf = counted_malloc(COPY_BUFSIZ)) == NULL)
+        return -1;
+    for (copied = 0; copied < len; ) {
+        chunk = len - copied > COPY_BUFSIZ ? COPY_BUFSIZ : len - copied;
+        n = pread(in_fd, sync_buf, chunk, in_off + copied);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return n == 0 ? copied : -1;                 // EOF or error.
+        for (w = 0; w < n; ) {
+            ssize_t m = pwrite(out_fd, sync_buf + w, n - w,
+                               out_off + copied + w);
+            if (m == -1 && errno == EINTR)
+                continue;
+            if (m == -1)
+                return -1;                                    // Exit on error.
+            w += m;
+        }
+        copied += n;
+    }
+    return copied;
+}   /* sync_transfer */
+
+
+const io_backend sync_backend = { "sync", sync_transfer };
+
+
+const io_backend *io_backend_for (off_t len)
+{
+    if (len >= URING_MIN_BYTES && uring_available())
+        return &uring_backend;
+    return &sync_backend;
+}   /* io_backend_for */
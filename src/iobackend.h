@@ -0,0 +1,36 @@
+/*
+ *  iobackend.h
+ *
+ *  Author: Joseph Erlinger
+ *      Created on: October 17, 2026
+ */
+#ifndef IOBACKEND_H
+#define IOBACKEND_H
+
+#include <sys/types.h>
+
+
+/* A way of moving bytes between two files through user-space buffers, for
+when the kernel will not copy them for us (see copy.c). */
+typedef struct io_backend {
+    const char *name;
+    /* Copy len bytes from in_fd at in_off to out_fd at out_off. Stops early
+    only at end of input. Returns the # bytes copied, or -1 with errno set;
+    ENOSYS means the backend is unavailable and nothing was done. */
+    off_t (*transfer) (int in_fd, off_t in_off, int out_fd, off_t out_off,
+                       off_t len);
+} io_backend;
+
+
+extern const io_backend sync_backend;     // Blocking pread/pwrite loop.
+extern const io_backend uring_backend;    // io_uring with I/O in flight.
+
+
+#define URING_MIN_BYTES (8 << 20)   // Smaller transfers stay synchronous.
+
+
+/* The backend to use for a transfer of len bytes: io_uring for large
+transfers while it is available, otherwise the blocking loop. */
+const io_backend *io_backend_for (off_t len);
+
+#endif  /* IOBACKEND_H */
@@ -0,0 +1,279 @@
+/*
+ *  jobs.c
+ *
+ *  Author: Joseph Erlinger
+ *      Created on: October 17, 2026
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "jobs.h"
+#include "cli.h"
+#include "arena.h"
+#include "copy.h"
+#include "output.h"
+#include "session.h"
+#include "durable.h"
+#include "uring.h"
+#include "stats.h"
+
+
+typedef struct job {
+    struct job *next;       // The job started after it.
+    struct job *queued;     // The next job waiting for a thread.
+    char **argv;            // Copy of the tokens; the strings follow it.
+    job_list *list;         // The session that started it.
+    session session;        // Its own working directory.
+    int fd;                 // memfd(2) collecting its output.
+    int done;
+} job;
+
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t work;        // Signalled when a job is queued.
+    pthread_cond_t done;        // Broadcast when a job finishes.
+    job *queue, *queue_tail;    // Jobs waiting for a thread.
+    pthread_t threads[JOB_THREADS];
+    int started;                // # Job threads running.
+    int idle;                   // # Of them waiting for a job.
+    int stopping;
+} jobs = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .work = PTHREAD_COND_INITIALIZER,
+    .done = PTHREAD_COND_INITIALIZER,
+};
+
+
+static job_list shell_jobs = { NULL, NULL, -1 };
+static __thread job_list *current_jobs = &shell_jobs;
+static __thread int in_job;     // Set while this thread runs a job.
+
+
+/* Run j with its session and output. */
+static void run_job (job *j)
+{
+    static const char nomem[] = "Error! Cannot allocate memory: &\n";
+    session *caller;
+    output *o, *previous;
+    const char *call;
+    ssize_t n;
+
+    caller = current_session;
+    current_session = &j->session;
+    in_job = 1;
+    if ((o = out_open(j->fd)) == NULL) {
+        n = write(j->fd, nomem, sizeof(nomem) - 1);
+        (void) n;                               // Nowhere else to report it.
+    } else {
+        previous = out_select(o);
+        run_list(j->argv);
+        if ((call = durable_commit()) != NULL)   // A job is done once it
+            print_syserr(errno, call);           //   is durable.
+        out_select(previous);
+        out_close(o);
+    }
+    in_job = 0;
+    current_session = caller;
+}   /* run_job */
+
+
+static void *job_thread (void *unused)
+{
+    job *j;
+
+    (void) unused;
+    pthread_mutex_lock(&jobs.lock);
+    for (;;) {
+        while (jobs.queue == NULL && !jobs.stopping) {
+            jobs.idle++;
+            pthread_cond_wait(&jobs.work, &jobs.lock);
+            jobs.idle--;
+        }
+        if ((j = jobs.queue) == NULL)
+            break;                                  // Stopping and drained.
+        if ((jobs.queue = j->queued) == NULL)
+            jobs.queue_tail = NULL;
+        pthread_mutex_unlock(&jobs.lock);
+        run_job(j);
+        arena_reset(&line_arena);               // The job's temporaries.
+        pthread_mutex_lock(&jobs.lock);
+        j->done = 1;
+        pthread_cond_broadcast(&jobs.done);
+        if (j->list->notify != -1)      // Before j can be reported and freed.
+            eventfd_write(j->list->notify, 1);
+    }
+    pthread_mutex_unlock(&jobs.lock);
+    arena_release(&line_arena);
+    copy_release();
+    uring_release();
+    stats_thread_exit();
+    return NULL;
+}   /* job_thread */
+
+
+/* Copy the NULL terminated tokens into one allocation after a job. */
+static job *new_job (char **tokens)
+{
+    size_t n, bytes, len;
+    char *text;             // Where the next string goes.
+    job *j;
+    int i;
+
+    for (n = bytes = 0; tokens[n] != NULL; n++)
+        bytes += strlen(tokens[n]) + 1;
+    if ((j = counted_malloc(sizeof(job) + (n + 1) * sizeof(char *)
+                            + bytes)) == NULL)
+        return NULL;
+    j->argv = (char **) (j + 1);
+    text = (char *) (j->argv + n + 1);
+    for (i = 0; tokens[i] != NULL; i++) {
+        len = strlen(tokens[i]) + 1;
+        j->argv[i] = memcpy(text, tokens[i], len);
+        text += len;
+    }
+    j->argv[n] = NULL;
+    j->next = j->queued = NULL;
+    j->done = 0;
+    return j;
+}   /* new_job */
+
+
+static void free_job (job *j)
+{
+    close(j->fd);
+    session_free(&j->session);
+    counted_free(j);
+}   /* free_job */
+
+
+int job_start (char **tokens)
+{
+    job *j;
+    int saved_errno;
+
+    if ((j = new_job(tokens)) == NULL)
+        return -1;
+    if (session_copy(&j->session, current_session) == -1) {
+        counted_free(j);
+        return -1;
+    }
+    if ((j->fd = memfd_create("job", MFD_CLOEXEC)) == -1) {
+        saved_errno = errno;
+        session_free(&j->session);
+        counted_free(j);
+        errno = saved_errno;
+        return -1;
+    }
+
+    j->list = current_jobs;
+    pthread_mutex_lock(&jobs.lock);
+    if (j->list->tail != NULL)
+        j->list->tail->next = j;
+    else
+        j->list->head = j;
+    j->list->tail = j;
+    if (jobs.idle == 0 && jobs.started < JOB_THREADS
+        && pthread_create(&jobs.threads[jobs.started], NULL, job_thread,
+                          NULL) == 0)
+        jobs.started++;
+    if (jobs.started == 0) {                // No thread: run it right away.
+        pthread_mutex_unlock(&jobs.lock);
+        run_job(j);
+        j->done = 1;
+        return 0;
+    }
+    if (jobs.queue_tail != NULL)
+        jobs.queue_tail->queued = j;
+    else
+        jobs.queue = j;
+    jobs.queue_tail = j;
+    pthread_cond_signal(&jobs.work);
+    pthread_mutex_unlock(&jobs.lock);
+    return 0;
+}   /* job_start */
+
+
+/* Append the output j collected to the shell's output. */
+static void print_job (job *j)
+{
+    struct stat sb;
+    int saved_errno;
+
+    saved_errno = errno;
+    if (fstat(j->fd, &sb) == 0 && sb.st_size > 0
+        && lseek(j->fd, 0, SEEK_SET) == 0) {
+        out_flush();
+        stream_data(j->fd, out_fileno(), NULL);
+    }
+    errno = saved_errno;
+}   /* print_job */
+
+
+job_list *jobs_select (job_list *l)
+{
+    job_list *previous;
+
+    previous = current_jobs;
+    current_jobs = l != NULL ? l : &shell_jobs;
+    return previous;
+}   /* jobs_select */
+
+
+void jobs_report (int block)
+{
+    job_list *l;
+    job *j;
+
+    l = current_jobs;
+    if (in_job || l->head == NULL)          // Only this thread adds jobs, so
+        return;                             //   no lock is needed to look.
+    pthread_mutex_lock(&jobs.lock);
+    while ((j = l->head) != NULL) {
+        if (!j->done) {
+            if (!block)
+                break;
+            pthread_cond_wait(&jobs.done, &jobs.lock);
+            continue;
+        }
+        if ((l->head = j->next) == NULL)
+            l->tail = NULL;
+        pthread_mutex_unlock(&jobs.lock);
+        print_job(j);
+        free_job(j);
+        pthread_mutex_lock(&jobs.lock);
+    }
+    pthread_mutex_unlock(&jobs.lock);
+}   /* jobs_report */
+
+
+void jobs_shutdown (void)
+{
+    int i;
+
+    jobs_report(1);
+    pthread_mutex_lock(&jobs.lock);
+    jobs.stopping = 1;
+    pthread_cond_broadcast(&jobs.work);
+    pthread_mutex_unlock(&jobs.lock);
+    for (i = 0; i < jobs.started; i++)
+        pthread_join(jobs.threads[i], NULL);
+    jobs.started = 0;
+    jobs.stopping = 0;
+}   /* jobs_shutdown */
+
+
+/* Inside a job, wait has nothing to wait for: the jobs of its line run
+beside it, not under it. */
+cmd_result waitJobs ()
+{
+    jobs_report(1);
+    return CMD_OK;
+}   /* waitJobs */
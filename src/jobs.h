@@ -0,0 +1,52 @@
+/*
+ *  jobs.h
+ *
+ *  Author: Joseph Erlinger
+ *      Created on: October 17, 2026
+ */
+#ifndef JOBS_H
+#define JOBS_H
+
+#include "command.h"
+
+
+#define JOB_THREADS 4           // Jobs that run at the same time.
+
+
+/* The jobs one session started and has not been shown yet, in the order
+they were started. The shell has a list of its own; the server keeps one
+per connection. notify, unless it is -1, is an eventfd(2) that is counted
+up each time one of the jobs finishes. */
+typedef struct job_list {
+    struct job *head, *tail;
+    int notify;
+} job_list;
+
+
+/* Run the NULL terminated tokens (an and-or list) as a background job, on
+a copy of the tokens and of the session, so a cd inside the job does not
+move the shell. The job's output is collected in a file of its own and
+written out as a whole, after the output of every job started before it.
+Returns 0, or -1 with errno set if the job could not be queued. */
+int job_start (char **tokens);
+
+
+/* Make l the list the calling thread starts and reports jobs in, or the
+shell's own list if l is NULL. Returns the list used before. */
+job_list *jobs_select (job_list *l);
+
+
+/* Write out the output of the jobs of the selected list that have
+finished, in the order they were started. With block set, wait for every
+one of them first. Only the shell's main thread starts and reports jobs. */
+void jobs_report (int block);
+
+
+/* Wait for every job, report them, and stop the job threads. */
+void jobs_shutdown (void);
+
+
+/* wait: let every background job finish and print its output. */
+cmd_result waitJobs ();
+
+#endif  /* JOBS_H */
@@ -0,0 +1,972 @@
+/*
+ *  lineedit.c
+ *
+ *  Author: Joseph Erlinger
+ *      Created on: October 17, 2026
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <dirent.h>
+#include <poll.h>
+#include <termios.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include "lineedit.h"
+#include "arena.h"
+#include "cli.h"
+#include "dirlist.h"
+#include "output.h"
+#include "session.h"
+
+
+#define CTRL_KEY(c) ((c) & 0x1f)
+#define KEY_ESC 27
+#define KEY_BACKSPACE 127
+#define KEY_NONE -2             // Nothing to do (a timeout, an unknown key).
+
+enum { KEY_UP = 256, KEY_DOWN, KEY_LEFT, KEY_RIGHT, KEY_HOME, KEY_END,
+       KEY_DELETE };
+
+
+/* A growable byte buffer. */
+typedef struct text {
+    char *data;
+    size_t len;
+    size_t cap;
+} text;
+
+
+static struct {
+    int enabled;                // stdin and stdout are terminals.
+    struct termios cooked;      // The terminal settings to restore.
+    text line;                  // The line being edited.
+    size_t pos;                 // Cursor offset in line.
+    const char *prompt;
+    size_t history;             // History entry shown (1 is the newest),
+                                //   or 0 for the line being typed.
+    text saved;                 // The typed line, while walking the history.
+    int tabs;                   // Tabs pressed in a row.
+    int cols;                   // Terminal width.
+    size_t offset;              // First byte of line shown (long lines
+                                //   scroll sideways).
+    text shown;                 // What the terminal row holds now.
+    size_t cursor;              // Column of the terminal cursor.
+    text row;                   // What it should hold.
+    text label;                 // The reverse search prompt.
+    text screen;                // Bytes to write to the terminal.
+} ed;
+
+
+static struct {
+    unsigned char buf[256];     // Input read ahead.
+    size_t len;
+    size_t pos;                 // Next byte of buf to hand out.
+} in;
+
+
+static struct {
+    char *lines[LINEEDIT_HISTORY];  // A ring, oldest at first.
+    size_t first;
+    size_t count;
+    int fd;                     // The history file, appended to, or -1.
+} history = { .fd = -1 };
+
+
+/* The sorted names in a directory, read again only when it changes. */
+static struct {
+    int valid;
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+    struct timespec read;       // When it was read.
+    text names;                 // Records of a DT_* byte, the name, a NUL.
+    char **sorted;              // count names, then room for sort_names().
+    size_t count;
+} listing;
+
+
+static char **matches;          // Completion candidates.
+static size_t num_matches, matches_cap;
+
+
+static int reserve (text *t, size_t need)
+{
+    char *p;
+    size_t cap;
+
+    if (need <= t->cap)
+        return 0;
+    for (cap = t->cap ? t->cap : 128; cap < need; cap *= 2)
+        ;
+    if ((p = counted_realloc(t->data, cap)) == NULL)
+        return -1;
+    t->data = p;
+    t->cap = cap;
+    return 0;
+}   /* reserve */
+
+
+static void append (text *t, const char *data, size_t len)
+{
+    if (len > 0 && reserve(t, t->len + len) == 0) {
+        memcpy(t->data + t->len, data, len);
+        t->len += len;
+    }
+}   /* append */
+
+
+static void emit (const char *data, size_t len)
+{
+    append(&ed.screen, data, len);
+}   /* emit */
+
+
+/* Write what the last keystrokes drew, in one go. */
+static void flush_screen (void)
+{
+    size_t done;
+    ssize_t n;
+
+    for (done = 0; done < ed.screen.len; done += n)
+        if ((n = write(STDOUT_FILENO, ed.screen.data + done,
+                       ed.screen.len - done)) == -1) {
+            if (errno != EINTR)
+                break;
+            n = 0;
+        }
+    ed.screen.len = 0;
+}   /* flush_screen */
+
+
+static int before (const struct timespec *a, const struct timespec *b)
+{
+    return a->tv_sec < b->tv_sec
+           || (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}   /* before */
+
+
+/* History entry i, 1 being the newest. */
+static const char *entry (size_t i)
+{
+    return history.lines[(history.first + history.count - i)
+                         % LINEEDIT_HISTORY];
+}   /* entry */
+
+
+static void add_history (const char *line, size_t len, int persist)
+{
+    struct iovec iov[2];
+    char *copy;
+    size_t i;
+
+    for (i = 0; i < len && line[i] == ' '; i++)
+        ;
+    if (i == len || (history.count > 0 && strlen(entry(1)) == len
+                     && memcmp(entry(1), line, len) == 0))
+        return;                             // Blank, or the same again.
+    if ((copy = counted_malloc(len + 1)) == NULL)
+        return;
+    memcpy(copy, line, len);
+    copy[len] = '\0';
+    if (history.count == LINEEDIT_HISTORY) {
+        counted_free(history.lines[history.first]);
+        history.first = (history.first + 1) % LINEEDIT_HISTORY;
+        history.count--;
+    }
+    history.lines[(history.first + history.count++) % LINEEDIT_HISTORY]
+        = copy;
+    if (persist && history.fd != -1) {
+        iov[0].iov_base = copy;
+        iov[0].iov_len = len;
+        iov[1].iov_base = "\n";
+        iov[1].iov_len = 1;
+        if (writev(history.fd, iov, 2) == -1) {
+            close(history.fd);              // Keep going without saving.
+            history.fd = -1;
+        }
+    }
+}   /* add_history */
+
+
+/* Read the history file into the ring. Returns the number of lines in the
+file. */
+static size_t load_history (const char *path)
+{
+    text file = { NULL, 0, 0 };
+    char *line, *end;
+    size_t lines;
+    ssize_t n;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY | O_CLOEXEC)) == -1)
+        return 0;
+    do {
+        if (reserve(&file, file.len + 4096) == -1)
+            break;
+        n = read(fd, file.data + file.len, file.cap - file.len);
+        if (n > 0)
+            file.len += n;
+    } while (n > 0 || (n == -1 && errno == EINTR));
+    close(fd);
+    for (lines = 0, line = file.data; line < file.data + file.len;
+         line = end + 1, lines++) {
+        if ((end = memchr(line, '\n', file.data + file.len - line)) == NULL)
+            end = file.data + file.len;
+        add_history(line, end - line, 0);
+    }
+    counted_free(file.data);
+    return lines;
+}   /* load_history */
+
+
+/* Replace the history file with the lines in the ring, once it has grown
+past them. */
+static void rewrite_history (const char *path)
+{
+    char tmp[PATH_MAX];
+    size_t i;
+    FILE *f;
+    int fd;
+
+    if (snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path) >= (int) sizeof(tmp)
+        || (fd = mkostemp(tmp, O_CLOEXEC)) == -1)
+        return;
+    if ((f = fdopen(fd, "w")) == NULL) {
+        close(fd);
+        unlink(tmp);
+        return;
+    }
+    for (i = history.count; i > 0; i--)
+        fprintf(f, "%s\n", entry(i));
+    if (fclose(f) != 0 || rename(tmp, path) == -1)
+        unlink(tmp);
+}   /* rewrite_history */
+
+
+void lineedit_open (void)
+{
+    char path[PATH_MAX];
+    const char *home;
+    const char *term;
+
+    term = getenv("TERM");
+    ed.enabled = isatty(STDIN_FILENO) && isatty(STDOUT_FILENO)
+                 && term != NULL && strcmp(term, "dumb") != 0
+                 && tcgetattr(STDIN_FILENO, &ed.cooked) == 0;
+    if (!ed.enabled || (home = getenv("HOME")) == NULL
+        || snprintf(path, sizeof(path), "%s/%s", home, LINEEDIT_HISTORY_FILE)
+           >= (int) sizeof(path))
+        return;
+    if (load_history(path) > LINEEDIT_HISTORY)
+        rewrite_history(path);
+    history.fd = open(path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+}   /* lineedit_open */
+
+
+void lineedit_close (void)
+{
+    if (history.fd != -1)
+        close(history.fd);
+    history.fd = -1;
+    while (history.count > 0) {
+        counted_free(history.lines[history.first]);
+        history.first = (history.first + 1) % LINEEDIT_HISTORY;
+        history.count--;
+    }
+    counted_free(ed.line.data);
+    counted_free(ed.saved.data);
+    counted_free(ed.shown.data);
+    counted_free(ed.row.data);
+    counted_free(ed.label.data);
+    counted_free(ed.screen.data);
+    counted_free(listing.names.data);
+    counted_free(listing.sorted);
+    counted_free(matches);
+    memset(&ed.line, 0, sizeof(text));
+    memset(&ed.saved, 0, sizeof(text));
+    memset(&ed.shown, 0, sizeof(text));
+    memset(&ed.row, 0, sizeof(text));
+    memset(&ed.label, 0, sizeof(text));
+    memset(&ed.screen, 0, sizeof(text));
+    memset(&listing, 0, sizeof(listing));
+    matches = NULL;
+    num_matches = matches_cap = 0;
+}   /* lineedit_close */
+
+
+/* ------------------------------------------------------------------------
+   Drawing
+   ------------------------------------------------------------------------ */
+
+
+/* Move the terminal cursor to column to of the row shown. Moves are
+relative, so the row may start after output that did not end a line. */
+static void move_cursor (size_t to)
+{
+    char seq[32];
+    size_t n;
+    int len;
+
+    if (to < ed.cursor) {
+        n = ed.cursor - to;
+        if (n <= 4)
+            emit("\b\b\b\b", n);
+        else
+            emit(seq, snprintf(seq, sizeof(seq), "\x1b[%zuD", n));
+    } else if (to > ed.cursor) {
+        n = to - ed.cursor;
+        len = snprintf(seq, sizeof(seq), "\x1b[%zuC", n);
+        if (n <= (size_t) len)                  // Cheaper to write again.
+            emit(ed.shown.data + ed.cursor, n);
+        else
+            emit(seq, len);
+    }
+    ed.cursor = to;
+}   /* move_cursor */
+
+
+static void window_width (void)
+{
+    struct winsize ws;
+    int cols;
+
+    cols = ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_col > 0
+           ? ws.ws_col : 80;
+    if (cols != ed.cols && ed.shown.len > 0) {
+        emit("\r\x1b[K", 4);                // The terminal reflowed the row.
+        ed.shown.len = ed.cursor = 0;
+    }
+    ed.cols = cols;
+}   /* window_width */
+
+
+/* Show label then the part of t around pos, with the cursor at pos,
+writing only the bytes of the row that changed. */
+static void refresh (const char *label, size_t llen, const char *t,
+                     size_t len, size_t pos)
+{
+    size_t width;           // Columns left for t.
+    size_t visible;
+    size_t same;            // Bytes at the start of the row already shown.
+
+    window_width();
+    if (llen > (size_t) ed.cols / 2)
+        llen = ed.cols / 2;
+    width = ed.cols - 1 - llen;
+    if (ed.offset > len)
+        ed.offset = len;
+    if (ed.offset > 0 && len - ed.offset < width)
+        ed.offset = len > width ? len - width : 0;
+    if (pos < ed.offset)
+        ed.offset = pos;
+    if (pos - ed.offset > width)
+        ed.offset = pos - width;
+    visible = len - ed.offset < width ? len - ed.offset : width;
+
+    ed.row.len = 0;
+    append(&ed.row, label, llen);
+    append(&ed.row, t + ed.offset, visible);
+    for (same = 0; same < ed.row.len && same < ed.shown.len
+                   && ed.row.data[same] == ed.shown.data[same]; same++)
+        ;
+    if (same < ed.row.len || same < ed.shown.len) {
+        move_cursor(same);
+        emit(ed.row.data + same, ed.row.len - same);
+        ed.cursor = ed.row.len;
+        if (ed.shown.len > ed.row.len)
+            emit("\x1b[K", 3);
+        ed.shown.len = 0;
+        append(&ed.shown, ed.row.data, ed.row.len);
+    }
+    move_cursor(llen + pos - ed.offset);
+}   /* refresh */
+
+
+static void refresh_line (void)
+{
+    refresh(ed.prompt, strlen(ed.prompt), ed.line.data, ed.line.len, ed.pos);
+}   /* refresh_line */
+
+
+/* Leave the row as it is and start a fresh one below it. */
+static void new_row (void)
+{
+    if (ed.shown.len == 0)
+        return;                             // On a fresh row already.
+    move_cursor(ed.shown.len);
+    emit("\n", 1);
+    ed.shown.len = ed.cursor = 0;
+    ed.offset = 0;
+}   /* new_row */
+
+
+/* ------------------------------------------------------------------------
+   Input
+   ------------------------------------------------------------------------ */
+
+
+/* The next byte of input, waiting at most timeout ms for it (forever if
+timeout is -1). Returns -1 at the end of input (errno 0) or on error, or
+KEY_NONE on a timeout. */
+static int read_byte (int timeout)
+{
+    struct pollfd p;
+    ssize_t n;
+
+    if (in.pos < in.len)
+        return in.buf[in.pos++];
+    p.fd = STDIN_FILENO;
+    p.events = POLLIN;
+    if (timeout >= 0 && poll(&p, 1, timeout) == 0)
+        return KEY_NONE;
+    do {
+        n = read(STDIN_FILENO, in.buf, sizeof(in.buf));
+    } while (n == -1 && errno == EINTR);
+    if (n <= 0) {
+        if (n == 0)
+            errno = 0;
+        return -1;
+    }
+    in.len = n;
+    in.pos = 1;
+    return in.buf[0];
+}   /* read_byte */
+
+
+/* The next key: a byte, or a KEY_* for an escape sequence. Returns -1 at
+the end of input or on error. */
+static int read_key (void)
+{
+    int c, param, final;
+
+    if ((c = read_byte(-1)) != KEY_ESC)
+        return c;
+    if ((c = read_byte(LINEEDIT_ESC_TIMEOUT)) != '[' && c != 'O')
+        return c == KEY_NONE ? KEY_ESC : KEY_NONE;      // Alt-keys: unused.
+    if (c == 'O')
+        final = read_byte(LINEEDIT_ESC_TIMEOUT);
+    else {
+        param = 0;                  // The first parameter; ";5" etc ignored.
+        while ((final = read_byte(LINEEDIT_ESC_TIMEOUT)) >= '0'
+               && final <= '9')
+            param = param * 10 + final - '0';
+        while (final >= 0x20 && final < 0x40)
+            final = read_byte(LINEEDIT_ESC_TIMEOUT);
+        if (final == '~')
+            switch (param) {
+            case 1: case 7: return KEY_HOME;
+            case 4: case 8: return KEY_END;
+            case 3: return KEY_DELETE;
+            default: return KEY_NONE;
+            }
+    }
+    switch (final) {
+    case 'A': return KEY_UP;
+    case 'B': return KEY_DOWN;
+    case 'C': return KEY_RIGHT;
+    case 'D': return KEY_LEFT;
+    case 'H': return KEY_HOME;
+    case 'F': return KEY_END;
+    default: return KEY_NONE;
+    }
+}   /* read_key */
+
+
+/* ------------------------------------------------------------------------
+   Editing
+   ------------------------------------------------------------------------ */
+
+
+static void insert (const char *s, size_t n)
+{
+    if (reserve(&ed.line, ed.line.len + n) == -1)
+        return;
+    memmove(ed.line.data + ed.pos + n, ed.line.data + ed.pos,
+            ed.line.len - ed.pos);
+    memcpy(ed.line.data + ed.pos, s, n);
+    ed.line.len += n;
+    ed.pos += n;
+}   /* insert */
+
+
+/* Delete line[from..to) and put the cursor at from. */
+static void erase (size_t from, size_t to)
+{
+    if (from == to)
+        return;
+    memmove(ed.line.data + from, ed.line.data + to, ed.line.len - to);
+    ed.line.len -= to - from;
+    ed.pos = from;
+}   /* erase */
+
+
+static void set_line (const char *s, size_t n)
+{
+    ed.line.len = 0;
+    append(&ed.line, s, n);
+    ed.pos = ed.line.len;
+}   /* set_line */
+
+
+/* Show history entry ed.history + step (0 being the typed line). */
+static void recall (int step)
+{
+    size_t to;
+
+    if ((step < 0 && ed.history == 0)
+        || (step > 0 && ed.history == history.count))
+        return;
+    if (ed.history == 0) {
+        ed.saved.len = 0;
+        append(&ed.saved, ed.line.data, ed.line.len);
+    }
+    to = ed.history + step;
+    if (to == 0)
+        set_line(ed.saved.data, ed.saved.len);
+    else
+        set_line(entry(to), strlen(entry(to)));
+    ed.history = to;
+}   /* recall */
+
+
+/* ^R: search older history entries for a string as it is typed. Returns
+the key that ended the search, to be handled as usual, or KEY_NONE. The
+line becomes the entry found unless the search was cancelled. */
+static int search (void)
+{
+    char query[LINEEDIT_QUERY_MAX + 1];
+    size_t qlen;
+    size_t found;           // The entry found (1 is the newest), or 0.
+    size_t at;              // Where in it.
+    size_t from, i;
+    const char *hit;
+    int failing;
+    int key;
+
+    qlen = found = at = 0;
+    failing = 0;
+    ed.offset = 0;
+    for (;;) {
+        ed.label.len = 0;
+        append(&ed.label, failing ? "(failing reverse-i-search)`"
+                                  : "(reverse-i-search)`",
+               failing ? 27 : 19);
+        append(&ed.label, query, qlen);
+        append(&ed.label, "': ", 3);
+        hit = found ? entry(found) : "";
+        refresh(ed.label.data, ed.label.len, hit, strlen(hit), at);
+        flush_screen();
+
+        from = found ? found : 1;
+        switch (key = read_key()) {
+        case KEY_NONE:
+            continue;
+        case CTRL_KEY('r'):
+            if (qlen == 0)
+                continue;
+            from = found + 1;
+            break;
+        case CTRL_KEY('h'): case KEY_BACKSPACE:
+            if (qlen > 0)
+                qlen--;
+            if (qlen == 0) {
+                found = at = failing = 0;
+                continue;
+            }
+            break;
+        case CTRL_KEY('g'): case CTRL_KEY('c'): case KEY_ESC:
+            ed.offset = 0;
+            return KEY_NONE;
+        default:
+            if (key >= ' ' && key < 256 && qlen < LINEEDIT_QUERY_MAX) {
+                query[qlen++] = key;
+                break;
+            }
+            if (found) {
+                set_line(entry(found), strlen(entry(found)));
+                ed.pos = at;
+                ed.history = 0;
+            }
+            ed.offset = 0;
+            return key;
+        }
+        query[qlen] = '\0';
+        for (failing = 1, i = from; i <= history.count; i++)
+            if ((hit = strstr(entry(i), query)) != NULL) {
+                found = i;
+                at = hit - entry(i);
+                failing = 0;
+                break;
+            }
+    }
+}   /* search */
+
+
+/* ------------------------------------------------------------------------
+   Completion
+   ------------------------------------------------------------------------ */
+
+
+static int word_break (char c)
+{
+    return c == ' ' || c == ';' || c == '&' || c == '|';
+}   /* word_break */
+
+
+static void add_match (char *name)
+{
+    char **p;
+    size_t cap;
+
+    if (num_matches == matches_cap) {
+        cap = matches_cap ? matches_cap * 2 : 64;
+        if ((p = counted_realloc(matches, 2 * cap * sizeof(char *))) == NULL)
+            return;
+        matches = p;
+        matches_cap = cap;
+    }
+    matches[num_matches++] = name;
+}   /* add_match */
+
+
+/* Read the directory dir (relative to the working directory) into
+listing, unless it has not changed since it was last read. A change made
+in the clock tick of the last read may not have moved the mtime yet, so
+the listing is kept only once its mtime is older than the read. Returns 0,
+or -1 if the directory cannot be read. */
+static int list_directory (const char *dir)
+{
+    char buf[32 << 10];
+    struct stat sb;
+    const char *name;
+    unsigned char type;
+    dirlist d;
+    char **p;
+    size_t i, len;
+    int fd;
+
+    if (fstatat(session_fd(), dir, &sb, 0) == -1 || !S_ISDIR(sb.st_mode))
+        return -1;
+    if (listing.valid && listing.dev == sb.st_dev && listing.ino == sb.st_ino
+        && listing.mtime.tv_sec == sb.st_mtim.tv_sec
+        && listing.mtime.tv_nsec == sb.st_mtim.tv_nsec
+        && before(&listing.mtime, &listing.read))
+        return 0;
+
+    if ((fd = openat(session_fd(), dir,
+                     O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1
+        || fstat(fd, &sb) == -1) {
+        if (fd != -1)
+            close(fd);
+        return -1;
+    }
+    listing.valid = 0;
+    listing.names.len = listing.count = 0;
+    clock_gettime(CLOCK_REALTIME_COARSE, &listing.read);
+    dirlist_init(&d, fd, buf, sizeof(buf));
+    while ((name = dirlist_next(&d, &type)) != NULL) {
+        if (name[0] == '.' && (name[1] == '\0'
+                               || (name[1] == '.' && name[2] == '\0')))
+            continue;
+        append(&listing.names, (const char *) &type, 1);
+        append(&listing.names, name, strlen(name) + 1);
+        listing.count++;
+    }
+    close(fd);
+    if (d.error != 0 || (p = counted_realloc(listing.sorted,
+                         (2 * listing.count + 1) * sizeof(char *))) == NULL)
+        return -1;
+    listing.sorted = p;
+    for (i = 0, len = 0; i < listing.count; i++) {
+        listing.sorted[i] = listing.names.data + len + 1;
+        len += strlen(listing.sorted[i]) + 2;
+    }
+    sort_names(listing.sorted, listing.sorted + listing.count, listing.count);
+    listing.dev = sb.st_dev;
+    listing.ino = sb.st_ino;
+    listing.mtime = sb.st_mtim;
+    listing.valid = 1;
+    return 0;
+}   /* list_directory */
+
+
+/* Whether the listed entry name of dir is a directory, following links. */
+static int is_directory (const char *dir, const char *name)
+{
+    char path[PATH_MAX];
+    struct stat sb;
+
+    if (name[-1] == DT_DIR)
+        return 1;
+    if (name[-1] != DT_UNKNOWN && name[-1] != DT_LNK)
+        return 0;
+    return snprintf(path, sizeof(path), "%s/%s", dir, name)
+           < (int) sizeof(path)
+           && fstatat(session_fd(), path, &sb, 0) == 0
+           && S_ISDIR(sb.st_mode);
+}   /* is_directory */
+
+
+/* Print the candidates in columns below the line. */
+static void show_matches (void)
+{
+    static const char spaces[] = "                                ";
+    size_t width, per_row, i, len, pad;
+
+    for (width = 0, i = 0; i < num_matches; i++)
+        if ((len = strlen(matches[i])) > width)
+            width = len;
+    width += 2;
+    per_row = (size_t) ed.cols > width ? ed.cols / width : 1;
+    refresh_line();
+    new_row();
+    for (i = 0; i < num_matches; i++) {
+        len = strlen(matches[i]);
+        emit(matches[i], len);
+        if ((i + 1) % per_row == 0 || i + 1 == num_matches) {
+            emit("\n", 1);
+            continue;
+        }
+        for (pad = width - len; pad > 0; pad -= len) {
+            len = pad < sizeof(spaces) - 1 ? pad : sizeof(spaces) - 1;
+            emit(spaces, len);
+        }
+    }
+}   /* show_matches */
+
+
+/* Tab: complete the word before the cursor as a builtin if it is the first
+of a command, or else as a file name. */
+static void complete (void)
+{
+    char dir[PATH_MAX];
+    const char *word, *base, *slash;
+    size_t start, i, wlen, blen, common;
+    int command;
+
+    for (start = ed.pos; start > 0 && !word_break(ed.line.data[start-1]);
+         start--)
+        ;
+    for (i = start; i > 0 && ed.line.data[i-1] == ' '; i--)
+        ;
+    command = i == 0 || word_break(ed.line.data[i-1]);
+    word = ed.line.data + start;
+    wlen = ed.pos - start;
+    num_matches = 0;
+
+    if (command && memchr(word, '/', wlen) == NULL) {
+        base = word;
+        blen = wlen;
+        dir[0] = '\0';
+        for (i = 0; i < BUILTIN_SLOTS; i++)
+            if (BUILTIN_TABLE[i].name != NULL
+                && strncmp(BUILTIN_TABLE[i].name, word, wlen) == 0)
+                add_match((char *) BUILTIN_TABLE[i].name);
+    } else {
+        for (slash = word + wlen; slash > word && slash[-1] != '/'; slash--)
+            ;
+        base = slash;
+        blen = word + wlen - slash;
+        if (slash == word)
+            strcpy(dir, ".");
+        else if (slash - word == 1)
+            strcpy(dir, "/");
+        else if ((size_t) (slash - word) < sizeof(dir)) {
+            memcpy(dir, word, slash - word - 1);
+            dir[slash - word - 1] = '\0';
+        } else
+            return;
+        if (list_directory(dir) == -1)
+            return;
+        for (i = 0; i < listing.count; i++)
+            if (strncmp(listing.sorted[i], base, blen) == 0
+                && (listing.sorted[i][0] != '.' || blen > 0))
+                add_match(listing.sorted[i]);
+    }
+    if (num_matches == 0) {
+        emit("\a", 1);
+        return;
+    }
+    if (command)
+        sort_names(matches, matches + num_matches, num_matches);
+
+    for (common = blen; matches[0][common] != '\0'; common++) {
+        for (i = 1; i < num_matches; i++)
+            if (matches[i][common] != matches[0][common])
+                break;
+        if (i < num_matches)
+            break;
+    }
+    if (common > blen)
+        insert(matches[0] + blen, common - blen);
+    if (num_matches == 1)
+        insert(dir[0] != '\0' && is_directory(dir, matches[0]) ? "/" : " ",
+               1);
+    else if (common == blen && ed.tabs > 1)
+        show_matches();
+    else if (common == blen)
+        emit("\a", 1);
+}   /* complete */
+
+
+/* ------------------------------------------------------------------------
+   The editor
+   ------------------------------------------------------------------------ */
+
+
+/* Edit a line in ed.line until Enter. Returns 0, or -1 at the end of input
+or on error. */
+static int edit (void)
+{
+    size_t i;
+    int key;
+
+    ed.line.len = ed.pos = 0;
+    ed.history = 0;
+    ed.tabs = 0;
+    ed.offset = 0;
+    ed.shown.len = ed.cursor = 0;
+    for (;;) {
+        if (in.pos == in.len) {             // Draw once typing is handled.
+            refresh_line();
+            flush_screen();
+        }
+        if ((key = read_key()) == CTRL_KEY('r'))
+            key = search();
+        ed.tabs = key == '\t' ? ed.tabs + 1 : 0;
+
+        switch (key) {
+        case -1:
+            flush_screen();
+            return -1;
+        case '\r': case '\n':
+            ed.pos = ed.line.len;
+            refresh_line();
+            new_row();
+            flush_screen();
+            return 0;
+        case CTRL_KEY('c'):
+            refresh_line();
+            move_cursor(ed.shown.len);
+            emit("^C", 2);
+            append(&ed.shown, "^C", 2);
+            ed.cursor += 2;
+            new_row();
+            ed.line.len = ed.pos = 0;
+            ed.history = 0;
+            break;
+        case CTRL_KEY('d'):
+            if (ed.line.len == 0) {
+                flush_screen();
+                errno = 0;
+                return -1;
+            }
+            /* FALLTHROUGH */
+        case KEY_DELETE:
+            if (ed.pos < ed.line.len)
+                erase(ed.pos, ed.pos + 1);
+            break;
+        case CTRL_KEY('h'): case KEY_BACKSPACE:
+            if (ed.pos > 0)
+                erase(ed.pos - 1, ed.pos);
+            break;
+        case CTRL_KEY('a'): case KEY_HOME:
+            ed.pos = 0;
+            break;
+        case CTRL_KEY('e'): case KEY_END:
+            ed.pos = ed.line.len;
+            break;
+        case CTRL_KEY('b'): case KEY_LEFT:
+            if (ed.pos > 0)
+                ed.pos--;
+            break;
+        case CTRL_KEY('f'): case KEY_RIGHT:
+            if (ed.pos < ed.line.len)
+                ed.pos++;
+            break;
+        case CTRL_KEY('k'):
+            ed.line.len = ed.pos;
+            break;
+        case CTRL_KEY('u'):
+            erase(0, ed.pos);
+            break;
+        case CTRL_KEY('w'):
+            for (i = ed.pos; i > 0 && ed.line.data[i-1] == ' '; i--)
+                ;
+            for (; i > 0 && ed.line.data[i-1] != ' '; i--)
+                ;
+            erase(i, ed.pos);
+            break;
+        case CTRL_KEY('p'): case KEY_UP:
+            recall(1);
+            break;
+        case CTRL_KEY('n'): case KEY_DOWN:
+            recall(-1);
+            break;
+        case CTRL_KEY('l'):
+            emit("\x1b[H\x1b[2J", 7);
+            ed.shown.len = ed.cursor = 0;
+            break;
+        case '\t':
+            complete();
+            break;
+        default:
+            if (key >= ' ' && key < 256 && key != KEY_BACKSPACE) {
+                char c = key;
+                insert(&c, 1);
+            }
+            break;
+        }
+    }
+}   /* edit */
+
+
+ssize_t lineedit_read (const char *prompt, char **linep, size_t *sizep)
+{
+    struct termios raw;
+    ssize_t n;
+    char *p;
+    int result;
+
+    if (!ed.enabled) {
+        out_write(prompt, strlen(prompt));
+        out_flush();                         // Show output before reading.
+        if ((n = getline(linep, sizep, stdin)) == -1 && !ferror(stdin))
+            errno = 0;
+        return n;
+    }
+    out_flush();
+    raw = ed.cooked;
+    raw.c_iflag &= ~(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
+    raw.c_cflag |= CS8;
+    raw.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    if (tcsetattr(STDIN_FILENO, TCSADRAIN, &raw) == -1)
+        return -1;
+    ed.prompt = prompt;
+    result = edit();
+    tcsetattr(STDIN_FILENO, TCSADRAIN, &ed.cooked);
+    if (result == -1)
+        return -1;
+
+    add_history(ed.line.data, ed.line.len, 1);
+    if (*sizep < ed.line.len + 2) {
+        if ((p = realloc(*linep, ed.line.len + 2)) == NULL)
+            return -1;
+        *linep = p;
+        *sizep = ed.line.len + 2;
+    }
+    memcpy(*linep, ed.line.data, ed.line.len);
+    (*linep)[ed.line.len] = '\n';
+    (*linep)[ed.line.len + 1] = '\0';
+    return ed.line.len + 1;
+}   /* lineedit_read */
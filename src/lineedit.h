@@ -0,0 +1,56 @@
+/*
+ *  lineedit.h
+ *
+ *  Author: Joseph Erlinger
+ *      Created on: October 17, 2026
+ */
+#ifndef LINEEDIT_H
+#define LINEEDIT_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+
+#define LINEEDIT_HISTORY 1000       // Lines kept in the history ring.
+#define LINEEDIT_HISTORY_FILE ".pseudo-shell_history"    // In $HOME.
+#define LINEEDIT_ESC_TIMEOUT 50     // ms to wait for the rest of an escape
+                                    //   sequence before taking a lone ESC.
+#define LINEEDIT_QUERY_MAX 256      // Longest reverse search string.
+
+
+/* A line editor for interactive mode. While a line is read the terminal is
+in raw mode, and every keystroke redraws only what changed on the row: the
+row is diffed against what the terminal already shows, and the cursor is
+moved with whichever of a backspace, a rewrite of bytes already shown, or
+an escape sequence is shortest. Typed-ahead and pasted input is drawn once,
+when it has all been handled, in a single write(2).
+
+    Left/Right, ^B/^F, Home/End, ^A/^E     move
+    Backspace, Delete, ^D, ^K, ^U, ^W      delete
+    Up/Down, ^P/^N                         walk the history
+    ^R                                     search the history backwards
+    Tab                                    complete a builtin (first word)
+                                           or a file name (twice to list)
+    ^L                                     clear the screen
+    ^C                                     drop the line
+
+Columns are counted in bytes, so a line holding multibyte characters may
+be drawn shifted. */
+
+
+/* Load the history from $HOME/LINEEDIT_HISTORY_FILE. Does nothing unless
+stdin and stdout are terminals. */
+void lineedit_open (void);
+
+
+/* Show prompt and read a line into *linep (of *sizep bytes, grown with
+realloc(3) as getline(3) does), ending it with a newline. Returns its
+length, or -1 at the end of input (errno 0) or on error. Without a terminal
+this is getline(3) on stdin. */
+ssize_t lineedit_read (const char *prompt, char **linep, size_t *sizep);
+
+
+/* Close the history file and free the history. */
+void lineedit_close (void);
+
+#endif  /* LINEEDIT_H */
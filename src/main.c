@@ -8,8 +8,19 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <signal.h>
+#include <errno.h>
 #include "string_parser.h"
 #include "cli.h"
+#include "arena.h"
+#include "output.h"
+#include "pool.h"
+#include "stats.h"
+#include "session.h"
+#include "jobs.h"
+#include "server.h"
+#include "compile.h"
+#include "durable.h"
 #define _GNU_SOURCE
 
 
@@ -18,38 +29,121 @@
 
 int main(int argc, char *argv[])
 {
-    FILE *output_stream;    // Output stream for file mode.
     int flags, opt;        
     char *filename;         // The batch file for file mode.
+    char *socket_path;      // The socket for server mode.
+    int show_allocs;        // Print allocation counters on exit (-m).
+    int jobs;               // Worker threads for multi-file commands (-j).
+    char *end;              // End of the -j number.
+    const char *usage[3];   // Usage message, written as one line.
+    STATS_FORMAT format;    // Format of the -p dump.
+    session shell;          // Working directory of the shell.
 
     flags = 0;
+    filename = socket_path = NULL;
+    show_allocs = 0;
 
-    while ((opt = getopt(argc, argv, "f:")) != -1) {
+    while ((opt = getopt(argc, argv, "f:s:c:d:mj:p::")) != -1) {
         switch (opt) {
         case 'f':
             flags = 1;
             filename = optarg;     // Filename is the next arg after -f option.
             break;
+        case 's':
+            flags = 2;
+            socket_path = optarg;
+            break;
+        case 'c':
+            flags = 3;
+            filename = optarg;             // The batch file to compile.
+            break;
+        case 'd':
+            if (durable_set_level(optarg) == -1)
+                goto error;
+            break;
+        case 'm':
+            show_allocs = 1;
+            break;
+        case 'j':
+            jobs = strtol(optarg, &end, 10);
+            if (*end != '\0' || jobs < 1)
+                goto error;
+            pool_configure(jobs);
+            break;
+        case 'p':
+            if (optarg == NULL || strcmp(optarg, "text") == 0)
+                format = STATS_TEXT;
+            else if (strcmp(optarg, "json") == 0)
+                format = STATS_JSON;
+            else
+                goto error;
+            stats_start(format);
+            break;
         default: /* '?' */
             goto error;
         }
     }
  
-    if (optind != argc || argc > 3)    // Only allow up to 3 args and 1 option.
+    if (optind != argc)                         // No operands, only options.
         goto error;
 
+    if ((usage[0] = check_builtins()) != NULL) {   // builtins.def is wrong.
+        usage[1] = ": len, first or last in builtins.def does not match\n";
+        err_write(usage, 2);
+        exit(EXIT_FAILURE);
+    }
+    if (session_init(&shell) == -1) {
+        usage[0] = argv[0];
+        usage[1] = ": cannot open the working directory\n";
+        err_write(usage, 2);
+        exit(EXIT_FAILURE);
+    }
+    current_session = &shell;
+    signal(SIGPIPE, SIG_IGN);   // A closed pipe is an EPIPE, not our death.
+
     if (flags == 0) {
         interactive_mode();
+        jobs_shutdown();            // Jobs still running finish first.
+        out_flush();
+        durable_commit();
     } else if (flags == 1) {
-        output_stream = freopen("output.txt", "w", stdout);
+        if (durable_output_open() == -1) {
+            print_syserr(errno, OUTPUT_FILE);
+            exit(EXIT_FAILURE);
+        }
         file_mode(filename);
-        fclose(output_stream);
+        jobs_shutdown();
+        out_flush();
+        if (durable_commit() != NULL || durable_output_close() == -1) {
+            print_syserr(errno, OUTPUT_FILE);
+            exit(EXIT_FAILURE);
+        }
+    } else if (flags == 2) {
+        if (server_run(socket_path) == -1) {
+            print_syserr(errno, socket_path);
+            exit(EXIT_FAILURE);
+        }
+        jobs_shutdown();
+        out_flush();
+        durable_commit();
+    } else if (flags == 3) {
+        if (compile_batch(filename) == -1) {
+            print_syserr(errno, filename);
+            exit(EXIT_FAILURE);
+        }
     }
+    pool_shutdown();
+    session_free(&shell);
+    if (show_allocs)
+        print_alloc_stats(STDERR);
+    stats_exit();
     exit(EXIT_SUCCESS);
 
     error:
-    write(STDERR, "Usuage: ", 8);
-    write(STDERR, argv[0], strlen(argv[0]));
-    write(STDERR, " [-f filename]\n", 16);
+    usage[0] = "Usuage: ";
+    usage[1] = argv[0];
+    usage[2] = " [-f filename | -c filename | -s socket] [-d level] [-m]"
+                " [-j threads] [-p[json]]\n";
+    err_write(usage, 3);
     exit(EXIT_FAILURE);
 }   /* main */
\ No newline at end of file
@@ -0,0 +1,184 @@
+/*
+ *  output.c
+ *
+ *  Author: Joseph Erlinger
+ *      Created on: October 17, 2026
+ */
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/uio.h>
+#include "output.h"
+#include "arena.h"
+
+
+#define STDOUT 1
+#define STDERR 2
+#define MAX_PARTS 8             // Most strings err_write() will coalesce.
+
+
+/* A buffer in front of a descriptor. */
+struct output {
+    char *buf;              // OUT_BUFSIZ bytes.
+    size_t len;             // # Bytes waiting in buf.
+    int fd;                 // Where buf is flushed to.
+};
+
+
+static char shell_buf[OUT_BUFSIZ];
+static output shell_output = {shell_buf, 0, STDOUT};
+
+/* Every thread starts out writing to the shell's stdout; a job's thread
+switches to the job's own output. */
+static __thread output *out = &shell_output;
+
+
+/* writev(2) until every byte has been written. Write errors are dropped, as
+there is nowhere left to report them. */
+static void writev_all (int fd, struct iovec *iov, int iovcnt)
+{
+    ssize_t n;              // # Bytes written by the last call.
+    int saved_errno;        // Output errors must not fail the next command.
+
+    saved_errno = errno;
+    while (iovcnt > 0) {
+        n = writev(fd, iov, iovcnt);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n == -1)
+            break;
+        while (iovcnt > 0 && (size_t) n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char *) iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    errno = saved_errno;
+}   /* writev_all */
+
+
+void out_write (const char *data, size_t len)
+{
+    struct iovec iov[2];    // Buffered bytes followed by data.
+
+    if (out->len + len <= OUT_BUFSIZ) {
+        memcpy(out->buf + out->len, data, len);
+        out->len += len;
+        return;
+    }
+    if (len >= OUT_BUFSIZ / 2) {                 // Too big to copy: writev.
+        iov[0].iov_base = out->buf;
+        iov[0].iov_len = out->len;
+        iov[1].iov_base = (void *) data;
+        iov[1].iov_len = len;
+        writev_all(out->fd, iov, 2);
+        out->len = 0;
+        return;
+    }
+    out_flush();
+    memcpy(out->buf, data, len);
+    out->len = len;
+}   /* out_write */
+
+
+void out_write_direct (const char *data, size_t len)
+{
+    struct iovec iov[2];    // Buffered bytes followed by data.
+
+    iov[0].iov_base = out->buf;
+    iov[0].iov_len = out->len;
+    iov[1].iov_base = (void *) data;
+    iov[1].iov_len = len;
+    writev_all(out->fd, iov + (out->len == 0), 2 - (out->len == 0));
+    out->len = 0;
+}   /* out_write_direct */
+
+
+void out_puts (const char *s)
+{
+    out_write(s, strlen(s));
+}   /* out_puts */
+
+
+void out_flush (void)
+{
+    struct iovec iov;
+
+    if (out->len == 0)
+        return;
+    iov.iov_base = out->buf;
+    iov.iov_len = out->len;
+    writev_all(out->fd, &iov, 1);
+    out->len = 0;
+}   /* out_flush */
+
+
+int out_redirect (int fd)
+{
+    int previous;
+
+    out_flush();
+    previous = out->fd;
+    out->fd = fd;
+    return previous;
+}   /* out_redirect */
+
+
+int out_fileno (void)
+{
+    return out->fd;
+}   /* out_fileno */
+
+
+output *out_open (int fd)
+{
+    output *o;
+
+    if ((o = counted_malloc(sizeof(*o) + OUT_BUFSIZ)) == NULL)
+        return NULL;
+    o->buf = (char *) (o + 1);
+    o->len = 0;
+    o->fd = fd;
+    return o;
+}   /* out_open */
+
+
+output *out_select (output *o)
+{
+    output *previous;
+
+    previous = out;
+    out = o != NULL ? o : &shell_output;
+    return previous;
+}   /* out_select */
+
+
+void out_close (output *o)
+{
+    output *previous;
+
+    previous = out_select(o);
+    out_flush();
+    out_select(previous);
+    counted_free(o);
+}   /* out_close */
+
+
+void err_write (const char **parts, int count)
+{
+    struct iovec iov[MAX_PARTS];
+    int i;
+
+    out_flush();
+    if (count > MAX_PARTS)
+        count = MAX_PARTS;
+    for (i = 0; i < count; i++) {
+        iov[i].iov_base = (void *) parts[i];
+        iov[i].iov_len = strlen(parts[i]);
+    }
+    writev_all(STDERR, iov, count);
+}   /* err_write */
@@ -0,0 +1,73 @@
+/*
+ *  output.h
+ *
+ *  Author: Joseph Erlinger
+ *      Created on: October 17, 2026
+ */
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stddef.h>
+
+
+#define OUT_BUFSIZ (64 << 10)   // Flush threshold of the output buffer.
+
+
+/* A buffered output. The functions below write to the calling thread's
+current output, which is the shell's stdout unless out_select() picked
+another one. */
+typedef struct output output;
+
+
+/* Append len bytes to the current output's buffer. The buffer is written when
+it fills up; data too large to be worth copying is written together with
+the buffered bytes in one writev(2). */
+void out_write (const char *data, size_t len);
+
+
+/* Write len bytes after the buffered ones with a single writev(2), without
+copying them. The kernel reads data itself, so a file mapping that shrank
+under it makes the write fail instead of raising SIGBUS. */
+void out_write_direct (const char *data, size_t len);
+
+
+/* Append a NUL terminated string. */
+void out_puts (const char *s);
+
+
+/* Write everything buffered so far to the output's descriptor. Must be
+called before exit, before reading interactive input, and before anything
+else writes to the descriptor directly. */
+void out_flush (void);
+
+
+/* Send the shell's output to fd from now on (a pipe, for a builtin inside
+a pipeline), after flushing what was written so far to the old one.
+Returns the old descriptor, so the caller can switch back. */
+int out_redirect (int fd);
+
+
+/* The descriptor output currently goes to, for builtins that bypass the
+buffer (cat). */
+int out_fileno (void);
+
+
+/* A new output buffering in front of fd (which it does not own). Returns
+NULL if out of memory. */
+output *out_open (int fd);
+
+
+/* Make o (NULL for the shell's stdout) the calling thread's output.
+Nothing is flushed. Returns the output that was current. */
+output *out_select (output *o);
+
+
+/* Flush o and free it. */
+void out_close (output *o);
+
+
+/* Write count strings to stderr as a single writev(2), after flushing
+stdout so the two streams stay in order. */
+void err_write (const char **parts, int count);
+
+#endif  /* OUTPUT_H */
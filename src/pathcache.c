@@ -0,0 +1,230 @@
+/*
+ *  pathcache.c
+ *
+ *  Author: Joseph Erlinger
+ *      Created on: October 17, 2026
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include "pathcache.h"
+#include "arena.h"
+
+
+#define DEFAULT_PATH "/bin:/usr/bin"    // What execvp(3) uses without $PATH.
+
+
+/* Open addressing with linear probing. An entry's name and path share one
+allocation, which starts at name. */
+typedef struct path_entry {
+    unsigned long hash;
+    char *name;             // NULL for an empty slot.
+    char *path;
+} path_entry;
+
+
+static path_entry *table;
+static size_t nslots;       // A power of two, or 0 before the first insert.
+static size_t used;         // # Slots holding an entry.
+static char *table_path;    // The $PATH the entries were found with.
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;   // Guards it all.
+
+
+/* FNV-1a. */
+static unsigned long hash_name (const char *s)
+{
+    unsigned long h = 14695981039346656037UL;
+
+    for (; *s != '\0'; s++) {
+        h ^= (unsigned char) *s;
+        h *= 1099511628211UL;
+    }
+    return h;
+}   /* hash_name */
+
+
+/* The slot holding name, or the empty slot where it would go. */
+static size_t find_slot (const char *name, unsigned long h)
+{
+    size_t i;
+
+    for (i = h & (nslots - 1); table[i].name != NULL; i = (i + 1) & (nslots - 1))
+        if (table[i].hash == h && strcmp(table[i].name, name) == 0)
+            break;
+    return i;
+}   /* find_slot */
+
+
+/* Double the table (or create it) and rehash every entry. */
+static int grow (void)
+{
+    path_entry *old;
+    size_t old_slots, i, j;
+
+    old = table;
+    old_slots = nslots;
+    nslots = old_slots == 0 ? PATHCACHE_MIN_SLOTS : 2 * old_slots;
+    if ((table = counted_malloc(nslots * sizeof(*table))) == NULL) {
+        table = old;
+        nslots = old_slots;
+        return -1;
+    }
+    memset(table, 0, nslots * sizeof(*table));
+    for (i = 0; i < old_slots; i++) {
+        if (old[i].name == NULL)
+            continue;
+        for (j = old[i].hash & (nslots - 1); table[j].name != NULL;
+             j = (j + 1) & (nslots - 1))
+            ;
+        table[j] = old[i];
+    }
+    counted_free(old);
+    return 0;
+}   /* grow */
+
+
+/* Empty slot i, moving later entries of the same probe run back into the
+hole so that lookups never need tombstones. */
+static void remove_slot (size_t i)
+{
+    size_t j, home, mask;
+    int reachable;          // home lies cyclically in (i, j].
+
+    mask = nslots - 1;
+    counted_free(table[i].name);
+    for (j = (i + 1) & mask; table[j].name != NULL; j = (j + 1) & mask) {
+        home = table[j].hash & mask;
+        reachable = i <= j ? (i < home && home <= j) : (i < home || home <= j);
+        if (!reachable) {
+            table[i] = table[j];
+            i = j;
+        }
+    }
+    table[i].name = NULL;
+    used--;
+}   /* remove_slot */
+
+
+/* Search the absolute directories of path for an executable regular file
+called name, writing its path into buf. Empty and relative entries are
+skipped: their meaning changes with every cd, so they cannot be cached. */
+static int search (const char *path, const char *name, char *buf)
+{
+    const char *dir, *end;
+    struct stat sb;
+    size_t dlen, nlen;
+
+    nlen = strlen(name);
+    for (dir = path; *dir != '\0'; dir = *end == ':' ? end + 1 : end) {
+        end = strchrnul(dir, ':');
+        dlen = end - dir;
+        if (dlen == 0 || dir[0] != '/' || dlen + nlen + 2 > PATH_MAX)
+            continue;
+        memcpy(buf, dir, dlen);
+        buf[dlen] = '/';
+        memcpy(buf + dlen + 1, name, nlen + 1);
+        if (stat(buf, &sb) == 0 && S_ISREG(sb.st_mode)
+            && faccessat(AT_FDCWD, buf, X_OK, AT_EACCESS) == 0)
+            return 0;
+    }
+    return -1;
+}   /* search */
+
+
+/* Empty the table. Called with the lock held. */
+static void clear (void)
+{
+    size_t i;
+
+    for (i = 0; i < nslots; i++)
+        counted_free(table[i].name);
+    counted_free(table);
+    counted_free(table_path);
+    table = NULL;
+    table_path = NULL;
+    nslots = used = 0;
+}   /* clear */
+
+
+/* The cached path of name, adding it on a miss. Called with the lock held;
+the result is only valid until the lock is dropped. */
+static const char *lookup (const char *name, const char *path)
+{
+    char buf[PATH_MAX];     // Candidate path.
+    unsigned long h;
+    size_t i, nlen, plen;
+    char *entry;
+
+    if (table_path != NULL && strcmp(table_path, path) != 0)
+        clear();                                        // $PATH has changed.
+    if (table_path == NULL) {
+        if ((table_path = counted_malloc(strlen(path) + 1)) == NULL)
+            return NULL;
+        strcpy(table_path, path);
+    }
+
+    h = hash_name(name);
+    if (nslots > 0 && table[i = find_slot(name, h)].name != NULL)
+        return table[i].path;                                   // Cache hit.
+
+    if (search(path, name, buf) == -1) {
+        errno = ENOENT;
+        return NULL;
+    }
+    if ((used + 1) * 2 > nslots && grow() == -1)
+        return NULL;
+    nlen = strlen(name) + 1;
+    plen = strlen(buf) + 1;
+    if ((entry = counted_malloc(nlen + plen)) == NULL)
+        return NULL;
+    i = find_slot(name, h);
+    table[i].hash = h;
+    table[i].name = memcpy(entry, name, nlen);
+    table[i].path = memcpy(entry + nlen, buf, plen);
+    used++;
+    return table[i].path;
+}   /* lookup */
+
+
+const char *pathcache_lookup (const char *name)
+{
+    const char *path;       // $PATH.
+    const char *found;
+    char *copy;
+
+    if (strchr(name, '/') != NULL)
+        return name;
+    if ((path = getenv("PATH")) == NULL)
+        path = DEFAULT_PATH;
+    pthread_mutex_lock(&lock);
+    found = lookup(name, path);
+    copy = found != NULL ? arena_strdup(&line_arena, found) : NULL;
+    pthread_mutex_unlock(&lock);
+    return copy;
+}   /* pathcache_lookup */
+
+
+void pathcache_forget (const char *name)
+{
+    size_t i;
+
+    pthread_mutex_lock(&lock);
+    if (nslots > 0 && table[i = find_slot(name, hash_name(name))].name != NULL)
+        remove_slot(i);
+    pthread_mutex_unlock(&lock);
+}   /* pathcache_forget */
+
+
+void pathcache_clear (void)
+{
+    pthread_mutex_lock(&lock);
+    clear();
+    pthread_mutex_unlock(&lock);
+}   /* pathcache_clear */
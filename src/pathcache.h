@@ -0,0 +1,30 @@
+/*
+ *  pathcache.h
+ *
+ *  Author: Joseph Erlinger
+ *      Created on: October 17, 2026
+ */
+#ifndef PATHCACHE_H
+#define PATHCACHE_H
+
+
+#define PATHCACHE_MIN_SLOTS 64  // Initial size of the hash table.
+
+
+/* Find the program name would run: name itself if it contains a '/',
+otherwise the first executable regular file called name in a directory of
+$PATH. Hits are kept in a hash table, which is emptied whenever $PATH no
+longer has the value it was filled with, so only the first run of a program
+searches the directories. Safe to call from any thread. Returns a copy in
+the caller's line arena, or NULL with errno set to ENOENT. */
+const char *pathcache_lookup (const char *name);
+
+
+/* Drop the entry of name, e.g. after the cached file failed to execute. */
+void pathcache_forget (const char *name);
+
+
+/* Free the table. */
+void pathcache_clear (void);
+
+#endif  /* PATHCACHE_H */
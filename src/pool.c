@@ -0,0 +1,201 @@
+/*
+ *  pool.c
+ *
+ *  Author: Joseph Erlinger
+ *      Created on: October 17, 2026
+ */
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "pool.h"
+#include "arena.h"
+#include "copy.h"
+#include "session.h"
+#include "uring.h"
+#include "stats.h"
+
+
+typedef struct pool_task {
+    pool_fn fn;
+    void *arg;
+    pool_group *group;
+    session *session;       // Session of the thread that submitted it.
+    stats_sample *stats;    // Measurement of the command it is run for.
+} pool_task;
+
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t work;        // Signalled when a task is queued.
+    pthread_cond_t done;        // Broadcast when a task finishes.
+    pool_task queue[POOL_QUEUE_SIZE];
+    int head, count;            // Ring buffer of queued tasks.
+    pthread_t *threads;
+    int nthreads;               // Configured size of the pool.
+    int started;                // # Worker threads running.
+    int stopping;
+} pool = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .work = PTHREAD_COND_INITIALIZER,
+    .done = PTHREAD_COND_INITIALIZER,
+};
+
+
+void pool_configure (int nthreads)
+{
+    pool.nthreads = nthreads;
+}   /* pool_configure */
+
+
+int pool_threads (void)
+{
+    long n;
+
+    if (pool.nthreads == 0) {
+        n = sysconf(_SC_NPROCESSORS_ONLN);
+        pool.nthreads = n > 0 ? n : 1;
+    }
+    return pool.nthreads;
+}   /* pool_threads */
+
+
+static __thread int is_worker;      // Set in the pool's own threads.
+static __thread int nesting;        // # Tasks running on this thread.
+
+
+/* Run one task with the lock dropped, then mark it finished. On a worker,
+the temporaries the task took from the thread's line arena are released
+afterwards; a caller running a task keeps them until its line ends. A task
+run while another waits in pool_wait() leaves the arena alone, since the
+waiting task may still be using it. The task runs in the session (working
+directory) it was submitted from, and while statistics are recorded its
+usage is charged to the command that submitted it. */
+static void run_task (pool_task task)
+{
+    session *caller;
+    stats_sample sample;
+    int timed;
+
+    pthread_mutex_unlock(&pool.lock);
+    caller = current_session;
+    current_session = task.session;
+    nesting++;
+    if ((timed = stats_enabled || task.stats != NULL))
+        stats_task_begin(&sample, task.stats);
+    task.fn(task.arg);
+    if (timed)
+        stats_task_end(&sample);
+    nesting--;
+    current_session = caller;
+    if (is_worker && nesting == 0)
+        arena_reset(&line_arena);
+    pthread_mutex_lock(&pool.lock);
+    if (--task.group->pending == 0)
+        pthread_cond_broadcast(&pool.done);
+}   /* run_task */
+
+
+static int dequeue (pool_task *task)
+{
+    if (pool.count == 0)
+        return 0;
+    *task = pool.queue[pool.head];
+    pool.head = (pool.head + 1) % POOL_QUEUE_SIZE;
+    pool.count--;
+    return 1;
+}   /* dequeue */
+
+
+static void *worker (void *unused)
+{
+    pool_task task;
+
+    (void) unused;
+    is_worker = 1;
+    pthread_mutex_lock(&pool.lock);
+    for (;;) {
+        while (pool.count == 0 && !pool.stopping)
+            pthread_cond_wait(&pool.work, &pool.lock);
+        if (!dequeue(&task))
+            break;                                  // Stopping and drained.
+        run_task(task);
+    }
+    pthread_mutex_unlock(&pool.lock);
+    arena_release(&line_arena);
+    copy_release();
+    uring_release();
+    stats_thread_exit();
+    return NULL;
+}   /* worker */
+
+
+/* Start the workers on first use. Called with the lock held. */
+static void start_workers (void)
+{
+    int n;
+
+    n = pool_threads();
+    pool.threads = counted_malloc(n * sizeof(pthread_t));
+    if (pool.threads == NULL)
+        return;
+    for (pool.started = 0; pool.started < n; pool.started++)
+        if (pthread_create(&pool.threads[pool.started], NULL, worker, NULL))
+            break;
+}   /* start_workers */
+
+
+void pool_submit (pool_group *group, pool_fn fn, void *arg)
+{
+    pool_task task;
+
+    task.fn = fn;
+    task.arg = arg;
+    task.group = group;
+    task.session = current_session;
+    task.stats = stats_target();
+
+    pthread_mutex_lock(&pool.lock);
+    group->pending++;
+    if (pool_threads() > 1 && pool.threads == NULL)
+        start_workers();
+    if (pool.started == 0 || pool.count == POOL_QUEUE_SIZE) {
+        run_task(task);                     // No room: the caller runs it.
+    } else {
+        pool.queue[(pool.head + pool.count) % POOL_QUEUE_SIZE] = task;
+        pool.count++;
+        pthread_cond_signal(&pool.work);
+    }
+    pthread_mutex_unlock(&pool.lock);
+}   /* pool_submit */
+
+
+void pool_wait (pool_group *group)
+{
+    pool_task task;
+
+    pthread_mutex_lock(&pool.lock);
+    while (group->pending > 0) {
+        if (dequeue(&task))
+            run_task(task);                 // Help instead of blocking.
+        else
+            pthread_cond_wait(&pool.done, &pool.lock);
+    }
+    pthread_mutex_unlock(&pool.lock);
+}   /* pool_wait */
+
+
+void pool_shutdown (void)
+{
+    int i;
+
+    pthread_mutex_lock(&pool.lock);
+    pool.stopping = 1;
+    pthread_cond_broadcast(&pool.work);
+    pthread_mutex_unlock(&pool.lock);
+    for (i = 0; i < pool.started; i++)
+        pthread_join(pool.threads[i], NULL);
+    counted_free(pool.threads);
+    pool.threads = NULL;
+    pool.started = 0;
+    pool.stopping = 0;
+}   /* pool_shutdown */
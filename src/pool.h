@@ -0,0 +1,45 @@
+/*
+ *  pool.h
+ *
+ *  Author: Joseph Erlinger
+ *      Created on: October 17, 2026
+ */
+#ifndef POOL_H
+#define POOL_H
+
+
+#define POOL_QUEUE_SIZE 1024    // Tasks that can wait for a worker.
+
+
+typedef void (*pool_fn)(void *arg);
+
+
+/* Tasks are submitted as part of a group, and a group can be waited on
+without waiting for anyone else's tasks. */
+typedef struct pool_group {
+    int pending;            // # Tasks submitted but not finished.
+} pool_group;
+
+
+/* Set the number of worker threads (default: # online CPUs). Must be called
+before the first task is submitted. 1 runs every task inline. */
+void pool_configure (int nthreads);
+
+
+int pool_threads (void);
+
+
+/* Queue fn(arg) as part of group. If the queue is full, or the pool has a
+single thread, the task is run by the caller instead. */
+void pool_submit (pool_group *group, pool_fn fn, void *arg);
+
+
+/* Wait until every task of group has finished. The caller runs queued
+tasks while it waits, so waiting from inside a task cannot deadlock. */
+void pool_wait (pool_group *group);
+
+
+/* Stop the workers once the queue is empty. */
+void pool_shutdown (void);
+
+#endif  /* POOL_H */
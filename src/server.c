@@ -0,0 +1,454 @@
+/*
+ *  server.c
+ *
+ *  Author: Joseph Erlinger
+ *      Created on: October 17, 2026
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "server.h"
+#include "cli.h"
+#include "arena.h"
+#include "output.h"
+#include "session.h"
+#include "jobs.h"
+
+
+/* One connection. Its lines are run on the server's thread with the
+connection's session, and the shell's output redirected to a memfd(2) that
+is sent to the socket as fast as the client takes it. The output of its
+background jobs is queued there too, as they finish. */
+typedef struct client {
+    struct client *prev, *next;     // Every open connection.
+    int fd;                 // The socket, non-blocking; -1 once closed.
+    int out;                // memfd(2) queueing the output of its commands.
+    off_t sent;             // # Bytes of out the socket has taken.
+    off_t queued;           // # Bytes in out.
+    uint32_t events;        // What fd is watched for; 0 if not watched.
+    int eof;                // Nothing more to run: close once out is sent.
+    session session;        // Its own working directory.
+    job_list jobs;          // The jobs it started and has not been sent.
+    char *buf;              // Bytes read but not yet run, with room for a NUL.
+    size_t len;             // # Bytes in buf.
+    size_t cap;             // Capacity of buf (excluding the NUL).
+} client;
+
+
+static client *clients;                 // Head of the open connections.
+static int jobs_done = -1;              // eventfd(2) counting finished jobs.
+static volatile sig_atomic_t stopping;  // Set by SIGINT and SIGTERM.
+
+
+static void on_signal (int sig)
+{
+    (void) sig;
+    stopping = 1;
+}   /* on_signal */
+
+
+/* Returns true if nothing is listening at addr anymore. */
+static int is_stale (const struct sockaddr_un *addr)
+{
+    int fd, stale;
+
+    if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) == -1)
+        return 0;
+    stale = connect(fd, (const struct sockaddr *) addr, sizeof(*addr)) == -1
+            && errno == ECONNREFUSED;
+    close(fd);
+    return stale;
+}   /* is_stale */
+
+
+/* A non-blocking listening socket bound to path. */
+static int open_socket (const char *path)
+{
+    struct sockaddr_un addr;
+    int fd, retried, saved_errno;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1)
+        return -1;
+    for (retried = 0;
+         bind(fd, (struct sockaddr *) &addr, sizeof(addr)) == -1;
+         retried = 1) {
+        if (errno != EADDRINUSE || retried)
+            goto fail;
+        if (!is_stale(&addr)) {
+            errno = EADDRINUSE;                 // Another server is using it.
+            goto fail;
+        }
+        unlink(path);
+    }
+    if (listen(fd, SOMAXCONN) == -1)
+        goto fail;
+    return fd;
+
+    fail:
+    saved_errno = errno;
+    close(fd);
+    errno = saved_errno;
+    return -1;
+}   /* open_socket */
+
+
+static void free_client (client *c)
+{
+    if (c->prev != NULL)
+        c->prev->next = c->next;
+    else
+        clients = c->next;
+    if (c->next != NULL)
+        c->next->prev = c->prev;
+    if (c->fd != -1)
+        close(c->fd);                   // Also removes it from the epoll set.
+    close(c->out);
+    session_free(&c->session);
+    counted_free(c->buf);
+    counted_free(c);
+}   /* free_client */
+
+
+/* Start a session for the connection fd in the shell's directory. */
+static int add_client (int epfd, int fd)
+{
+    struct epoll_event ev;
+    client *c;
+
+    if ((c = counted_malloc(sizeof(client))) == NULL)
+        return -1;
+    if ((c->buf = counted_malloc(SERVER_BUFSIZ + 1)) == NULL) {
+        counted_free(c);
+        return -1;
+    }
+    if ((c->out = memfd_create("session", MFD_CLOEXEC)) == -1) {
+        counted_free(c->buf);
+        counted_free(c);
+        return -1;
+    }
+    if (session_copy(&c->session, current_session) == -1) {
+        close(c->out);
+        counted_free(c->buf);
+        counted_free(c);
+        return -1;
+    }
+    c->fd = fd;
+    c->sent = c->queued = 0;
+    c->events = EPOLLIN;
+    c->eof = 0;
+    c->jobs.head = c->jobs.tail = NULL;
+    c->jobs.notify = jobs_done;
+    c->len = 0;
+    c->cap = SERVER_BUFSIZ;
+    c->prev = NULL;
+    if ((c->next = clients) != NULL)
+        clients->prev = c;
+    clients = c;
+
+    ev.events = EPOLLIN;
+    ev.data.ptr = c;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+        c->fd = -1;                     // The caller closes it.
+        free_client(c);
+        return -1;
+    }
+    return 0;
+}   /* add_client */
+
+
+/* Accept every pending connection. The connections do not block: a
+client that is slow to read its output holds up only itself. */
+static void accept_clients (int epfd, int listen_fd)
+{
+    int fd;
+
+    for (;;) {
+        fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd == -1 && errno == EINTR)
+            continue;
+        if (fd == -1) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK
+                && errno != ECONNABORTED)
+                print_syserr(errno, __func__);
+            return;
+        }
+        if (add_client(epfd, fd) == -1) {
+            print_syserr(errno, __func__);
+            close(fd);
+        }
+    }
+}   /* accept_clients */
+
+
+/* Send as much of c's queued output as the socket takes. While some is
+left, c is watched for EPOLLOUT only, so it sends no new lines before it
+has read the output of the last ones. Returns 0 to keep the connection, or
+-1 once it is done or gone. */
+static int flush_client (int epfd, client *c)
+{
+    struct epoll_event ev;
+    ssize_t n;
+    int op;
+
+    while (c->sent < c->queued) {
+        n = sendfile(c->fd, c->out, &c->sent, c->queued - c->sent);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n == -1 && errno == EAGAIN)
+            break;
+        if (n <= 0)
+            return -1;                      // The client went away.
+    }
+    if (c->sent == c->queued) {
+        if (c->eof && c->jobs.head == NULL)
+            return -1;
+        if (c->queued > 0 && (ftruncate(c->out, 0) == -1
+                              || lseek(c->out, 0, SEEK_SET) == -1)) {
+            print_syserr(errno, __func__);
+            return -1;
+        }
+        c->sent = c->queued = 0;
+    }
+
+    /* At end of file c is left out of the epoll set while it waits for its
+    jobs, or the hung up socket would wake the loop over and over. */
+    if (c->sent < c->queued)
+        ev.events = EPOLLOUT;
+    else
+        ev.events = c->eof ? 0 : EPOLLIN;
+    ev.data.ptr = c;
+    if (ev.events != c->events) {
+        op = c->events == 0 ? EPOLL_CTL_ADD
+                            : ev.events == 0 ? EPOLL_CTL_DEL : EPOLL_CTL_MOD;
+        if (epoll_ctl(epfd, op, c->fd, &ev) == -1) {
+            print_syserr(errno, __func__);
+            return -1;
+        }
+        c->events = ev.events;
+    }
+    return 0;
+}   /* flush_client */
+
+
+/* Queue what was written to c->out since the last call, and send it. */
+static int queue_client (int epfd, client *c)
+{
+    struct stat sb;
+
+    if (fstat(c->out, &sb) == -1) {
+        print_syserr(errno, __func__);
+        return -1;
+    }
+    c->queued = sb.st_size;
+    return flush_client(epfd, c);
+}   /* queue_client */
+
+
+/* Close c once it is done or gone. Jobs it started still write to its
+list and session, so while one is running only the socket is closed, and
+report_jobs() frees c after the last of them. */
+static void drop_client (client *c)
+{
+    if (c->jobs.head == NULL) {
+        free_client(c);
+        return;
+    }
+    if (c->fd != -1) {
+        close(c->fd);                   // Also removes it from the epoll set.
+        c->fd = -1;
+    }
+}   /* drop_client */
+
+
+/* Queue the output of every job that has finished into the connection
+that started it. Jobs still running are left for the next wakeup, so the
+loop never waits for one. */
+static void report_jobs (int epfd)
+{
+    eventfd_t count;
+    client *c, *next;
+    job_list *shell;        // The server's own jobs.
+    int previous;           // The shell's output descriptor.
+
+    if (eventfd_read(jobs_done, &count) == -1 && errno != EAGAIN)
+        print_syserr(errno, __func__);
+    for (c = clients; c != NULL; c = next) {
+        next = c->next;
+        if (c->jobs.head == NULL)
+            continue;
+        previous = out_redirect(c->out);
+        shell = jobs_select(&c->jobs);
+        jobs_report(0);
+        jobs_select(shell);
+        out_redirect(previous);
+        if (c->fd == -1) {                  // Nobody to send them to.
+            if (c->jobs.head == NULL)
+                free_client(c);
+        } else if (queue_client(epfd, c) == -1)
+            drop_client(c);
+    }
+}   /* report_jobs */
+
+
+/* Read what c sent and run its complete lines; at end of file an
+unterminated last line is run too. Background jobs are started in c's list
+and not waited for: report_jobs() queues their output once they finish.
+The output is queued and sent by flush_client(). Returns 0 to keep the
+connection, or -1 once it is done. */
+static int serve_client (int epfd, client *c)
+{
+    session *shell;         // The server's own session.
+    job_list *shell_jobs;
+    SHELL_STATUS opcode;
+    ssize_t nread;
+    size_t done;            // # Bytes of complete lines executed.
+    char *grown;
+    int previous;           // The shell's output descriptor.
+    int eof;
+
+    if (c->len == c->cap) {                 // A single line fills the buffer.
+        if ((grown = counted_realloc(c->buf, 2 * c->cap + 1)) == NULL) {
+            print_syserr(errno, __func__);
+            return -1;
+        }
+        c->buf = grown;
+        c->cap *= 2;
+    }
+    nread = read(c->fd, c->buf + c->len, c->cap - c->len);
+    if (nread == -1 && (errno == EINTR || errno == EAGAIN))
+        return 0;
+    if ((eof = nread <= 0) == 0)
+        c->len += nread;
+
+    shell = current_session;
+    current_session = &c->session;
+    shell_jobs = jobs_select(&c->jobs);
+    previous = out_redirect(c->out);
+    opcode = run_lines(c->buf, c->len, &done);
+    if (opcode != HALTED && eof && done < c->len) {
+        c->buf[c->len] = '\0';
+        opcode = command_line_interface(c->buf + done);
+        done = c->len;
+    }
+    jobs_report(0);
+    out_redirect(previous);
+    jobs_select(shell_jobs);
+    current_session = shell;
+
+    memmove(c->buf, c->buf + done, c->len - done);
+    c->len -= done;
+    c->eof = eof || opcode == HALTED;
+    return queue_client(epfd, c);
+}   /* serve_client */
+
+
+int server_run (const char *path)
+{
+    struct epoll_event events[SERVER_EVENTS];
+    struct epoll_event ev;
+    struct sigaction sa;
+    client *c;
+    int listen_fd, epfd, null_fd;
+    int previous;           // The shell's output descriptor.
+    int n, i, saved_errno;
+
+    /* Sessions read their lines from the socket. A program they start
+    without input gets an empty one instead of blocking the server on its
+    terminal. */
+    if ((null_fd = open("/dev/null", O_RDONLY)) == -1)
+        return -1;
+    if (null_fd != STDIN_FILENO) {
+        n = dup2(null_fd, STDIN_FILENO);
+        saved_errno = errno;
+        close(null_fd);
+        errno = saved_errno;
+        if (n == -1)
+            return -1;
+    }
+    if ((listen_fd = open_socket(path)) == -1)
+        return -1;
+    if ((epfd = epoll_create1(EPOLL_CLOEXEC)) == -1)
+        goto fail;
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;                         // NULL marks the listener.
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, listen_fd, &ev) == -1)
+        goto fail;
+    if ((jobs_done = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1)
+        goto fail;
+    ev.data.ptr = &jobs_done;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, jobs_done, &ev) == -1)
+        goto fail;
+
+    /* No SA_RESTART: the signal interrupts epoll_wait(2). */
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    while (!stopping) {
+        if ((n = epoll_wait(epfd, events, SERVER_EVENTS, -1)) == -1) {
+            if (errno == EINTR)
+                continue;
+            print_syserr(errno, __func__);
+            break;
+        }
+        for (i = 0; i < n; i++) {
+            if ((c = events[i].data.ptr) == NULL)
+                accept_clients(epfd, listen_fd);
+            else if (events[i].data.ptr == &jobs_done)
+                report_jobs(epfd);
+            else if ((c->events == EPOLLOUT ? flush_client(epfd, c)
+                                            : serve_client(epfd, c)) == -1)
+                drop_client(c);
+        }
+    }
+
+    while (clients != NULL) {               // Their jobs finish first.
+        previous = out_redirect(clients->out);
+        jobs_select(&clients->jobs);
+        jobs_report(1);
+        jobs_select(NULL);
+        out_redirect(previous);
+        free_client(clients);
+    }
+    close(jobs_done);
+    jobs_done = -1;
+    close(epfd);
+    close(listen_fd);
+    unlink(path);
+    return 0;
+
+    fail:
+    saved_errno = errno;
+    if (jobs_done != -1) {
+        close(jobs_done);
+        jobs_done = -1;
+    }
+    if (epfd != -1)
+        close(epfd);
+    close(listen_fd);
+    unlink(path);
+    errno = saved_errno;
+    return -1;
+}   /* server_run */
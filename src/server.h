@@ -0,0 +1,27 @@
+/*
+ *  server.h
+ *
+ *  Author: Joseph Erlinger
+ *      Created on: October 17, 2026
+ */
+#ifndef SERVER_H
+#define SERVER_H
+
+
+#define SERVER_EVENTS 64            // Events taken per epoll_wait(2).
+#define SERVER_BUFSIZ 4096          // Initial read buffer of a connection.
+
+
+/* Serve shell sessions on the Unix domain socket at path until SIGINT or
+SIGTERM. Every connection is a session of its own, with its own working
+directory (starting in the shell's) and its output going back over the
+connection; the lines it sends are run like a batch file, and exit ends the
+session, not the server. One epoll(7) loop serves every connection, so a
+session costs an accept(2) instead of a process. Output is queued per
+connection and sent as the client reads it, and the server's stdin becomes
+/dev/null for the programs sessions start. A stale socket left at
+path by a server that is gone is replaced. Returns 0, or -1 with errno set
+if the socket could not be set up. */
+int server_run (const char *path);
+
+#endif  /* SERVER_H */
@@ -0,0 +1,250 @@
+/*
+ *  session.c
+ *
+ *  Author: Joseph Erlinger
+ *      Created on: October 17, 2026
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/openat2.h>
+#include "session.h"
+#include "arena.h"
+
+
+#define DIR_FLAGS (O_PATH | O_DIRECTORY | O_CLOEXEC)
+
+
+__thread session *current_session;
+
+
+int session_fd (void)
+{
+    return current_session->dirfd;
+}   /* session_fd */
+
+
+/* Write the logical path of path, taken relative to base (an absolute,
+normalized path of base_len bytes) unless it is absolute itself, into out.
+"." and empty components are dropped and ".." removes the component before
+it. out needs room for base_len + strlen(path) + 2 bytes. Returns the
+length of the result. */
+static size_t normalize (const char *base, size_t base_len, const char *path,
+                         char *out)
+{
+    const char *comp, *end; // The current component of path.
+    size_t len, n;          // Length of out, and of the component.
+
+    len = 0;
+    if (path[0] != '/') {
+        memcpy(out, base, base_len);
+        len = base_len;
+    }
+    for (comp = path; *comp != '\0'; comp = end) {
+        while (*comp == '/')
+            comp++;
+        for (end = comp; *end != '\0' && *end != '/'; end++)
+            ;
+        n = end - comp;
+        if (n == 0 || (n == 1 && comp[0] == '.'))
+            continue;
+        if (n == 2 && comp[0] == '.' && comp[1] == '.') {
+            while (len > 0 && out[len-1] != '/')
+                len--;                          // Drop the last component...
+            if (len > 0)
+                len--;                          // ...and the '/' before it.
+            continue;
+        }
+        if (len == 1)
+            len = 0;                            // out was "/".
+        out[len++] = '/';
+        memcpy(out + len, comp, n);
+        len += n;
+    }
+    if (len == 0)
+        out[len++] = '/';
+    out[len] = '\0';
+    return len;
+}   /* normalize */
+
+
+/* Returns true if path has a ".." component. */
+static int has_dotdot (const char *path)
+{
+    const char *p;
+
+    for (p = path; (p = strstr(p, "..")) != NULL; p += 2)
+        if ((p == path || p[-1] == '/') && (p[2] == '\0' || p[2] == '/'))
+            return 1;
+    return 0;
+}   /* has_dotdot */
+
+
+/* Open the directory path relative to dirfd, refusing to pass through a
+symbolic link (ELOOP). Kernels without openat2(2) report ENOSYS. */
+static int open_no_symlinks (int dirfd, const char *path)
+{
+    struct open_how how;
+
+    memset(&how, 0, sizeof(how));
+    how.flags = DIR_FLAGS;
+    how.resolve = RESOLVE_NO_SYMLINKS;
+    return syscall(SYS_openat2, dirfd, path, &how, sizeof(how));
+}   /* open_no_symlinks */
+
+
+/* Make s->cwd the len bytes of path. */
+static int set_cwd (session *s, const char *path, size_t len)
+{
+    char *grown;
+
+    if (len + 1 > s->cap) {
+        if ((grown = counted_realloc(s->cwd, len + 1)) == NULL)
+            return -1;
+        s->cwd = grown;
+        s->cap = len + 1;
+    }
+    memcpy(s->cwd, path, len + 1);
+    s->len = len;
+    return 0;
+}   /* set_cwd */
+
+
+int session_init (session *s)
+{
+    char buf[PATH_MAX];     // The starting directory, normalized.
+    struct stat here, there;
+    const char *pwd;
+    size_t len;
+    int fd;
+
+    s->cwd = NULL;
+    s->len = s->cap = 0;
+    if ((s->dirfd = open(".", DIR_FLAGS)) == -1)
+        return -1;
+
+    /* A shell started from a symlinked directory inherits its name in
+    $PWD; getcwd(3) only knows the physical path. */
+    pwd = getenv("PWD");
+    if (pwd != NULL && pwd[0] == '/' && strlen(pwd) < sizeof(buf)
+        && (len = normalize("", 0, pwd, buf)) > 0
+        && stat(buf, &there) == 0 && fstat(s->dirfd, &here) == 0
+        && here.st_dev == there.st_dev && here.st_ino == there.st_ino) {
+        /* $PWD is usable. */
+    } else if (getcwd(buf, sizeof(buf)) != NULL) {
+        len = strlen(buf);
+    } else {
+        return -1;
+    }
+    if (set_cwd(s, buf, len) == -1)
+        return -1;
+
+    fd = open_no_symlinks(AT_FDCWD, s->cwd);
+    s->physical = fd != -1;
+    if (fd != -1)
+        close(fd);
+    return 0;
+}   /* session_init */
+
+
+int session_copy (session *dst, const session *src)
+{
+    dst->cwd = NULL;
+    dst->len = dst->cap = 0;
+    dst->physical = src->physical;
+    if ((dst->dirfd = fcntl(src->dirfd, F_DUPFD_CLOEXEC, 0)) == -1)
+        return -1;
+    if (set_cwd(dst, src->cwd, src->len) == -1) {
+        session_free(dst);
+        return -1;
+    }
+    return 0;
+}   /* session_copy */
+
+
+void session_free (session *s)
+{
+    if (s->dirfd != -1)
+        close(s->dirfd);
+    counted_free(s->cwd);
+    s->cwd = NULL;
+    s->dirfd = -1;
+}   /* session_free */
+
+
+int session_chdir (session *s, const char *path)
+{
+    char *logical;          // Where path leads logically.
+    size_t len;             // strlen(logical).
+    int direct;             // Open path relative to the current directory.
+    int dotdot;             // path has a ".." component.
+    int fd;                 // The new working directory.
+    int physical;           // No symbolic link was crossed to reach it.
+    int saved_errno;        // errno on entry, restored on success.
+
+    saved_errno = errno;
+    if (path[0] == '\0') {
+        errno = ENOENT;
+        return -1;
+    }
+    logical = arena_alloc(&line_arena, s->len + strlen(path) + 2);
+    if (logical == NULL)
+        return -1;
+    len = normalize(s->cwd, s->len, path, logical);
+
+    /* Resolving path from the current directory is incremental and gives
+    the logical result, unless a ".." backs out of a symbolic link: the
+    kernel's ".." is then the parent of the link's target. So when the
+    current path went through a link, a path with ".." is opened by its
+    logical name from the root instead. */
+    dotdot = has_dotdot(path);
+    direct = path[0] != '/' && (s->physical || !dotdot);
+    fd = open_no_symlinks(direct ? s->dirfd : AT_FDCWD,
+                          direct ? path : logical);
+    physical = fd != -1 && (!direct || s->physical);
+    if (fd == -1 && (errno == ELOOP || errno == ENOSYS)) {
+        if (direct && !dotdot)
+            fd = openat(s->dirfd, path, DIR_FLAGS);
+        else
+            fd = open(logical, DIR_FLAGS);
+    }
+    if (fd == -1)
+        return -1;                                            // Exit on error.
+    if (set_cwd(s, logical, len) == -1) {
+        close(fd);
+        return -1;                                            // Exit on error.
+    }
+    close(s->dirfd);
+    s->dirfd = fd;
+    s->physical = physical;
+    errno = saved_errno;            // The fallback's ELOOP is not an error.
+    return 0;
+}   /* session_chdir */
+
+
+char *session_physical (const session *s, char *buf, size_t size)
+{
+    char link[32];          // "/proc/self/fd/<dirfd>".
+    ssize_t n;
+
+    if (s->physical && s->len < size) {
+        memcpy(buf, s->cwd, s->len + 1);
+        return buf;
+    }
+    snprintf(link, sizeof(link), "/proc/self/fd/%d", s->dirfd);
+    if ((n = readlink(link, buf, size - 1)) == -1)
+        return NULL;
+    if ((size_t) n == size - 1) {
+        errno = ENAMETOOLONG;
+        return NULL;
+    }
+    buf[n] = '\0';
+    return buf;
+}   /* session_physical */
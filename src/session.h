@@ -0,0 +1,57 @@
+/*
+ *  session.h
+ *
+ *  Author: Joseph Erlinger
+ *      Created on: October 17, 2026
+ */
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <stddef.h>
+
+
+/* The working directory of one shell session. Builtins resolve relative
+paths with *at(2) syscalls against dirfd instead of the process's cwd, and
+pwd prints the cached logical path without asking the kernel. */
+typedef struct session {
+    int dirfd;              // O_PATH descriptor of the working directory.
+    char *cwd;              // Its logical path, absolute and normalized.
+    size_t len;             // strlen(cwd).
+    size_t cap;             // Size of the cwd buffer.
+    int physical;           // cwd goes through no symbolic link, so the
+                            //   kernel's ".." agrees with the logical one.
+} session;
+
+
+/* The session whose commands this thread is running. Pool tasks run with
+the session of the thread that submitted them. */
+extern __thread session *current_session;
+
+
+/* Start s in the process's working directory, taking its logical path from
+$PWD when that names the same directory. Returns 0, or -1 with errno set. */
+int session_init (session *s);
+
+
+/* Start dst in the working directory of src, for a job whose cd must not
+move the shell. Returns 0, or -1 with errno set. */
+int session_copy (session *dst, const session *src);
+
+
+void session_free (session *s);
+
+
+/* The directory relative paths are resolved against. */
+int session_fd (void);
+
+
+/* cd: resolve path logically (".." drops the last component of the cached
+path) and move s there. Returns 0, or -1 with errno set and s unchanged. */
+int session_chdir (session *s, const char *path);
+
+
+/* Write the physical path of the working directory (pwd -P) into buf.
+Returns buf, or NULL with errno set. */
+char *session_physical (const session *s, char *buf, size_t size);
+
+#endif  /* SESSION_H */
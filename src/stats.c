@@ -0,0 +1,379 @@
+/*
+ *  stats.c
+ *
+ *  Author: Joseph Erlinger
+ *      Created on: October 17, 2026
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include "stats.h"
+#include "cli.h"
+#include "output.h"
+
+
+#define STDOUT 1
+#define STDERR 2
+#define IO_BUFSIZ 512       // /proc/self/io is about 150 bytes.
+
+
+int stats_enabled;                          // Set by -p or "stats on".
+static STATS_FORMAT exit_format;            // Format of the dump at exit.
+static int dump_at_exit;                    // Collection was ever turned on.
+static cmd_stats table[BUILTIN_SLOTS];      // Indexed like BUILTIN_TABLE.
+
+static __thread int io_fd = -1;             // /proc/thread-self/io, kept open.
+static __thread long io_reads;              // Our own reads of it, and their
+static __thread long io_bytes;              //   bytes, taken out of syscr and
+                                            //   rchar again.
+static __thread stats_sample *frame;        // Innermost measurement.
+
+
+void stats_start (STATS_FORMAT format)
+{
+    exit_format = format;
+    dump_at_exit = 1;
+    stats_enabled = 1;
+}   /* stats_start */
+
+
+void stats_stop (void)
+{
+    stats_enabled = 0;
+}   /* stats_stop */
+
+
+void stats_reset (void)
+{
+    memset(table, 0, sizeof(table));
+}   /* stats_reset */
+
+
+/* Returns the value of the field key ("rchar: ", ...) in the text of
+/proc/thread-self/io, or 0 if it is missing. */
+static long io_field (const char *text, const char *key)
+{
+    const char *p;
+
+    p = strstr(text, key);
+    return p == NULL ? 0 : strtol(p + strlen(key), NULL, 10);
+}   /* io_field */
+
+
+/* Read the calling thread's CPU time and I/O counters into u, and the wall
+clock into *wall unless it is NULL. The two clocks are read last and next
+to each other, in the same order at the start and at the end, so CPU time
+and wall time cover the same span. Each read of /proc/thread-self/io is
+counted by the kernel too (one read-like call of the returned length), so
+the ones made so far are taken out. */
+static void read_usage (stats_usage *u, struct timespec *wall)
+{
+    struct timespec cpu;
+    char buf[IO_BUFSIZ];
+    ssize_t n;
+
+    memset(u, 0, sizeof(*u));
+    if (io_fd == -1)
+        io_fd = open("/proc/thread-self/io", O_RDONLY | O_CLOEXEC);
+    if (io_fd != -1 && (n = pread(io_fd, buf, sizeof(buf) - 1, 0)) > 0) {
+        buf[n] = '\0';
+        u->rchar = io_field(buf, "rchar: ") - io_bytes;
+        u->wchar = io_field(buf, "wchar: ");
+        u->syscr = io_field(buf, "syscr: ") - io_reads;
+        u->syscw = io_field(buf, "syscw: ");
+        io_reads++;
+        io_bytes += n;
+    }
+    if (wall != NULL)
+        clock_gettime(CLOCK_MONOTONIC, wall);
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu);
+    u->cpu_ns = cpu.tv_sec * 1000000000L + cpu.tv_nsec;
+}   /* read_usage */
+
+
+/* Add the usage d (times sign) to s->moved. */
+static void move_usage (stats_sample *s, const stats_usage *d, long sign)
+{
+    __atomic_fetch_add(&s->moved.cpu_ns, sign * d->cpu_ns, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&s->moved.rchar, sign * d->rchar, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&s->moved.wchar, sign * d->wchar, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&s->moved.syscr, sign * d->syscr, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&s->moved.syscw, sign * d->syscw, __ATOMIC_RELAXED);
+}   /* move_usage */
+
+
+/* Start measuring s on this thread, charged to target, and read the wall
+clock into *wall unless it is NULL. */
+static void open_frame (stats_sample *s, stats_sample *target,
+                        struct timespec *wall)
+{
+    memset(&s->moved, 0, sizeof(s->moved));
+    s->target = target;
+    s->outer = frame;
+    frame = s;
+    read_usage(&s->start, wall);
+}   /* open_frame */
+
+
+/* Stop measuring s and put in d what this thread used meanwhile, less what
+measurements inside it took for themselves. That usage belongs to s alone,
+so it is taken away from the enclosing measurement. The wall clock is read
+into *wall unless it is NULL. */
+static void close_frame (stats_sample *s, stats_usage *d,
+                         struct timespec *wall)
+{
+    stats_usage now;
+
+    read_usage(&now, wall);
+    d->cpu_ns = now.cpu_ns - s->start.cpu_ns;
+    d->rchar = now.rchar - s->start.rchar;
+    d->wchar = now.wchar - s->start.wchar;
+    d->syscr = now.syscr - s->start.syscr;
+    d->syscw = now.syscw - s->start.syscw;
+    frame = s->outer;
+    if (frame != NULL)
+        move_usage(frame, d, -1);
+}   /* close_frame */
+
+
+void stats_begin (stats_sample *s)
+{
+    int saved_errno;
+
+    saved_errno = errno;
+    out_flush();                        // Earlier output is not ours.
+    open_frame(s, s, &s->wall);
+    errno = saved_errno;
+}   /* stats_begin */
+
+
+stats_sample *stats_target (void)
+{
+    return frame != NULL ? frame->target : NULL;
+}   /* stats_target */
+
+
+void stats_task_begin (stats_sample *s, stats_sample *target)
+{
+    int saved_errno;
+
+    saved_errno = errno;
+    open_frame(s, target, NULL);
+    errno = saved_errno;
+}   /* stats_task_begin */
+
+
+void stats_task_end (stats_sample *s)
+{
+    stats_usage d;
+    int saved_errno;
+
+    saved_errno = errno;
+    close_frame(s, &d, NULL);
+    d.cpu_ns += s->moved.cpu_ns;        // Less nested tasks' own usage.
+    d.rchar += s->moved.rchar;
+    d.wchar += s->moved.wchar;
+    d.syscr += s->moved.syscr;
+    d.syscw += s->moved.syscw;
+    if (s->target != NULL)
+        move_usage(s->target, &d, 1);
+    errno = saved_errno;
+}   /* stats_task_end */
+
+
+void stats_thread_exit (void)
+{
+    if (io_fd != -1)
+        close(io_fd);
+    io_fd = -1;
+}   /* stats_thread_exit */
+
+
+static unsigned long elapsed_ns (const struct timespec *start,
+                                 const struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) * 1000000000UL
+           + end->tv_nsec - start->tv_nsec;
+}   /* elapsed_ns */
+
+
+/* Log2 bucket of a duration: 0 below one microsecond, otherwise i such
+that the duration in microseconds is in [2^(i-1), 2^i). */
+static int bucket (unsigned long ns)
+{
+    unsigned long us;
+    int i;
+
+    us = ns / 1000;
+    if (us == 0)
+        return 0;
+    i = 64 - __builtin_clzl(us);
+    return i < STATS_BUCKETS ? i : STATS_BUCKETS - 1;
+}   /* bucket */
+
+
+#define ADD(field, n) __atomic_fetch_add(&(field), (n), __ATOMIC_RELAXED)
+
+
+void stats_end (int slot, stats_sample *s, int failed)
+{
+    struct timespec wall;       // The clock now.
+    stats_usage d;              // What the command used.
+    unsigned long wall_ns;
+    cmd_stats *c;
+    int saved_errno;
+
+    saved_errno = errno;
+    out_flush();                        // Its own output is.
+    close_frame(s, &d, &wall);
+    wall_ns = elapsed_ns(&s->wall, &wall);
+    d.cpu_ns += __atomic_load_n(&s->moved.cpu_ns, __ATOMIC_RELAXED);
+    d.rchar += __atomic_load_n(&s->moved.rchar, __ATOMIC_RELAXED);
+    d.wchar += __atomic_load_n(&s->moved.wchar, __ATOMIC_RELAXED);
+    d.syscr += __atomic_load_n(&s->moved.syscr, __ATOMIC_RELAXED);
+    d.syscw += __atomic_load_n(&s->moved.syscw, __ATOMIC_RELAXED);
+
+    c = &table[slot];
+    ADD(c->calls, 1);
+    ADD(c->errors, failed != 0);
+    ADD(c->wall_ns, wall_ns);
+    ADD(c->cpu_ns, d.cpu_ns);
+    ADD(c->wall_hist[bucket(wall_ns)], 1);
+    ADD(c->cpu_hist[bucket(d.cpu_ns)], 1);
+    ADD(c->read_calls, d.syscr);
+    ADD(c->read_bytes, d.rchar);
+    ADD(c->write_calls, d.syscw);
+    ADD(c->write_bytes, d.wchar);
+    errno = saved_errno;
+}   /* stats_end */
+
+
+/* Text form: one line of totals per builtin, then the non-empty buckets of
+each histogram as "<lower bound in us>:<count>". */
+static void print_text (FILE *f)
+{
+    const char *hist_name[2] = {"wall", "cpu"};
+    const unsigned long *hist;
+    const cmd_stats *c;
+    int slot, h, i;
+
+    fprintf(f, "%-8s %10s %8s %12s %12s %14s %14s %11s %11s\n", "command",
+            "calls", "errors", "wall ms", "cpu ms", "read bytes",
+            "write bytes", "read calls", "write calls");
+    for (slot = 0; slot < BUILTIN_SLOTS; slot++) {
+        c = &table[slot];
+        if (c->calls == 0)
+            continue;
+        fprintf(f, "%-8s %10lu %8lu %12.3f %12.3f %14lu %14lu %11lu %11lu\n",
+                BUILTIN_TABLE[slot].name, c->calls, c->errors,
+                c->wall_ns / 1e6, c->cpu_ns / 1e6, c->read_bytes,
+                c->write_bytes, c->read_calls, c->write_calls);
+        for (h = 0; h < 2; h++) {
+            hist = h == 0 ? c->wall_hist : c->cpu_hist;
+            fprintf(f, "  %-4s us", hist_name[h]);
+            for (i = 0; i < STATS_BUCKETS; i++)
+                if (hist[i] != 0)
+                    fprintf(f, " %lu:%lu", i == 0 ? 0 : 1UL << (i - 1),
+                            hist[i]);
+            fprintf(f, "\n");
+        }
+    }
+}   /* print_text */
+
+
+static void print_hist (FILE *f, const char *name, const unsigned long *hist)
+{
+    int i;
+
+    fprintf(f, ", \"%s\": [", name);
+    for (i = 0; i < STATS_BUCKETS; i++)
+        fprintf(f, i == 0 ? "%lu" : ", %lu", hist[i]);
+    fprintf(f, "]");
+}   /* print_hist */
+
+
+/* JSON form: an object per builtin. Histogram entry i counts durations of
+[2^(i-1), 2^i) microseconds, and entry 0 those under one microsecond. */
+static void print_json (FILE *f)
+{
+    const cmd_stats *c;
+    int slot, first;
+
+    fprintf(f, "{\"buckets\": %d, \"commands\": {", STATS_BUCKETS);
+    first = 1;
+    for (slot = 0; slot < BUILTIN_SLOTS; slot++) {
+        c = &table[slot];
+        if (c->calls == 0)
+            continue;
+        fprintf(f, "%s\n  \"%s\": {\"calls\": %lu, \"errors\": %lu, "
+                "\"wall_ns\": %lu, \"cpu_ns\": %lu, \"read_bytes\": %lu, "
+                "\"write_bytes\": %lu, \"read_calls\": %lu, "
+                "\"write_calls\": %lu", first ? "" : ",",
+                BUILTIN_TABLE[slot].name, c->calls, c->errors, c->wall_ns,
+                c->cpu_ns, c->read_bytes, c->write_bytes, c->read_calls,
+                c->write_calls);
+        print_hist(f, "wall_hist_us", c->wall_hist);
+        print_hist(f, "cpu_hist_us", c->cpu_hist);
+        fprintf(f, "}");
+        first = 0;
+    }
+    fprintf(f, "\n}}\n");
+}   /* print_json */
+
+
+void stats_print (int fd, STATS_FORMAT format)
+{
+    FILE *f;                // Collects the dump, so it is written at once.
+    char *text;
+    size_t len;
+    const char *parts[1];
+
+    if ((f = open_memstream(&text, &len)) == NULL)
+        return;
+    if (format == STATS_JSON)
+        print_json(f);
+    else
+        print_text(f);
+    if (fclose(f) != 0)
+        return;
+    parts[0] = text;
+    if (fd == STDOUT)
+        out_write(text, len);
+    else
+        err_write(parts, 1);
+    free(text);
+}   /* stats_print */
+
+
+void stats_exit (void)
+{
+    if (dump_at_exit)
+        stats_print(STDERR, exit_format);
+}   /* stats_exit */
+
+
+/* stats [text|json] prints the counters; stats on|off|reset controls them.
+"on" keeps the exit format chosen by -p (text by default). */
+cmd_result showStats (char **args, int count)
+{
+    if (count > 1)
+        return CMD_USAGE;
+    if (count == 0 || strcmp(args[0], "text") == 0
+        || strcmp(args[0], "json") == 0) {
+        stats_print(STDOUT, count == 1 && args[0][0] == 'j'
+                            ? STATS_JSON : STATS_TEXT);
+    } else if (strcmp(args[0], "on") == 0) {
+        stats_start(exit_format);
+    } else if (strcmp(args[0], "off") == 0) {
+        stats_stop();
+    } else if (strcmp(args[0], "reset") == 0) {
+        stats_reset();
+    } else {
+        return CMD_USAGE;
+    }
+    return CMD_OK;
+}   /* showStats */
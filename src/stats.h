@@ -0,0 +1,114 @@
+/*
+ *  stats.h
+ *
+ *  Author: Joseph Erlinger
+ *      Created on: October 17, 2026
+ */
+#ifndef STATS_H
+#define STATS_H
+
+#include <time.h>
+#include "command.h"
+
+
+#define STATS_BUCKETS 32    // Bucket 0: < 1 us; bucket i: [2^(i-1), 2^i) us.
+
+
+typedef enum STATS_FORMAT {
+    STATS_TEXT,
+    STATS_JSON
+} STATS_FORMAT;
+
+
+/* Counters of one builtin. Every field is updated with an atomic add, so
+commands running on several threads never take a lock to be counted. */
+typedef struct cmd_stats {
+    unsigned long calls;
+    unsigned long errors;               // Calls that returned an error.
+    unsigned long wall_ns;              // Total elapsed time.
+    unsigned long cpu_ns;               // Total CPU time of its threads.
+    unsigned long read_bytes;           // Bytes moved by read-like calls.
+    unsigned long write_bytes;          // Bytes moved by write-like calls.
+    unsigned long read_calls;           // # read-like calls (syscr).
+    unsigned long write_calls;          // # write-like calls (syscw).
+    unsigned long wall_hist[STATS_BUCKETS];
+    unsigned long cpu_hist[STATS_BUCKETS];
+} cmd_stats;
+
+
+/* CPU time and I/O counters of one thread, from CLOCK_THREAD_CPUTIME_ID
+and /proc/thread-self/io. */
+typedef struct stats_usage {
+    long cpu_ns;
+    long rchar, wchar;
+    long syscr, syscw;
+} stats_usage;
+
+
+/* One measurement on a thread: a command, or a pool task run on behalf of
+one. Only the thread's own counters are read, so work of other commands
+(background jobs, other sessions) is not charged to it. A task's usage is
+moved from whatever it ran inside to the command that submitted it. */
+typedef struct stats_sample {
+    struct timespec wall;
+    stats_usage start;                  // The thread's usage at the start.
+    stats_usage moved;                  // Usage credited (or taken away) by
+                                        //   tasks, with atomic adds.
+    struct stats_sample *target;        // The command's sample.
+    struct stats_sample *outer;         // Enclosing measurement, or NULL.
+} stats_sample;
+
+
+extern int stats_enabled;
+
+
+/* Turn collection on (-p or "stats on"), with the counters dumped to stderr
+in format when the shell exits. */
+void stats_start (STATS_FORMAT format);
+
+
+void stats_stop (void);
+
+
+void stats_reset (void);
+
+
+/* Bracket one run of the builtin in slot of BUILTIN_TABLE. Only called
+while stats_enabled is set. The output buffer is flushed at both ends, so
+the command is charged with writing its own output and no one else's. */
+void stats_begin (stats_sample *s);
+
+
+void stats_end (int slot, stats_sample *s, int failed);
+
+
+/* The sample that tasks submitted from this thread are charged to, or
+NULL if nothing is being measured. */
+stats_sample *stats_target (void);
+
+
+/* Bracket one pool task run for target (NULL if its command is not being
+measured). */
+void stats_task_begin (stats_sample *s, stats_sample *target);
+
+
+void stats_task_end (stats_sample *s);
+
+
+/* Close the calling thread's /proc/thread-self/io, before it exits. */
+void stats_thread_exit (void);
+
+
+/* Write the counters of every builtin that has run to fd (stdout through
+the output buffer, or stderr). */
+void stats_print (int fd, STATS_FORMAT format);
+
+
+/* Dump to stderr if collection was turned on. Called once at exit. */
+void stats_exit (void);
+
+
+/* The stats builtin: stats [text|json|on|off|reset]. */
+cmd_result showStats (char **args, int count);
+
+#endif  /* STATS_H */
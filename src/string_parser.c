@@ -8,84 +8,145 @@
 #include <stdlib.h>
 #include <string.h>
 #include "string_parser.h"
+#include "arena.h"
 #define _GUN_SOURCE
 
 
-int count_token (char* buf, const char* delim)
-{	
-	int num_token;
-	int state;
-	int i;
-	
-	// Tokens start at 1 to make space for the NULL argument.
-	num_token = 1;
-	state = 0;
-	i = 0;
-	
-	// Replace any newline characters with NULL.
-	// WARNING: Potential risk of truncating strings.
-	strtok (buf, "\n");
-
-	// Skip all leading delimeters (if any).
-	while (buf[i] == delim[0])
-	{ 
-		i ++;
-	}
-	
-	// Increment tokens if sees a non delimiter after a delimiter.
-	for (i; buf[i] != '\0'; i++) 
-	{
-		if (state == 0 && buf[i] != delim[0])
-		{
-			state = 1;
-			num_token ++;
-		}
-		if (state == 1 && buf[i] == delim[0])
-		{
-			state = 0;
-		}
-	}
+#define TEXT 0
+#define TOKEN_BREAK 1
+#define SEGMENT_BREAK 2
+#define OPERATOR 3
+#define BACKGROUND 4
 
-	return num_token;
+
+// Let c be an operator token, alone or doubled.
+static void add_operator (token_arena* arena, char c, int class)
+{
+	unsigned char u = (unsigned char) c;
+
+	arena->delim_class[u] = class;
+	arena->single[u][0] = c;
+	arena->doubled[u][0] = arena->doubled[u][1] = c;
 }
 
 
-command_line str_filler (char* buf, const char* delim)
+void init_token_arena (token_arena* arena, const char* seg_delim, const char* tok_delim, const char* op_delim, const char* bg_delim)
 {
-	command_line command;
-	char *saveptr;
-	char *token;
-	int i;
+	memset(arena, 0, sizeof(*arena));
+	for (; *op_delim != '\0'; op_delim++)
+		add_operator (arena, *op_delim, OPERATOR);
+	for (; *bg_delim != '\0'; bg_delim++)
+		add_operator (arena, *bg_delim, BACKGROUND);
+	for (; *tok_delim != '\0'; tok_delim++)
+		arena->delim_class[(unsigned char) *tok_delim] = TOKEN_BREAK;
+	for (; *seg_delim != '\0'; seg_delim++)
+		arena->delim_class[(unsigned char) *seg_delim] = SEGMENT_BREAK;
+}
 
-	i = 0;
-	command.num_token = count_token (buf, delim);
-	command.command_list = (char**) malloc (sizeof(char*) * command.num_token);
 
-	token = strtok (buf, delim);
-	while (token != NULL)
-	{
-		// IMPORTANT: duplicate token string.
-		// Otherwise, multiple ptrs will point to same token.
-		command.command_list[i] = strdup (token);
-		token = strtok (NULL, delim);
-		i ++;
-	}
-	// Make last token in the command list NULL (Lab requirement). 
-	command.command_list[i] = NULL;
-	return command;
+// Make room for at least need entries in a growable array.
+static int reserve (void** array, int* capacity, int need, size_t size)
+{
+	void* grown;
+	int n;
+
+	if (need <= *capacity)
+		return 0;
+	n = *capacity > 0 ? *capacity : 16;
+	while (n < need)
+		n *= 2;
+	if ((grown = counted_realloc (*array, n * size)) == NULL)
+		return -1;
+	*array = grown;
+	*capacity = n;
+	return 0;
 }
 
 
-void free_command_line (command_line* command)
+// Close the segment whose tokens start at index start. Empty segments are
+// dropped. The command_list pointer is set once all tokens are known,
+// because the token array may still move while the line is being scanned.
+static int end_segment (token_arena* arena, int* ntok, int start, int background)
 {
+	command_line* seg;
+
+	if (*ntok == start)
+		return 0;
+	if (reserve ((void**) &arena->tokens, &arena->token_capacity, *ntok + 1, sizeof(char*)) == -1
+		|| reserve ((void**) &arena->segments, &arena->segment_capacity, arena->num_segments + 1, sizeof(command_line)) == -1)
+		return -1;
+	arena->tokens[(*ntok)++] = NULL;
+	seg = &arena->segments[arena->num_segments++];
+	seg->num_token = *ntok - start;			// Counts the NULL (Lab requirement).
+	seg->background = background;
+	return 0;
+}
+
+
+int tokenize_line (token_arena* arena, char* buf)
+{
+	const unsigned char* class;
+	unsigned char c;
+	int ntok;			// # Token slots used so far (including NULLs).
+	int start;			// Index of the first token of the current segment.
+	int in_token;
 	int i;
 
-	// Free each token in the command list.
-	for (i = 0; i < command->num_token - 1; i++)
+	class = arena->delim_class;
+	arena->num_segments = 0;
+	ntok = start = in_token = 0;
+
+	for (; (c = (unsigned char) *buf) != '\0'; buf++)
+	{
+		if (class[c] == TEXT)
+		{
+			if (!in_token)
+			{
+				if (reserve ((void**) &arena->tokens, &arena->token_capacity, ntok + 1, sizeof(char*)) == -1)
+					return -1;
+				arena->tokens[ntok++] = buf;
+				in_token = 1;
+			}
+			continue;
+		}
+		*buf = '\0';			// Terminate the token (if any) in place.
+		in_token = 0;
+		if ((class[c] == OPERATOR || class[c] == BACKGROUND) && (unsigned char) buf[1] == c)
+		{
+			if (reserve ((void**) &arena->tokens, &arena->token_capacity, ntok + 1, sizeof(char*)) == -1)
+				return -1;
+			arena->tokens[ntok++] = arena->doubled[c];
+			*++buf = '\0';
+		}
+		else if (class[c] == OPERATOR)
+		{
+			if (reserve ((void**) &arena->tokens, &arena->token_capacity, ntok + 1, sizeof(char*)) == -1)
+				return -1;
+			arena->tokens[ntok++] = arena->single[c];
+		}
+		else if (class[c] == SEGMENT_BREAK || class[c] == BACKGROUND)
+		{
+			if (end_segment (arena, &ntok, start, class[c] == BACKGROUND) == -1)
+				return -1;
+			start = ntok;
+		}
+	}
+	if (end_segment (arena, &ntok, start, 0) == -1)
+		return -1;
+
+	// Segments are stored back to back, each ending in its NULL token.
+	for (i = 0, ntok = 0; i < arena->num_segments; i++)
 	{
-		free (command->command_list[i]);
+		arena->segments[i].command_list = arena->tokens + ntok;
+		ntok += arena->segments[i].num_token;
 	}
+	return arena->num_segments;
+}
 
-	// Free the command list.
-	free (command->command_list); 
+
+void free_token_arena (token_arena* arena)
+{
+	counted_free (arena->tokens);
+	counted_free (arena->segments);
+	memset(arena, 0, sizeof(*arena));
 }
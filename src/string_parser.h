@@ -17,23 +17,55 @@
 #define _GUN_SOURCE
 
 
+// Characters that split a line into commands, and a command into tokens.
+// Operator characters are tokens of their own even without spaces around,
+// and so are two of them in a row ("||"). A background character ends a
+// command like a segment delimiter does, but marks it to run as a job; two
+// of them in a row are an operator ("&&").
+#define SEGMENT_DELIM ";"
+#define TOKEN_DELIM " \t\r\n\v\f"
+#define OPERATOR_DELIM "|"
+#define BACKGROUND_DELIM "&"
+
+
 typedef struct
 {
     char** command_list;
     int num_token;
+    int background;					// Ended by a background character.
 }command_line;
 
-//this functions returns the number of tokens needed for the string array
-//based on the delimeter
-int count_token (char* buf, const char* delim);
 
-//This functions can tokenize a string to token arrays base on a specified delimeter,
-//it returns a struct variable
-command_line str_filler (char* buf, const char* delim);
+//A reusable store for the tokens of one line. The token views point into
+//the tokenized buffer itself, and the arrays only grow, so once they are
+//large enough tokenizing a line does not allocate.
+typedef struct
+{
+    unsigned char delim_class[256];	// 0 = text, 1 = token delim, 2 = segment delim,
+									// 3 = operator, 4 = background.
+    char single[256][2];			// The token of each operator character,
+    char doubled[256][3];			// and of two of them in a row.
+    char** tokens;					// Token views for every segment, NULL separated.
+    int token_capacity;
+    command_line* segments;			// One command_line per non-empty segment.
+    int segment_capacity;
+    int num_segments;
+}token_arena;
+
+
+//Prepare an empty arena that splits segments on any character of seg_delim
+//and tokens on any character of tok_delim. Each character of op_delim is
+//a token by itself (pointing into the arena, not into the line), and each
+//character of bg_delim ends a background segment.
+void init_token_arena (token_arena* arena, const char* seg_delim, const char* tok_delim, const char* op_delim, const char* bg_delim);
 
+//Tokenize buf in a single pass, NUL terminating each token in place. Fills
+//arena->segments and returns the number of segments, or -1 if out of memory.
+//The views stay valid until buf is modified or the arena is reused.
+int tokenize_line (token_arena* arena, char* buf);
 
-//this function safely free all the tokens within the array.
-void free_command_line(command_line* command);
+//this function frees the arrays held by the arena.
+void free_token_arena (token_arena* arena);
 
 
 #endif /* STRING_PARSER_H_ */
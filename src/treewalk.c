@@ -0,0 +1,493 @@
+/*
+ *  treewalk.c
+ *
+ *  Author: Joseph Erlinger
+ *      Created on: October 17, 2026
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include "treewalk.h"
+#include "dirlist.h"
+#include "copy.h"
+#include "arena.h"
+#include "pool.h"
+#include "durable.h"
+
+
+typedef enum { TREE_COPY, TREE_REMOVE } TREE_OP;
+
+
+/* State shared by every directory of one walk. */
+typedef struct tree_walk {
+    TREE_OP op;
+    int flags;              // TREE_FOLLOW.
+    int error;              // First error of the walk, 0 if none.
+    int queued;             // # Directory tasks queued or running.
+    int max_queued;         // Beyond this, directories are walked inline.
+    int held_depth;         // Deeper directories are walked inline with
+                            //   their parent closed (see hold_depth()).
+    dev_t root_dev;         // The destination root of a copy, which is
+    ino_t root_ino;         //   skipped if it turns up inside the source.
+} tree_walk;
+
+
+/* One directory being walked. The parent stays open (and its tree_dir
+alive) until all of its subdirectories are done, except below the walk's
+held_depth, where a directory closes its parent while it is walked and
+reopens it as ".." afterwards. */
+typedef struct tree_dir {
+    tree_walk *walk;
+    struct tree_dir *parent;    // NULL for the root of the walk.
+    int src_parent;         // Directory holding the source.
+    int dst_parent;         // Directory holding the copy (TREE_COPY).
+    const char *name;       // Name in src_parent.
+    const char *dst_name;   // Name in dst_parent (TREE_COPY).
+    int depth;              // 0 for the root of the walk.
+    int src, dst;           // The directory and its copy, -1 when closed.
+    int release;            // Close the parent while walking this one.
+    dev_t dev;              // Identity of the source directory, for
+    ino_t ino;              //   detecting cycles with TREE_FOLLOW.
+    dev_t dst_dev;          // Identity of the copy, known once a
+    ino_t dst_ino;          //   subdirectory has closed it.
+    char storage[];         // Names of a queued directory.
+} tree_dir;
+
+
+static void walk_dir (tree_dir *d);
+
+
+/* Record error_number unless an earlier error was recorded already. */
+static void tree_fail (tree_walk *w, int error_number)
+{
+    int none = 0;
+
+    __atomic_compare_exchange_n(&w->error, &none, error_number, 0,
+                                __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}   /* tree_fail */
+
+
+/* Copy a non-directory entry. Regular files go through the copy engine
+(see copy.c) and are made as durable as cp's (see durable.h); links are
+recreated as links; anything else is recreated with mknodat(2). */
+static void copy_entry (tree_walk *w, int src, const char *name, int dst,
+                        const char *dst_name, unsigned char type)
+{
+    struct stat sb;         // Metadata of the source.
+    char link[PATH_MAX];    // Target of a symbolic link.
+    ssize_t n;              // Length of the link target.
+    int in, out;            // Source and destination of a regular file.
+    char *temp;             // What out is written as (see durable.h).
+    int nofollow;           // O_NOFOLLOW unless links are followed.
+
+    nofollow = w->flags & TREE_FOLLOW ? 0 : O_NOFOLLOW;
+    if (type == DT_LNK) {
+        if ((n = readlinkat(src, name, link, sizeof(link) - 1)) == -1) {
+            tree_fail(w, errno);
+            return;
+        }
+        link[n] = '\0';
+        if (symlinkat(link, dst, dst_name) == -1
+            && (errno != EEXIST || unlinkat(dst, dst_name, 0) == -1
+                || symlinkat(link, dst, dst_name) == -1))
+            tree_fail(w, errno);
+        return;
+    }
+    if (type != DT_REG) {
+        if (fstatat(src, name, &sb, nofollow ? AT_SYMLINK_NOFOLLOW : 0) == -1
+            || mknodat(dst, dst_name, sb.st_mode, sb.st_rdev) == -1)
+            tree_fail(w, errno);
+        return;
+    }
+
+    in = openat(src, name, O_RDONLY | O_CLOEXEC | nofollow);
+    if (in == -1 || fstat(in, &sb) == -1) {
+        tree_fail(w, errno);
+        goto cleanup;
+    }
+    out = durable_create(dst, dst_name, sb.st_mode & 07777, &temp);
+    if (out == -1) {
+        tree_fail(w, errno);
+        goto cleanup;
+    }
+    if (durable_copy(in, out, &sb, NULL) == -1
+        || fchmod(out, sb.st_mode & 07777) == -1) {       // Undo the umask.
+        tree_fail(w, errno);
+        durable_abort(dst, temp);
+    } else if (durable_finish(out, dst, dst_name, temp) != NULL) {
+        tree_fail(w, errno);
+    }
+    close(out);
+
+    cleanup:
+    if (in != -1)
+        close(in);
+}   /* copy_entry */
+
+
+/* Runs on a pool worker. The tree_dir was allocated by visit_subdir(). */
+static void run_dir_task (void *arg)
+{
+    tree_dir *d = arg;
+
+    walk_dir(d);
+    __atomic_sub_fetch(&d->walk->queued, 1, __ATOMIC_RELAXED);
+    counted_free(d);
+}   /* run_dir_task */
+
+
+/* Walk the subdirectory name of parent, as a pool task if the walk has
+room for another, otherwise right away on this thread. Below held_depth it
+is always walked right away, with the parent closed meanwhile; list is the
+parent's listing, which then resumes where it was. */
+static void visit_subdir (tree_dir *parent, pool_group *group, dirlist *list,
+                          const char *name)
+{
+    tree_walk *w = parent->walk;
+    tree_dir *child;        // The subdirectory.
+    tree_dir local;         // The subdirectory, when walked inline.
+    size_t len;             // Size of name, with its '\0'.
+    off_t pos = 0;          // Where the parent's listing resumes.
+
+    if (parent->depth + 1 >= TREE_MAX_DEPTH) {
+        tree_fail(w, ENAMETOOLONG);
+        return;
+    }
+    child = NULL;
+    len = strlen(name) + 1;
+    if (parent->depth + 1 < w->held_depth) {
+        if (__atomic_add_fetch(&w->queued, 1, __ATOMIC_RELAXED)
+            <= w->max_queued)
+            child = counted_malloc(sizeof(tree_dir) + len);
+        if (child == NULL)
+            __atomic_sub_fetch(&w->queued, 1, __ATOMIC_RELAXED);
+    }
+    if (child == NULL)
+        child = &local;
+
+    child->walk = w;
+    child->parent = parent;
+    child->src_parent = parent->src;
+    child->dst_parent = parent->dst;
+    child->depth = parent->depth + 1;
+    child->release = 0;
+    if (child == &local) {
+        child->name = child->dst_name = name;
+        if (child->depth >= w->held_depth
+            && (pos = lseek(parent->src, 0, SEEK_CUR)) != -1)
+            child->release = 1;
+        walk_dir(child);
+        if (child->release) {           // The parent was closed and reopened.
+            list->fd = parent->src;
+            if (parent->src != -1
+                && lseek(parent->src, pos, SEEK_SET) == -1)
+                tree_fail(w, errno);
+        }
+    } else {
+        memcpy(child->storage, name, len);    // name is in the dirlist buf.
+        child->name = child->dst_name = child->storage;
+        pool_submit(group, run_dir_task, child);
+    }
+}   /* visit_subdir */
+
+
+/* Close the parent of d (and of its copy) while d is walked, if d's ".."
+leads back to it; a directory reached through a followed link is walked
+with its parent open. */
+static void release_parent (tree_dir *d)
+{
+    tree_dir *p = d->parent;
+    struct stat sb;
+
+    if (fstatat(d->src, "..", &sb, 0) == -1 || sb.st_dev != p->dev
+        || sb.st_ino != p->ino || (p->dst != -1 && fstat(p->dst, &sb) == -1)) {
+        d->release = 0;
+        return;
+    }
+    if (p->dst != -1) {
+        p->dst_dev = sb.st_dev;
+        p->dst_ino = sb.st_ino;
+        close(p->dst);
+        p->dst = -1;
+    }
+    close(p->src);
+    p->src = -1;
+}   /* release_parent */
+
+
+/* Open the ".." of fd, which must still be the directory dev/ino. Returns
+the descriptor, or -1 with errno set (ENOENT if the tree was moved). */
+static int open_parent (int fd, dev_t dev, ino_t ino)
+{
+    struct stat sb;
+    int up;
+
+    if ((up = openat(fd, "..", O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1)
+        return -1;
+    if (fstat(up, &sb) == 0) {
+        if (sb.st_dev == dev && sb.st_ino == ino)
+            return up;
+        errno = ENOENT;                     // Moved while it was closed.
+    }
+    close(up);
+    return -1;
+}   /* open_parent */
+
+
+/* Reopen what release_parent() closed. Returns 0, or -1 with errno set. */
+static int restore_parent (tree_dir *d)
+{
+    tree_dir *p = d->parent;
+
+    if (p->src == -1 && (p->src = open_parent(d->src, p->dev, p->ino)) == -1)
+        return -1;
+    if (d->dst != -1 && p->dst == -1
+        && (p->dst = open_parent(d->dst, p->dst_dev, p->dst_ino)) == -1)
+        return -1;
+    d->src_parent = p->src;
+    d->dst_parent = p->dst;
+    return 0;
+}   /* restore_parent */
+
+
+/* Open the directory d and, for a copy, the directory it is copied to.
+Returns 0 and fills in the descriptors, or -1 if d is to be skipped (with
+the reason recorded in the walk if it is an error). */
+static int open_dir (tree_dir *d, int *src, int *dst, mode_t *mode)
+{
+    tree_walk *w = d->walk;
+    const tree_dir *a;      // An ancestor of d.
+    struct stat sb;         // Metadata of the source, then the copy.
+    int nofollow;           // O_NOFOLLOW unless links are followed.
+
+    *dst = -1;
+    nofollow = w->flags & TREE_FOLLOW ? 0 : O_NOFOLLOW;
+    *src = openat(d->src_parent, d->name,
+                  O_RDONLY | O_DIRECTORY | O_CLOEXEC | nofollow);
+    if (*src == -1 || fstat(*src, &sb) == -1)
+        goto fail;
+    d->dev = sb.st_dev;
+    d->ino = sb.st_ino;
+    *mode = sb.st_mode & 07777;
+
+    for (a = d->parent; a != NULL; a = a->parent)
+        if (a->dev == d->dev && a->ino == d->ino) {
+            errno = ELOOP;                  // A followed link loops back.
+            goto fail;
+        }
+    if (w->op != TREE_COPY)
+        return 0;
+    if (d->depth > 0 && d->dev == w->root_dev && d->ino == w->root_ino) {
+        close(*src);                        // Never copy the copy into itself.
+        return -1;
+    }
+
+    /* Keep the copy writable until its contents are in, then set its mode. */
+    if (mkdirat(d->dst_parent, d->dst_name, S_IRWXU) == -1 && errno != EEXIST)
+        goto fail;
+    *dst = openat(d->dst_parent, d->dst_name,
+                  O_RDONLY | O_DIRECTORY | O_CLOEXEC | O_NOFOLLOW);
+    if (*dst == -1)
+        goto fail;
+    if (d->depth == 0) {
+        if (fstat(*dst, &sb) == -1)
+            goto fail;
+        w->root_dev = sb.st_dev;
+        w->root_ino = sb.st_ino;
+    }
+    return 0;
+
+    fail:
+    tree_fail(w, errno);
+    if (*src != -1)
+        close(*src);
+    if (*dst != -1)
+        close(*dst);
+    return -1;
+}   /* open_dir */
+
+
+/* Walk one directory: copy or remove its entries, hand its subdirectories
+to visit_subdir(), and once those are done finish the directory itself. */
+static void walk_dir (tree_dir *d)
+{
+    tree_walk *w = d->walk;
+    pool_group group;       // The subdirectories queued from here.
+    dirlist list;           // Entries of the source directory.
+    const char *name;       // The current entry.
+    unsigned char type;     // Its DT_* type.
+    struct stat sb;         // Its metadata, if the type is not known.
+    char *buf;              // Buffer for list.
+    mode_t mode;            // Mode of the source directory.
+    int pass;               // Removal passes over the directory.
+
+    if (open_dir(d, &d->src, &d->dst, &mode) == -1)
+        return;
+    if ((buf = counted_malloc(TREE_BUFSIZ)) == NULL) {
+        tree_fail(w, errno);
+        goto cleanup;
+    }
+
+    group.pending = 0;
+    for (pass = 0; pass < 2; pass++) {
+        if (d->release)
+            release_parent(d);
+        dirlist_init(&list, d->src, buf, TREE_BUFSIZ);
+        while ((name = dirlist_next(&list, &type)) != NULL) {
+            if (name[0] == '.' && (name[1] == '\0'
+                                   || (name[1] == '.' && name[2] == '\0')))
+                continue;
+            if (type == DT_UNKNOWN
+                || (type == DT_LNK && w->flags & TREE_FOLLOW)) {
+                if (fstatat(d->src, name, &sb, w->flags & TREE_FOLLOW
+                            ? 0 : AT_SYMLINK_NOFOLLOW) == -1) {
+                    tree_fail(w, errno);
+                    continue;
+                }
+                type = IFTODT(sb.st_mode);
+            }
+            if (type == DT_DIR) {
+                visit_subdir(d, &group, &list, name);
+                if (d->src == -1)
+                    break;              // It could not be reopened.
+            } else if (w->op == TREE_COPY) {
+                copy_entry(w, d->src, name, d->dst, name, type);
+            } else if (unlinkat(d->src, name, 0) == -1) {
+                tree_fail(w, errno);
+            }
+        }
+        if (list.error != 0)
+            tree_fail(w, list.error);
+        pool_wait(&group);
+        if (d->src == -1)
+            break;
+        if (d->release && restore_parent(d) == -1) {
+            tree_fail(w, errno);
+            break;
+        }
+
+        if (w->op == TREE_COPY) {
+            if (fchmod(d->dst, mode) == -1)
+                tree_fail(w, errno);
+            break;
+        }
+        /* Entries removed while the directory was being read can hide
+        others from getdents(2), so a directory that is still not empty is
+        read once more from the start. After an error it is expected not to
+        be empty, and each level reading twice would be exponential. */
+        if (unlinkat(d->src_parent, d->name, AT_REMOVEDIR) == 0)
+            break;
+        if (errno != ENOTEMPTY || pass > 0 || w->error != 0
+            || lseek(d->src, 0, SEEK_SET) == -1) {
+            tree_fail(w, errno);
+            break;
+        }
+    }
+    counted_free(buf);
+
+    cleanup:
+    if (d->src != -1)
+        close(d->src);
+    if (d->dst != -1)
+        close(d->dst);
+}   /* walk_dir */
+
+
+/* How deep directories stay open while their subdirectories are walked.
+The calling thread and every pool thread may each hold a chain of two
+descriptors per level, and all of them must fit under RLIMIT_NOFILE with
+TREE_FD_RESERVE to spare (and the descriptors a durability level defers). */
+static int hold_depth (void)
+{
+    struct rlimit rl;
+    rlim_t fds;             // Descriptors the chains may use.
+
+    if (getrlimit(RLIMIT_NOFILE, &rl) == -1)
+        return 1;
+    fds = TREE_FD_RESERVE;
+    if (durable_level() != DURABLE_NONE)
+        fds += DURABLE_GROUP_MAX;
+    fds = rl.rlim_cur > fds ? rl.rlim_cur - fds : 0;
+    fds /= 2 * (pool_threads() + 1);
+    if (fds < 1)
+        return 1;
+    return fds > TREE_MAX_DEPTH ? TREE_MAX_DEPTH : (int) fds;
+}   /* hold_depth */
+
+
+static void walk_init (tree_walk *w, TREE_OP op, int flags)
+{
+    w->op = op;
+    w->flags = flags;
+    w->error = 0;
+    w->queued = 0;
+    w->max_queued = TREE_TASKS_PER_THREAD * pool_threads();
+    w->held_depth = hold_depth();
+    w->root_dev = 0;
+    w->root_ino = 0;
+}   /* walk_init */
+
+
+/* Walk the root directory of w, then report the first error. */
+static int walk_root (tree_walk *w, int src_dirfd, const char *src,
+                      int dst_dirfd, const char *dst)
+{
+    tree_dir root;
+
+    root.walk = w;
+    root.parent = NULL;
+    root.src_parent = src_dirfd;
+    root.dst_parent = dst_dirfd;
+    root.name = src;
+    root.dst_name = dst;
+    root.depth = 0;
+    root.release = 0;
+    walk_dir(&root);
+    if (w->error != 0) {
+        errno = w->error;
+        return -1;
+    }
+    return 0;
+}   /* walk_root */
+
+
+int tree_copy (int src_dirfd, const char *src, int dst_dirfd, const char *dst,
+               int flags)
+{
+    tree_walk w;
+    struct stat sb;
+
+    walk_init(&w, TREE_COPY, flags);
+    if (fstatat(src_dirfd, src, &sb,
+                flags & TREE_FOLLOW ? 0 : AT_SYMLINK_NOFOLLOW) == -1)
+        return -1;                                            // Exit on error.
+    if (S_ISDIR(sb.st_mode))
+        return walk_root(&w, src_dirfd, src, dst_dirfd, dst);
+
+    copy_entry(&w, src_dirfd, src, dst_dirfd, dst, IFTODT(sb.st_mode));
+    if (w.error != 0) {
+        errno = w.error;
+        return -1;
+    }
+    return 0;
+}   /* tree_copy */
+
+
+int tree_remove (int dirfd, const char *path)
+{
+    tree_walk w;
+    struct stat sb;
+
+    walk_init(&w, TREE_REMOVE, 0);
+    if (fstatat(dirfd, path, &sb, AT_SYMLINK_NOFOLLOW) == -1)
+        return -1;                                            // Exit on error.
+    if (S_ISDIR(sb.st_mode))
+        return walk_root(&w, dirfd, path, dirfd, NULL);
+    return unlinkat(dirfd, path, 0);
+}   /* tree_remove */
@@ -0,0 +1,47 @@
+/*
+ *  treewalk.h
+ *
+ *  Author: Joseph Erlinger
+ *      Created on: October 17, 2026
+ */
+#ifndef TREEWALK_H
+#define TREEWALK_H
+
+#include <limits.h>
+
+
+#define TREE_FOLLOW 1               // Follow symbolic links (cp -L).
+#define TREE_BUFSIZ (32 << 10)      // Bytes of entries read per directory.
+#define TREE_MAX_DEPTH (PATH_MAX / 2)  // Deeper than any nameable path.
+#define TREE_TASKS_PER_THREAD 4     // Directories queued per pool thread.
+#define TREE_FD_RESERVE 64          // Descriptors a walk leaves to the rest
+                                    //   of the shell.
+
+
+/* Both walks are fd-relative: every entry is reached with openat(2),
+fstatat(2) or unlinkat(2) from its parent's descriptor, so they work at any
+depth and are not confused by paths changing under them. Subdirectories
+become tasks on the worker pool (see pool.h) and are walked in parallel.
+Once TREE_TASKS_PER_THREAD directories per thread are queued, a directory
+is walked by the thread that found it instead, so memory stays bounded on
+wide trees. Each directory being walked holds two descriptors (source and
+copy), so past a depth derived from RLIMIT_NOFILE a directory closes its
+parent while it is walked and reopens it as ".." afterwards, and deep trees
+hold a bounded number of descriptors too; TREE_MAX_DEPTH bounds the
+recursion. A failing entry does not stop the walk. Both return 0 on
+success, or -1 with errno set to the first error. */
+
+
+/* Copy src (relative to src_dirfd) to dst (relative to dst_dirfd), with
+directories copied recursively and modes preserved. A directory at dst is
+merged into. Symbolic links are copied as links unless flags has
+TREE_FOLLOW. */
+int tree_copy (int src_dirfd, const char *src, int dst_dirfd, const char *dst,
+               int flags);
+
+
+/* Remove path (relative to dirfd) and, if it is a directory, everything
+below it. Symbolic links are removed, never followed. */
+int tree_remove (int dirfd, const char *path);
+
+#endif  /* TREEWALK_H */
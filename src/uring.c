@@ -0,0 +1,488 @@
+/*
+ *  uring.c
+ *
+ *  Author: Joseph Erlinger
+ *      Created on: October 17, 2026
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#include "uring.h"
+#include "iobackend.h"
+#include "arena.h"
+
+
+#define RING_ENTRIES (2 * URING_MAX_DEPTH)  // A read and a write per block.
+
+#define SLOT_FREE 0
+#define SLOT_BUSY 1
+#define SLOT_DONE 2             // Written, but an earlier block is not yet.
+
+
+/* The shared rings of one io_uring instance, mapped from the kernel. */
+typedef struct ring {
+    int fd;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_map, *cq_map;
+    size_t sq_len, cq_len, sqes_len;
+    char *bufs;             // nbufs registered buffers of URING_BLOCK bytes.
+    int nbufs;
+    unsigned tail;          // Our copy of the SQ tail, ahead of *sq_tail.
+    unsigned submitted;     // SQ tail as of the last io_uring_enter.
+} ring;
+
+
+/* One block being copied. */
+typedef struct slot {
+    int state;
+    off_t rel;              // Offset of the block from the start of the copy.
+    unsigned len;           // # Bytes in the block (fewer once EOF is seen).
+    unsigned filled;        // # Bytes of the block read so far.
+    unsigned written;       // # Bytes of the block written so far.
+    int read_res;           // Result of the linked read, once known.
+    int linked;             // The linked read/write pair is still in flight.
+} slot;
+
+
+static __thread ring *thread_ring;  // Each thread keeps its own ring.
+static int uring_state;             // 0 = untested, 1 = works, -1 = doesn't.
+
+
+static int sys_io_uring_setup (unsigned entries, struct io_uring_params *p)
+{
+    return syscall(__NR_io_uring_setup, entries, p);
+}   /* sys_io_uring_setup */
+
+
+static int sys_io_uring_enter (int fd, unsigned submit, unsigned wait,
+                               unsigned flags)
+{
+    return syscall(__NR_io_uring_enter, fd, submit, wait, flags, NULL, 0);
+}   /* sys_io_uring_enter */
+
+
+static int sys_io_uring_register (int fd, unsigned op, void *arg,
+                                  unsigned nargs)
+{
+    return syscall(__NR_io_uring_register, fd, op, arg, nargs);
+}   /* sys_io_uring_register */
+
+
+static void ring_destroy (ring *r)
+{
+    if (r->sqes != NULL && r->sqes != MAP_FAILED)
+        munmap(r->sqes, r->sqes_len);
+    if (r->cq_map != NULL && r->cq_map != MAP_FAILED && r->cq_map != r->sq_map)
+        munmap(r->cq_map, r->cq_len);
+    if (r->sq_map != NULL && r->sq_map != MAP_FAILED)
+        munmap(r->sq_map, r->sq_len);
+    if (r->fd != -1)
+        close(r->fd);
+    counted_free(r->bufs);
+    counted_free(r);
+}   /* ring_destroy */
+
+
+/* Create the calling thread's ring and map its queues. */
+static ring *ring_create (void)
+{
+    struct io_uring_params p;
+    ring *r;
+    char *sq, *cq;
+
+    if ((r = counted_malloc(sizeof(ring))) == NULL)
+        return NULL;
+    memset(r, 0, sizeof(ring));
+    memset(&p, 0, sizeof(p));
+    if ((r->fd = sys_io_uring_setup(RING_ENTRIES, &p)) == -1)
+        goto error;
+
+    r->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (r->cq_len > r->sq_len)
+            r->sq_len = r->cq_len;
+        r->cq_len = r->sq_len;
+    }
+    r->sq_map = mmap(NULL, r->sq_len, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    if (r->sq_map == MAP_FAILED)
+        goto error;
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+        r->cq_map = r->sq_map;
+    else
+        r->cq_map = mmap(NULL, r->cq_len, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+    if (r->cq_map == MAP_FAILED)
+        goto error;
+    r->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = mmap(NULL, r->sqes_len, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED)
+        goto error;
+
+    sq = r->sq_map;
+    cq = r->cq_map;
+    r->tail = r->submitted = *(unsigned *) (sq + p.sq_off.tail);
+    r->sq_head = (unsigned *) (sq + p.sq_off.head);
+    r->sq_tail = (unsigned *) (sq + p.sq_off.tail);
+    r->sq_mask = (unsigned *) (sq + p.sq_off.ring_mask);
+    r->sq_array = (unsigned *) (sq + p.sq_off.array);
+    r->cq_head = (unsigned *) (cq + p.cq_off.head);
+    r->cq_tail = (unsigned *) (cq + p.cq_off.tail);
+    r->cq_mask = (unsigned *) (cq + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *) (cq + p.cq_off.cqes);
+    return r;
+
+    error:
+    ring_destroy(r);
+    return NULL;
+}   /* ring_create */
+
+
+/* Make sure at least n buffers are allocated and registered with the ring,
+so the kernel pins them once instead of on every request. Returns -1 with
+errno ENOSYS if they cannot be (e.g. RLIMIT_MEMLOCK is too low), so the
+caller falls back to another method. */
+static int ring_buffers (ring *r, int n)
+{
+    struct iovec iov[URING_MAX_DEPTH];
+    void *bufs;
+    int i;
+
+    if (r->nbufs >= n)
+        return 0;
+    if (r->nbufs > 0)
+        sys_io_uring_register(r->fd, IORING_UNREGISTER_BUFFERS, NULL, 0);
+    counted_free(r->bufs);
+    r->bufs = NULL;
+    r->nbufs = 0;
+    if ((bufs = counted_memalign(4096, (size_t) n * URING_BLOCK)) == NULL) {
+        errno = ENOSYS;
+        return -1;
+    }
+    for (i = 0; i < n; i++) {
+        iov[i].iov_base = (char *) bufs + (size_t) i * URING_BLOCK;
+        iov[i].iov_len = URING_BLOCK;
+    }
+    if (sys_io_uring_register(r->fd, IORING_REGISTER_BUFFERS, iov, n) == -1) {
+        counted_free(bufs);
+        errno = ENOSYS;
+        return -1;
+    }
+    r->bufs = bufs;
+    r->nbufs = n;
+    return 0;
+}   /* ring_buffers */
+
+
+/* Queue a fixed-buffer read or write of buffer idx. */
+static void ring_queue (ring *r, int opcode, int fd, int idx, unsigned skip,
+                        unsigned len, off_t off, int flags, __u64 user_data)
+{
+    struct io_uring_sqe *sqe;
+    unsigned index;
+
+    index = r->tail & *r->sq_mask;
+    sqe = &r->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->flags = flags;
+    sqe->addr = (unsigned long) (r->bufs + (size_t) idx * URING_BLOCK + skip);
+    sqe->len = len;
+    sqe->off = off;
+    sqe->buf_index = idx;
+    sqe->user_data = user_data;
+    r->sq_array[index] = index;
+    r->tail++;
+}   /* ring_queue */
+
+
+/* Submit the queued SQEs and wait for at least one completion. */
+static int ring_submit_and_wait (ring *r)
+{
+    int n;
+
+    __atomic_store_n(r->sq_tail, r->tail, __ATOMIC_RELEASE);
+    do {
+        n = sys_io_uring_enter(r->fd, r->tail - r->submitted, 1,
+                               IORING_ENTER_GETEVENTS);
+    } while (n == -1 && errno == EINTR);
+    if (n == -1)
+        return -1;
+    r->submitted += n;
+    return 0;
+}   /* ring_submit_and_wait */
+
+
+/* Queue the linked read and write of one block. */
+static void queue_block (ring *r, slot *s, int idx, int in_fd, off_t in_off,
+                         int out_fd, off_t out_off)
+{
+    ring_queue(r, IORING_OP_READ_FIXED, in_fd, idx, 0, s->len,
+               in_off + s->rel, IOSQE_IO_LINK, (__u64) idx << 1);
+    ring_queue(r, IORING_OP_WRITE_FIXED, out_fd, idx, 0, s->len,
+               out_off + s->rel, 0, (__u64) idx << 1 | 1);
+    s->linked = 1;
+}   /* queue_block */
+
+
+/* Queue the next request of block idx: the rest of its read (after a short
+one), then the rest of its write. Once both are complete the block is
+done. */
+static void advance_block (ring *r, slot *s, int idx, int in_fd, off_t in_off,
+                           int out_fd, off_t out_off)
+{
+    if (s->filled < s->len)
+        ring_queue(r, IORING_OP_READ_FIXED, in_fd, idx, s->filled,
+                   s->len - s->filled, in_off + s->rel + s->filled, 0,
+                   (__u64) idx << 1);
+    else if (s->written < s->len)
+        ring_queue(r, IORING_OP_WRITE_FIXED, out_fd, idx, s->written,
+                   s->len - s->written, out_off + s->rel + s->written, 0,
+                   (__u64) idx << 1 | 1);
+    else
+        s->state = SLOT_DONE;
+}   /* advance_block */
+
+
+/* Account for a read of res bytes into the block. A read of 0 bytes is the
+end of the source, which shortens the block and moves *end to it. Returns
+0, or the errno of a failed read. */
+static int block_read (slot *s, int res, off_t *end)
+{
+    if (res < 0)
+        return -res;
+    if (res == 0 && s->filled < s->len) {
+        s->len = s->filled;
+        if (s->rel + s->len < *end)
+            *end = s->rel + s->len;
+    }
+    s->filled += res;
+    return 0;
+}   /* block_read */
+
+
+off_t uring_transfer (int in_fd, off_t in_off, int out_fd, off_t out_off,
+                      off_t len, int depth)
+{
+    ring *r;                // This thread's ring.
+    slot slots[URING_MAX_DEPTH];
+    struct io_uring_cqe *cqe;
+    unsigned head;
+    off_t next;             // Offset (from the start) of the next block.
+    off_t copied;           // # Bytes written with no gap before them.
+    off_t end;              // Where the source ended, or len.
+    int inflight;           // # Slots not free.
+    int error;              // First error, as a positive errno.
+    int err;                // errno of the completion being reaped.
+    int idx, i, res, more;
+    slot *s;
+
+    if (!uring_available()) {
+        errno = ENOSYS;
+        return -1;
+    }
+    if (depth < 1)
+        depth = 1;
+    if (depth > URING_MAX_DEPTH)
+        depth = URING_MAX_DEPTH;
+    if ((r = thread_ring) == NULL && (r = thread_ring = ring_create()) == NULL) {
+        errno = ENOSYS;
+        return -1;
+    }
+    if (ring_buffers(r, depth) == -1)
+        return -1;                                    // errno is ENOSYS.
+
+    for (i = 0; i < depth; i++)
+        slots[i].state = SLOT_FREE;
+    next = copied = 0;
+    end = len;
+    inflight = error = 0;
+
+    for (;;) {
+        /* Keep every free slot busy with the next block. */
+        for (i = 0; i < depth && next < end && !error; i++) {
+            if (slots[i].state != SLOT_FREE)
+                continue;
+            s = &slots[i];
+            s->state = SLOT_BUSY;
+            s->rel = next;
+            s->len = end - next > URING_BLOCK ? URING_BLOCK : end - next;
+            s->filled = s->written = 0;
+            s->read_res = -1;
+            next += s->len;
+            queue_block(r, s, i, in_fd, in_off, out_fd, out_off);
+            inflight++;
+        }
+        if (inflight == 0)
+            break;
+        if (ring_submit_and_wait(r) == -1) {
+            if (error == 0)
+                error = errno;
+            break;               // Nothing can complete if we cannot enter.
+        }
+
+        /* Reap every completion that is ready. */
+        head = *r->cq_head;
+        while (head != __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)) {
+            cqe = &r->cqes[head & *r->cq_mask];
+            idx = cqe->user_data >> 1;
+            res = cqe->res;
+            s = &slots[idx];
+            head++;
+
+            if (!(cqe->user_data & 1) && s->linked) {
+                s->read_res = res;            // Its write completes next.
+                continue;
+            }
+            if (!(cqe->user_data & 1)) {            // A resubmitted read.
+                err = block_read(s, res, &end);
+            } else if (s->linked) {
+                /* The linked write. A short read cancels it, and the rest
+                of the block is then read before it is written. */
+                s->linked = 0;
+                if (res > 0)
+                    s->written += res;
+                err = block_read(s, s->read_res, &end);
+                if (err == 0 && res <= 0 && res != -ECANCELED)
+                    err = res == 0 ? EIO : -res;
+            } else if (res > 0) {                   // A resubmitted write.
+                s->written += res;
+                err = 0;
+            } else {
+                err = res == 0 ? EIO : -res;
+            }
+
+            if (err != 0 && error == 0)
+                error = err;
+            if (error != 0) {
+                s->state = SLOT_FREE;               // Give up on the block.
+                inflight--;
+                continue;
+            }
+            advance_block(r, s, idx, in_fd, in_off, out_fd, out_off);
+        }
+        __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+
+        /* Count finished blocks in order, so copied never spans a gap. */
+        do {
+            more = 0;
+            for (i = 0; i < depth; i++) {
+                s = &slots[i];
+                if (s->state != SLOT_DONE)
+                    continue;
+                if (s->rel == copied && s->rel < end && error == 0) {
+                    copied += s->len;
+                    more = 1;
+                } else if (s->rel < end && error == 0) {
+                    continue;               // An earlier block is not done.
+                }
+                s->state = SLOT_FREE;
+                inflight--;
+            }
+        } while (more);
+    }
+
+    if (error != 0) {
+        errno = error;
+        return -1;
+    }
+    return copied;
+}   /* uring_transfer */
+
+
+int uring_sync (const int *fds, const int *datasync, int *errors, int n)
+{
+    ring *r;                // This thread's ring.
+    struct io_uring_sqe *sqe;
+    struct io_uring_cqe *cqe;
+    unsigned head, index;
+    int queued, done;       // # Syncs queued, and completed.
+    int error;              // First error, as a positive errno.
+
+    if (!uring_available()) {
+        errno = ENOSYS;
+        return -1;
+    }
+    if ((r = thread_ring) == NULL && (r = thread_ring = ring_create()) == NULL)
+        return -1;
+
+    for (done = 0; errors != NULL && done < n; done++)
+        errors[done] = ECANCELED;
+    queued = done = error = 0;
+    while (done < n) {
+        for (; queued < n && queued - done < RING_ENTRIES; queued++) {
+            index = r->tail & *r->sq_mask;
+            sqe = &r->sqes[index];
+            memset(sqe, 0, sizeof(*sqe));
+            sqe->opcode = IORING_OP_FSYNC;
+            sqe->fd = fds[queued];
+            sqe->fsync_flags = datasync[queued] ? IORING_FSYNC_DATASYNC : 0;
+            sqe->user_data = queued;
+            r->sq_array[index] = index;
+            r->tail++;
+        }
+        if (ring_submit_and_wait(r) == -1)
+            return -1;
+        head = *r->cq_head;
+        while (head != __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)) {
+            cqe = &r->cqes[head & *r->cq_mask];
+            if (cqe->res < 0 && error == 0)
+                error = -cqe->res;
+            if (errors != NULL)
+                errors[cqe->user_data] = cqe->res < 0 ? -cqe->res : 0;
+            head++;
+            done++;
+        }
+        __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+    }
+    if (error != 0) {
+        errno = error;
+        return -1;
+    }
+    return 0;
+}   /* uring_sync */
+
+
+void uring_release (void)
+{
+    if (thread_ring != NULL)
+        ring_destroy(thread_ring);
+    thread_ring = NULL;
+}   /* uring_release */
+
+
+int uring_available (void)
+{
+    int state;
+    ring *r;
+
+    state = __atomic_load_n(&uring_state, __ATOMIC_RELAXED);
+    if (state == 0) {
+        r = thread_ring != NULL ? thread_ring : (thread_ring = ring_create());
+        state = r != NULL ? 1 : -1;
+        __atomic_store_n(&uring_state, state, __ATOMIC_RELAXED);
+    }
+    return state == 1;
+}   /* uring_available */
+
+
+static off_t uring_backend_transfer (int in_fd, off_t in_off, int out_fd,
+                                     off_t out_off, off_t len)
+{
+    return uring_transfer(in_fd, in_off, out_fd, out_off, len, URING_DEPTH);
+}   /* uring_backend_transfer */
+
+
+const io_backend uring_backend = { "io_uring", uring_backend_transfer };
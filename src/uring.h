@@ -0,0 +1,45 @@
+/*
+ *  uring.h
+ *
+ *  Author: Joseph Erlinger
+ *      Created on: October 17, 2026
+ */
+#ifndef URING_H
+#define URING_H
+
+#include <sys/types.h>
+
+
+#define URING_DEPTH 8               // Default # blocks in flight.
+#define URING_MAX_DEPTH 64
+#define URING_BLOCK (256 << 10)     // Bytes per read/write pair.
+
+
+/* Copy len bytes from in_fd at in_off to out_fd at out_off with up to depth
+blocks in flight at once. Each block is a READ_FIXED linked to a
+WRITE_FIXED of the same registered buffer; short reads and writes are
+resubmitted, and only a read of 0 bytes ends the copy early. Returns the #
+bytes copied with no gap before them, or -1 with errno set (ENOSYS if the
+ring or its buffers cannot be set up, so the caller can use another
+method). */
+off_t uring_transfer (int in_fd, off_t in_off, int out_fd, off_t out_off,
+                      off_t len, int depth);
+
+
+/* Sync the n descriptors fds with one submission, so the filesystem can
+fold the syncs into one journal commit: fdatasync(2) for each where
+datasync[i] is set, fsync(2) for the others. Unless errors is NULL, errors[i]
+is set to the errno of the sync of fds[i], 0, or ECANCELED if it was not
+waited for. Returns 0, or -1 with errno set to the first failure (ENOSYS if
+io_uring cannot be used, and errors is then left alone). */
+int uring_sync (const int *fds, const int *datasync, int *errors, int n);
+
+
+/* Free the calling thread's ring, before the thread exits. */
+void uring_release (void);
+
+
+/* Returns true if io_uring can be used by this process. */
+int uring_available (void);
+
+#endif  /* URING_H */